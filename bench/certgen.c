@@ -0,0 +1,298 @@
+/*
+ * certgen.c
+ *
+ * Generates a synthetic corpus for benchmarking certcheck: <n> certificates
+ * signed by one generated CA, and an input csv naming them.
+ *
+ * Certificates vary in key algorithm and size, SAN count, wildcard names,
+ * expiry state, CA flag and extended key usage. Keys are drawn from a small
+ * pool per kind, as key generation would otherwise dominate. Output is deterministic for a seed.
+ */
+#include <openssl/bio.h>
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define EXIT_USAGE 64
+#define EXIT_GENERATE_FAIL 1
+
+#define SECONDS_PER_DAY (60*60*24)
+#define KEYS_PER_KIND 2
+#define NAME_BUFFER_LEN 256
+#define SAN_BUFFER_LEN (64*1024)
+#define MAX_SAN 200
+
+/* Domain all generated names live under */
+#define BENCH_DOMAIN "bench.test"
+
+typedef struct key_kind keyKind_t;
+struct key_kind {
+	int type;		/* EVP_PKEY_RSA, EVP_PKEY_EC or EVP_PKEY_ED25519 */
+	int parameter;	/* RSA modulus bits, or curve NID */
+	int weight;		/* Relative frequency in the corpus */
+	EVP_PKEY* key[KEYS_PER_KIND];
+};
+
+static keyKind_t keyKind[]={
+	{ EVP_PKEY_RSA, 1024, 10, { NULL } },
+	{ EVP_PKEY_RSA, 2048, 45, { NULL } },
+	{ EVP_PKEY_RSA, 3072, 15, { NULL } },
+	{ EVP_PKEY_RSA, 4096, 5, { NULL } },
+	{ EVP_PKEY_EC, NID_X9_62_prime256v1, 15, { NULL } },
+	{ EVP_PKEY_EC, NID_secp384r1, 5, { NULL } },
+	{ EVP_PKEY_ED25519, 0, 5, { NULL } },
+};
+#define N_KEY_KIND ((int)(sizeof(keyKind)/sizeof(keyKind[0])))
+
+static uint64_t randomState;
+
+static uint64_t nextRandom(void);
+static int randomBelow(int n);
+static EVP_PKEY* generateKey(int type, int parameter);
+static void addExtension(X509* cert, X509* issuer, int nid, const char* value);
+static X509* createCertificate(int serial, EVP_PKEY* key, X509* issuer, EVP_PKEY* issuerKey,
+		long notBeforeDays, long notAfterDays, const char* commonName, const char* san,
+		int ca, const char* usage);
+static void writeCertificate(const char* path, X509* cert);
+static void generateFail(const char* m);
+static void printUsage(const char* program);
+
+int main(int argc, char** argv) {
+	int option;
+	int nCert=1000;
+	long nRow=100000;
+	double repeatRatio=0.5;
+	const char* directory="bench/corpus";
+	char path[PATH_MAX];
+	char name[NAME_BUFFER_LEN];
+
+	randomState=1;
+	while((option=getopt(argc, argv, "n:r:p:o:s:"))!=-1){
+		switch(option){
+		case 'n': nCert=atoi(optarg); break;
+		case 'r': nRow=atol(optarg); break;
+		case 'p': repeatRatio=atof(optarg); break;
+		case 'o': directory=optarg; break;
+		case 's': randomState=strtoull(optarg, NULL, 10)|1; break;
+		default:
+			printUsage(argv[0]);
+			exit(EXIT_USAGE);
+		}
+	}
+	if(nCert<1 || nRow<0 || repeatRatio<0 || repeatRatio>1){
+		printUsage(argv[0]);
+		exit(EXIT_USAGE);
+	}
+	mkdir(directory, 0755);
+
+	/* Issuing CA */
+	EVP_PKEY* caKey=generateKey(EVP_PKEY_RSA, 2048);
+	X509* ca=createCertificate(1, caKey, NULL, caKey, -3650, 3650, "Bench CA", NULL, 1, NULL);
+	snprintf(path, sizeof(path), "%s/ca.pem", directory);
+	writeCertificate(path, ca);
+
+	/* Key pool */
+	int totalWeight=0;
+	for(int kx=0;kx<N_KEY_KIND;kx++){
+		totalWeight+=keyKind[kx].weight;
+		for(int px=0;px<KEYS_PER_KIND;px++){
+			keyKind[kx].key[px]=generateKey(keyKind[kx].type, keyKind[kx].parameter);
+		}
+	}
+
+	/* Certificates. Certificate <ix> answers to host<ix>.bench.test, to
+	 * host<ix>-<sx>.bench.test for each extra SAN, and to any single label
+	 * under w<ix>.bench.test if it has a wildcard. */
+	char* san=malloc(SAN_BUFFER_LEN);
+	int* nSan=malloc(sizeof(int)*nCert);
+	char* hasWildcard=malloc(nCert);
+	for(int ix=0;ix<nCert;ix++){
+
+		/* Key kind by weight */
+		int pick=randomBelow(totalWeight);
+		int kx=0;
+		while(pick>=keyKind[kx].weight){
+			pick-=keyKind[kx].weight;
+			kx++;
+		}
+		EVP_PKEY* key=keyKind[kx].key[randomBelow(KEYS_PER_KIND)];
+
+		/* Validity: mostly current, some expired, some not yet valid */
+		int state=randomBelow(100);
+		long notBefore=(state<75)?-1:((state<90)?-400:30);
+		long notAfter=(state<75)?365:((state<90)?-30:400);
+
+		/* A few CDN style certificates carry many names */
+		nSan[ix]=(randomBelow(100)<2)?MAX_SAN:randomBelow(8);
+		hasWildcard[ix]=(randomBelow(100)<30);
+
+		size_t used=snprintf(san, SAN_BUFFER_LEN, "DNS:host%d." BENCH_DOMAIN, ix);
+		for(int sx=0;sx<nSan[ix];sx++){
+			used+=snprintf(san+used, SAN_BUFFER_LEN-used, ",DNS:host%d-%d." BENCH_DOMAIN, ix, sx);
+		}
+		if(hasWildcard[ix]){
+			snprintf(san+used, SAN_BUFFER_LEN-used, ",DNS:*.w%d." BENCH_DOMAIN, ix);
+		}
+
+		/* Usage: mostly server, some client only, some without the extension */
+		int usagePick=randomBelow(100);
+		const char* usage=(usagePick<60)?"serverAuth"
+				:(usagePick<80)?"serverAuth,clientAuth"
+				:(usagePick<90)?"clientAuth":NULL;
+
+		snprintf(name, sizeof(name), "host%d." BENCH_DOMAIN, ix);
+		X509* cert=createCertificate(ix+2, key, ca, caKey, notBefore, notAfter, name, san,
+				randomBelow(100)<5, usage);
+		snprintf(path, sizeof(path), "%s/cert%06d.pem", directory, ix);
+		writeCertificate(path, cert);
+		X509_free(cert);
+	}
+
+	/* Input rows. A row repeats an already named certificate with probability
+	 * <repeatRatio>, else names the next one. Most domains should match. */
+	snprintf(path, sizeof(path), "%s/input.csv", directory);
+	FILE* csv=fopen(path, "w");
+	if(csv==NULL){generateFail("Failed to write input csv");}
+
+	int nNamed=0;
+	for(long rx=0;rx<nRow;rx++){
+		int ix;
+		if(nNamed==0 || (nNamed<nCert && randomBelow(1000)>=repeatRatio*1000)){
+			ix=nNamed++;
+		} else {
+			ix=randomBelow(nNamed);
+		}
+
+		int domainPick=randomBelow(100);
+		if(domainPick<40){
+			snprintf(name, sizeof(name), "host%d." BENCH_DOMAIN, ix);
+		} else if(domainPick<60 && nSan[ix]>0){
+			snprintf(name, sizeof(name), "HOST%d-%d." BENCH_DOMAIN, ix, randomBelow(nSan[ix]));
+		} else if(domainPick<75 && hasWildcard[ix]){
+			snprintf(name, sizeof(name), "www%d.w%d." BENCH_DOMAIN, randomBelow(100), ix);
+		} else if(domainPick<85){
+			snprintf(name, sizeof(name), "a.b.w%d." BENCH_DOMAIN, ix);
+		} else {
+			snprintf(name, sizeof(name), "miss%d.example.org", randomBelow(nCert));
+		}
+		fprintf(csv, "%s/cert%06d.pem,%s\n", directory, ix, name);
+	}
+	fclose(csv);
+
+	for(int kx=0;kx<N_KEY_KIND;kx++){
+		for(int px=0;px<KEYS_PER_KIND;px++){
+			EVP_PKEY_free(keyKind[kx].key[px]);
+		}
+	}
+	X509_free(ca);
+	EVP_PKEY_free(caKey);
+	free(san);
+	free(nSan);
+	free(hasWildcard);
+	return(0);
+}
+
+static uint64_t nextRandom(void) {
+	/* xorshift64 */
+	randomState^=randomState<<13;
+	randomState^=randomState>>7;
+	randomState^=randomState<<17;
+	return(randomState);
+}
+
+static int randomBelow(int n) {
+	return((int)(nextRandom()%(uint64_t)n));
+}
+
+static EVP_PKEY* generateKey(int type, int parameter) {
+	EVP_PKEY* key=NULL;
+	EVP_PKEY_CTX* context=EVP_PKEY_CTX_new_id(type, NULL);
+
+	if(context==NULL || EVP_PKEY_keygen_init(context)<=0
+			|| (type==EVP_PKEY_RSA && EVP_PKEY_CTX_set_rsa_keygen_bits(context, parameter)<=0)
+			|| (type==EVP_PKEY_EC && EVP_PKEY_CTX_set_ec_paramgen_curve_nid(context, parameter)<=0)
+			|| EVP_PKEY_keygen(context, &key)<=0){
+		generateFail("Failed to generate key");
+	}
+	EVP_PKEY_CTX_free(context);
+	return(key);
+}
+
+static void addExtension(X509* cert, X509* issuer, int nid, const char* value) {
+	X509V3_CTX context;
+	X509V3_set_ctx(&context, issuer, cert, NULL, NULL, 0);
+
+	X509_EXTENSION* extension=X509V3_EXT_conf_nid(NULL, &context, nid, value);
+	if(extension==NULL || !X509_add_ext(cert, extension, -1)){
+		generateFail("Failed to add extension");
+	}
+	X509_EXTENSION_free(extension);
+}
+
+static X509* createCertificate(int serial, EVP_PKEY* key, X509* issuer, EVP_PKEY* issuerKey,
+		long notBeforeDays, long notAfterDays, const char* commonName, const char* san,
+		int ca, const char* usage) {
+	/**
+	 * Create a certificate for <key> signed by <issuerKey>. <issuer> NULL
+	 * makes it self signed. <san> and <usage> are OpenSSL config values,
+	 * NULL to leave the extension out.
+	 */
+	X509* cert=X509_new();
+	if(cert==NULL){generateFail("Failed to create certificate");}
+
+	X509_set_version(cert, 2);
+	ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+	X509_gmtime_adj(X509_getm_notBefore(cert), notBeforeDays*SECONDS_PER_DAY);
+	X509_gmtime_adj(X509_getm_notAfter(cert), notAfterDays*SECONDS_PER_DAY);
+	X509_set_pubkey(cert, key);
+
+	X509_NAME* subject=X509_get_subject_name(cert);
+	X509_NAME_add_entry_by_txt(subject, "O", MBSTRING_ASC, (const unsigned char*)"certcheck bench", -1, -1, 0);
+	X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, (const unsigned char*)commonName, -1, -1, 0);
+	X509_set_issuer_name(cert, X509_get_subject_name((issuer==NULL)?cert:issuer));
+
+	if(issuer==NULL){issuer=cert;}
+	addExtension(cert, issuer, NID_basic_constraints, ca?"critical,CA:TRUE":"CA:FALSE");
+	addExtension(cert, issuer, NID_subject_key_identifier, "hash");
+	addExtension(cert, issuer, NID_authority_key_identifier, "keyid");
+	if(san!=NULL){
+		addExtension(cert, issuer, NID_subject_alt_name, san);
+	}
+	if(usage!=NULL){
+		addExtension(cert, issuer, NID_ext_key_usage, usage);
+	}
+
+	if(!X509_sign(cert, issuerKey, EVP_sha256())){
+		generateFail("Failed to sign certificate");
+	}
+	return(cert);
+}
+
+static void writeCertificate(const char* path, X509* cert) {
+	FILE* f=fopen(path, "w");
+	if(f==NULL || !PEM_write_X509(f, cert)){
+		generateFail("Failed to write certificate");
+	}
+	fclose(f);
+}
+
+static void generateFail(const char* m) {
+	fprintf(stderr, "%s\n", m);
+	exit(EXIT_GENERATE_FAIL);
+}
+
+static void printUsage(const char* program) {
+	fprintf(stderr, "usage: %s [-n certificates] [-r rows] [-p repeatRatio] [-o directory] [-s seed]\n",
+			program);
+}
@@ -0,0 +1,299 @@
+/*
+ * hostbench.c
+ *
+ * Microbenchmarks of hostname comparison, run by `make microbench`: the case
+ * folding kernels of caseTool on their own, then matching domains against the
+ * names of a CDN style certificate with each kernel and with the regex
+ * matcher of -R.
+ *
+ * Times are the best of BENCH_REPEAT runs, in ns per call. Before timing, each
+ * kernel is checked against the scalar one, so a broken kernel fails rather
+ * than timing well.
+ */
+#include "caseTool.h"
+#include "hostnameTool.h"
+#include "regexTool.h"
+#include "timing.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_REPEAT 5
+#define KERNEL_CALLS 1000000
+#define N_SAN 200
+#define N_DOMAIN 256
+#define REGEX_DOMAINS 16
+#define NAME_LEN 256
+
+/* Kernels are checked on each length up to CHECK_MAX_LENGTH, at each offset
+ * below CHECK_OFFSETS, CHECK_ROUNDS times */
+#define CHECK_MAX_LENGTH 65
+#define CHECK_OFFSETS 4
+#define CHECK_ROUNDS 64
+#define CHECK_SEED 834198
+
+typedef struct bench_names benchNames_t;
+struct bench_names {
+	char* name[N_SAN];
+	const char* domain[N_DOMAIN];
+	size_t domainLength[N_DOMAIN];
+	char* regex[N_SAN];
+};
+
+static volatile size_t sink;
+
+static void checkKernels(const int* kernels, int nKernel);
+static void checkAllKernels(const int* kernels, int nKernel, const char* a, const char* b,
+		size_t length);
+static int checkKernel(const char* a, const char* b, size_t length);
+static double timeKernel(int fold, const char* a, const char* b, char* out, size_t length);
+static double timeScan(const benchNames_t* names);
+static double timeIndex(const hostnameIndex_t* index, const benchNames_t* names);
+static double timeRegex(const benchNames_t* names);
+static void makeNames(benchNames_t* names);
+static void freeNames(benchNames_t* names);
+
+int main(void) {
+	static const size_t lengths[]={ 8, 15, 24, 40, 64, 128, 253 };
+	static const int kernels[]={ CASE_KERNEL_SCALAR, CASE_KERNEL_SSE2, CASE_KERNEL_AVX2 };
+	int nKernel=(int)(sizeof(kernels)/sizeof(kernels[0]));
+	char a[NAME_LEN];
+	char b[NAME_LEN];
+	char out[NAME_LEN];
+	benchNames_t names;
+
+	/* Equal but for case, so equality reads every byte */
+	for(int ix=0;ix<NAME_LEN;ix++){
+		a[ix]=(ix%7==6)?'.':(char)('a'+ix%26);
+		b[ix]=(ix%2)?(char)(a[ix]&~0x20):a[ix];
+		b[ix]=(a[ix]=='.')?'.':b[ix];
+	}
+	int defaultKernel=caseKernel();
+	checkKernels(kernels, nKernel);
+	useCaseKernel(defaultKernel);
+	printf("default kernel: %s\n\n", caseKernelName(defaultKernel));
+
+	printf("%-10s", "bytes");
+	for(int kx=0;kx<nKernel;kx++){
+		printf("  %8s fold  %7s equal", caseKernelName(kernels[kx]), caseKernelName(kernels[kx]));
+	}
+	printf("\n");
+	for(size_t lx=0;lx<sizeof(lengths)/sizeof(lengths[0]);lx++){
+		printf("%-10zu", lengths[lx]);
+		for(int kx=0;kx<nKernel;kx++){
+			if(!useCaseKernel(kernels[kx])){
+				printf("  %13s %13s", "-", "-");
+				continue;
+			}
+			printf("  %10.2fns  %10.2fns", timeKernel(1, a, b, out, lengths[lx]),
+					timeKernel(0, a, b, out, lengths[lx]));
+		}
+		printf("\n");
+	}
+
+	/* A certificate with N_SAN names, half the domains naming one of them */
+	makeNames(&names);
+	hostnameIndex_t* index=create_hostnameIndex((const char* const*)names.name, N_SAN);
+	if(index==NULL){
+		fprintf(stderr, "Failed to build index\n");
+		exit(EXIT_FAILURE);
+	}
+	printf("\n%d names, ns per domain checked\n", N_SAN);
+	for(int kx=0;kx<nKernel;kx++){
+		if(useCaseKernel(kernels[kx])){
+			printf("%-8s matchHostname scan %10.1fns  index lookup %8.1fns\n",
+					caseKernelName(kernels[kx]), timeScan(&names), timeIndex(index, &names));
+		}
+	}
+	printf("regex    isMatch scan       %10.1fns\n", timeRegex(&names));
+
+	delete_hostnameIndex(index);
+	freeNames(&names);
+	return(0);
+}
+
+static void checkKernels(const int* kernels, int nKernel) {
+	/**
+	 * Compare every kernel the CPU supports with the scalar one on random
+	 * bytes, non-ASCII included, of each length from 0 to
+	 * CHECK_MAX_LENGTH, at unaligned offsets, and exit if any differs.
+	 * <b> is <a> with random case changes, then with one byte changed.
+	 */
+	char a[CHECK_MAX_LENGTH+CHECK_OFFSETS];
+	char b[CHECK_MAX_LENGTH+CHECK_OFFSETS];
+
+	srand(CHECK_SEED);
+	for(int rx=0;rx<CHECK_ROUNDS;rx++){
+		for(size_t length=0;length<=CHECK_MAX_LENGTH;length++){
+			for(int offset=0;offset<CHECK_OFFSETS;offset++){
+				for(size_t ix=0;ix<length;ix++){
+					char c=(char)(rand()&0xff);
+					int letter=((c|0x20)>='a' && (c|0x20)<='z');
+					a[offset+ix]=c;
+					b[offset+ix]=(letter && rand()%2)?(char)(c^0x20):c;
+				}
+				checkAllKernels(kernels, nKernel, a+offset, b+offset, length);
+				if(length>0){
+					b[offset+rand()%length]^=(char)(1+rand()%0xff);
+					checkAllKernels(kernels, nKernel, a+offset, b+offset, length);
+				}
+			}
+		}
+	}
+}
+
+static void checkAllKernels(const int* kernels, int nKernel, const char* a, const char* b,
+		size_t length) {
+	/**
+	 * Exit if any kernel the CPU supports differs from the scalar one on
+	 * <a> and <b>
+	 */
+	for(int kx=0;kx<nKernel;kx++){
+		if(useCaseKernel(kernels[kx]) && !checkKernel(a, b, length)){
+			fprintf(stderr, "%s kernel differs from scalar at length %zu\n",
+					caseKernelName(kernels[kx]), length);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static int checkKernel(const char* a, const char* b, size_t length) {
+	/**
+	 * RETN:
+	 * 	1 if the kernel in use folds <a> and compares it with <b> as the
+	 * 	scalar kernel does, 0 if not. Leaves the kernel in use unchanged.
+	 */
+	char folded[CHECK_MAX_LENGTH+1];
+	char expected[CHECK_MAX_LENGTH+1];
+	int kernel=caseKernel();
+
+	memset(folded, 0, sizeof(folded));
+	memset(expected, 0, sizeof(expected));
+	size_t foldedLength=foldBytes(folded, a, length);
+	int equal=equalFolded(a, b, length);
+	int swapped=equalFolded(b, a, length);
+
+	useCaseKernel(CASE_KERNEL_SCALAR);
+	int same=(foldBytes(expected, a, length)==foldedLength
+			&& memcmp(folded, expected, sizeof(folded))==0
+			&& (equalFolded(a, b, length)!=0)==(equal!=0)
+			&& (equalFolded(b, a, length)!=0)==(swapped!=0));
+	useCaseKernel(kernel);
+	return(same);
+}
+
+static double timeKernel(int fold, const char* a, const char* b, char* out, size_t length) {
+	/**
+	 * Best time of foldBytes, if <fold>, else equalFolded, over <length> bytes
+	 */
+	double best=0;
+	for(int rx=0;rx<BENCH_REPEAT;rx++){
+		uint64_t start=nowNanoseconds();
+		size_t total=0;
+		for(int ix=0;ix<KERNEL_CALLS;ix++){
+			total+=fold?foldBytes(out, a, length):(size_t)equalFolded(a, b, length);
+		}
+		double elapsed=(double)(nowNanoseconds()-start)/KERNEL_CALLS;
+		sink=total;
+		best=(rx==0 || elapsed<best)?elapsed:best;
+	}
+	return(best);
+}
+
+static double timeScan(const benchNames_t* names) {
+	/**
+	 * Best time to match a domain against every name in turn, as done
+	 * for names an index cannot hold
+	 */
+	double best=0;
+	for(int rx=0;rx<BENCH_REPEAT;rx++){
+		uint64_t start=nowNanoseconds();
+		size_t total=0;
+		for(int dx=0;dx<N_DOMAIN;dx++){
+			for(int nx=0;nx<N_SAN;nx++){
+				total+=matchHostname(names->name[nx], strlen(names->name[nx]),
+						names->domain[dx], names->domainLength[dx]);
+			}
+		}
+		double elapsed=(double)(nowNanoseconds()-start)/N_DOMAIN;
+		sink=total;
+		best=(rx==0 || elapsed<best)?elapsed:best;
+	}
+	return(best);
+}
+
+static double timeIndex(const hostnameIndex_t* index, const benchNames_t* names) {
+	double best=0;
+	for(int rx=0;rx<BENCH_REPEAT;rx++){
+		uint64_t start=nowNanoseconds();
+		size_t total=0;
+		for(int cx=0;cx<KERNEL_CALLS/N_DOMAIN;cx++){
+			for(int dx=0;dx<N_DOMAIN;dx++){
+				total+=lookup_hostnameIndex(index, names->domain[dx], names->domainLength[dx]);
+			}
+		}
+		double elapsed=(double)(nowNanoseconds()-start)/(KERNEL_CALLS/N_DOMAIN*N_DOMAIN);
+		sink=total;
+		best=(rx==0 || elapsed<best)?elapsed:best;
+	}
+	return(best);
+}
+
+static double timeRegex(const benchNames_t* names) {
+	/**
+	 * Best time to match a domain against every name with the case
+	 * insensitive regex of -R. Slow, so over REGEX_DOMAINS domains only.
+	 */
+	double best=0;
+	for(int rx=0;rx<BENCH_REPEAT;rx++){
+		uint64_t start=nowNanoseconds();
+		size_t total=0;
+		for(int dx=0;dx<REGEX_DOMAINS;dx++){
+			for(int nx=0;nx<N_SAN;nx++){
+				total+=(isMatch(names->regex[nx], names->domain[dx])==MATCH);
+			}
+		}
+		double elapsed=(double)(nowNanoseconds()-start)/REGEX_DOMAINS;
+		sink=total;
+		best=(rx==0 || elapsed<best)?elapsed:best;
+	}
+	return(best);
+}
+
+static void makeNames(benchNames_t* names) {
+	/**
+	 * Names as certgen gives CDN style certificates, and domains in mixed
+	 * case alternately naming one of them and naming none
+	 */
+	char domain[NAME_LEN];
+	for(int nx=0;nx<N_SAN;nx++){
+		names->name[nx]=malloc(NAME_LEN);
+		names->regex[nx]=malloc(NAME_LEN);
+		if(names->name[nx]==NULL || names->regex[nx]==NULL){
+			fprintf(stderr, "Malloc failed\n");
+			exit(EXIT_FAILURE);
+		}
+		snprintf(names->name[nx], NAME_LEN, "host42-%d.edge.cdn.bench.test", nx);
+		snprintf(names->regex[nx], NAME_LEN, "^host42-%d\\.edge\\.cdn\\.bench\\.test$", nx);
+	}
+	for(int dx=0;dx<N_DOMAIN;dx++){
+		if(dx%2){
+			snprintf(domain, sizeof(domain), "HOST42-%d.Edge.CDN.bench.test", (dx*7)%N_SAN);
+		} else {
+			snprintf(domain, sizeof(domain), "Host42-%d.edge.cdn.bench.example", dx);
+		}
+		names->domain[dx]=strdup(domain);
+		names->domainLength[dx]=strlen(domain);
+	}
+}
+
+static void freeNames(benchNames_t* names) {
+	for(int nx=0;nx<N_SAN;nx++){
+		free(names->name[nx]);
+		free(names->regex[nx]);
+	}
+	for(int dx=0;dx<N_DOMAIN;dx++){
+		free((char*)names->domain[dx]);
+	}
+}
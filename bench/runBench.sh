@@ -0,0 +1,34 @@
+#!/bin/bash
+# End to end throughput of certcheck on a synthetic corpus, run by `make bench`
+#
+# BENCH_CERTS   certificates in the corpus            (default 2000)
+# BENCH_ROWS    input rows                            (default 200000)
+# BENCH_REPEAT  ratio of rows naming a seen certificate (default 0.9)
+# BENCH_THREADS workers of the threaded run           (default nproc)
+# BENCH_DIR     corpus directory, reused while its parameters are unchanged
+
+CERTS=${BENCH_CERTS:-2000}
+ROWS=${BENCH_ROWS:-200000}
+REPEAT=${BENCH_REPEAT:-0.9}
+THREADS=${BENCH_THREADS:-$(nproc)}
+DIR=${BENCH_DIR:-bench/corpus}
+
+PARAMETERS="$CERTS $ROWS $REPEAT"
+if [ "$(cat $DIR/parameters 2>/dev/null)" != "$PARAMETERS" ]; then
+	echo "-- GENERATING $CERTS CERTIFICATES, $ROWS ROWS --"
+	rm -rf $DIR
+	./certgen -n $CERTS -r $ROWS -p $REPEAT -o $DIR || exit 1
+	echo "$PARAMETERS" > $DIR/parameters
+fi
+
+# Warm the page cache, so every run sees the same input
+cat $DIR/*.pem $DIR/input.csv > /dev/null
+
+echo "-- SEQUENTIAL --"
+./certcheck -S -o /dev/null $DIR/input.csv
+
+echo "-- $THREADS THREADS --"
+./certcheck -S -j $THREADS -o /dev/null $DIR/input.csv
+
+echo "-- $THREADS THREADS, REGEX MATCHER --"
+./certcheck -S -R -j $THREADS -o /dev/null $DIR/input.csv
@@ -0,0 +1,322 @@
+/*
+ * certBundle.c
+ *
+ * Reading certificates from files holding one or many, in PEM or DER.
+ */
+#include "certBundle.h"
+#include "hashTool.h"
+#include "logger.h"
+
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/pem.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define EXIT_BUNDLE_MALLOC_FAIL 117
+
+/* Files smaller than this are read rather than mapped, mapping costs more */
+#define BUNDLE_MAP_THRESHOLD (64*1024)
+
+/* Leading byte of a DER certificate, an ASN.1 SEQUENCE */
+#define DER_SEQUENCE_TAG 0x30
+
+static int readFile(int fd, unsigned char* data, size_t length);
+static void* bundleMalloc(size_t size);
+static int sameFile(const bundleOffsets_t* offsets, const struct stat* fileStat);
+
+int splitBundlePath(const char* path, char* file, size_t fileSize, int* index) {
+	/**
+	 * Split <path> into the file it names and the index of a certificate in
+	 * that file, given as file#index. A path naming an existing file is
+	 * taken whole even if it contains CERT_BUNDLE_SEPARATOR.
+	 *
+	 * ARGS:
+	 * 	file - filled with the null terminated file path, <fileSize> bytes
+	 * 	index - set to the certificate index, or CERT_BUNDLE_WHOLE_FILE if
+	 * 	<path> has none
+	 *
+	 * RETN:
+	 * 	0, or -1 if the file path does not fit <file>
+	 */
+	const char* separator=strrchr(path, CERT_BUNDLE_SEPARATOR);
+	size_t fileLength=strlen(path);
+	*index=CERT_BUNDLE_WHOLE_FILE;
+
+	if(separator!=NULL && separator[1]!='\0' && access(path, F_OK)!=0){
+		char* end;
+		errno=0;
+		long parsed=strtol(separator+1, &end, 10);
+		if(*end=='\0' && isdigit((unsigned char)separator[1]) && errno==0 && parsed<=INT_MAX){
+			*index=(int)parsed;
+			fileLength=separator-path;
+		}
+	}
+	if(fileLength>=fileSize){
+		return(-1);
+	}
+	memcpy(file, path, fileLength);
+	file[fileLength]='\0';
+	return(0);
+}
+
+certBundle_t* openCertBundle(const char* path) {
+	/**
+	 * Open the certificate file at <path>. Files starting with a DER
+	 * SEQUENCE are read as concatenated DER, others as PEM.
+	 *
+	 * RETN:
+	 * 	Bundle to close with closeCertBundle, NULL if <path> cannot be read
+	 */
+	struct stat fileStat;
+	int fd=open(path, O_RDONLY);
+	if(fd<0){
+		return(NULL);
+	}
+	if(fstat(fd, &fileStat)!=0 || !S_ISREG(fileStat.st_mode) || fileStat.st_size==0){
+		close(fd);
+		return(NULL);
+	}
+
+	certBundle_t* bundle=bundleMalloc(sizeof(*bundle));
+	bundle->length=fileStat.st_size;
+	bundle->position=0;
+	bundle->mapped=0;
+	bundle->data=NULL;
+
+	if(bundle->length>=BUNDLE_MAP_THRESHOLD){
+		void* data=mmap(NULL, bundle->length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data!=MAP_FAILED){
+			madvise(data, bundle->length, MADV_SEQUENTIAL);
+			bundle->data=data;
+			bundle->mapped=1;
+		}
+	}
+	if(!bundle->mapped){
+		bundle->data=bundleMalloc(bundle->length);
+		if(readFile(fd, bundle->data, bundle->length)!=0){
+			close(fd);
+			closeCertBundle(bundle);
+			return(NULL);
+		}
+	}
+	close(fd);
+
+	bundle->der=(bundle->data[0]==DER_SEQUENCE_TAG);
+	return(bundle);
+}
+
+certBundle_t* openCertBundleBuffer(unsigned char* data, size_t length) {
+	/**
+	 * Open the <length> bytes of a certificate file already read into
+	 * <data>, which the bundle takes and frees on close
+	 *
+	 * RETN:
+	 * 	Bundle to close with closeCertBundle
+	 */
+	certBundle_t* bundle=bundleMalloc(sizeof(*bundle));
+	bundle->data=data;
+	bundle->length=length;
+	bundle->position=0;
+	bundle->mapped=0;
+	bundle->der=(length>0 && data[0]==DER_SEQUENCE_TAG);
+	return(bundle);
+}
+
+X509* nextCert_certBundle(certBundle_t* bundle, size_t* offset) {
+	/**
+	 * Read the next certificate of <bundle>. PEM blocks other than
+	 * certificates are skipped.
+	 *
+	 * ARGS:
+	 * 	offset - set to the position the certificate was read from, for
+	 * 	seek_certBundle. May be NULL.
+	 *
+	 * RETN:
+	 * 	The certificate for the caller to free, NULL at the end of the bundle
+	 * 	or if the rest of it cannot be read
+	 */
+	X509* cert=NULL;
+	size_t remaining=bundle->length-bundle->position;
+	if(remaining==0){
+		return(NULL);
+	}
+	if(offset!=NULL){
+		*offset=bundle->position;
+	}
+
+	if(bundle->der){
+		const unsigned char* scanner=bundle->data+bundle->position;
+		cert=d2i_X509(NULL, &scanner, (long)remaining);
+		if(cert!=NULL){
+			bundle->position=scanner-bundle->data;
+		}
+	} else {
+		int window=(remaining>INT_MAX)?INT_MAX:(int)remaining;
+		BIO* memory=BIO_new_mem_buf(bundle->data+bundle->position, window);
+		if(memory!=NULL){
+			cert=PEM_read_bio_X509(memory, NULL, NULL, NULL);
+			bundle->position+=window-BIO_pending(memory);
+			BIO_free(memory);
+		}
+	}
+
+	if(cert==NULL){
+		/* End of the bundle, or unreadable from here on */
+		bundle->position=bundle->length;
+		ERR_clear_error();
+	}
+	return(cert);
+}
+
+void seek_certBundle(certBundle_t* bundle, size_t offset) {
+	/**
+	 * Continue reading <bundle> from <offset>, given by nextCert_certBundle
+	 */
+	bundle->position=(offset<bundle->length)?offset:bundle->length;
+}
+
+void closeCertBundle(certBundle_t* bundle) {
+	if(bundle==NULL){return;}
+	if(bundle->mapped){
+		munmap(bundle->data, bundle->length);
+	} else {
+		free(bundle->data);
+	}
+	free(bundle);
+}
+
+certBundleTable_t* create_certBundleTable(void) {
+	/**
+	 * Create an empty table, delete with delete_certBundleTable
+	 */
+	certBundleTable_t* table=bundleMalloc(sizeof(*table));
+	memset(table->bucket, 0, sizeof(table->bucket));
+	pthread_mutex_init(&table->lock, NULL);
+	return(table);
+}
+
+void delete_certBundleTable(certBundleTable_t* table) {
+	if(table==NULL){return;}
+	for(int ix=0;ix<CERT_BUNDLE_TABLE_BUCKETS;ix++){
+		while(table->bucket[ix]!=NULL){
+			bundleOffsets_t* offsets=table->bucket[ix];
+			table->bucket[ix]=offsets->next;
+			free(offsets->path);
+			free(offsets->offset);
+			free(offsets);
+		}
+	}
+	pthread_mutex_destroy(&table->lock);
+	free(table);
+}
+
+int findOffset_certBundleTable(certBundleTable_t* table, const char* path,
+		const struct stat* fileStat, int index, size_t* offset) {
+	/**
+	 * Find the offset of certificate <index> of the bundle at <path>, whose
+	 * current stat is <fileStat>
+	 *
+	 * RETN:
+	 * 	1 and <offset> set if known, 0 if the bundle has not been read since
+	 * 	it last changed, -1 if the bundle has no certificate <index>
+	 */
+	int found=0;
+	pthread_mutex_lock(&table->lock);
+
+	bundleOffsets_t* offsets=table->bucket[hashString(path)%CERT_BUNDLE_TABLE_BUCKETS];
+	while(offsets!=NULL && strcmp(offsets->path, path)!=0){
+		offsets=offsets->next;
+	}
+	if(offsets!=NULL && sameFile(offsets, fileStat)){
+		if(index<offsets->nCert){
+			*offset=offsets->offset[index];
+			found=1;
+		} else {
+			found=-1;
+		}
+	}
+
+	pthread_mutex_unlock(&table->lock);
+	return(found);
+}
+
+void record_certBundleTable(certBundleTable_t* table, const char* path,
+		const struct stat* fileStat, const size_t* offset, int nCert) {
+	/**
+	 * Record the <nCert> certificate offsets <offset> of the bundle at
+	 * <path>, read when its stat was <fileStat>. Replaces any earlier record.
+	 */
+	bundleOffsets_t* record=bundleMalloc(sizeof(*record));
+	record->path=strdup(path);
+	record->offset=bundleMalloc(sizeof(size_t)*(nCert>0?nCert:1));
+	if(record->path==NULL){
+		free(record->offset);
+		free(record);
+		return;
+	}
+	memcpy(record->offset, offset, sizeof(size_t)*nCert);
+	record->nCert=nCert;
+	record->device=fileStat->st_dev;
+	record->inode=fileStat->st_ino;
+	record->mtime=fileStat->st_mtime;
+	record->size=fileStat->st_size;
+
+	pthread_mutex_lock(&table->lock);
+	bundleOffsets_t** slot=&table->bucket[hashString(path)%CERT_BUNDLE_TABLE_BUCKETS];
+	while(*slot!=NULL && strcmp((*slot)->path, path)!=0){
+		slot=&(*slot)->next;
+	}
+	bundleOffsets_t* replaced=*slot;
+	record->next=(replaced!=NULL)?replaced->next:NULL;
+	*slot=record;
+	pthread_mutex_unlock(&table->lock);
+
+	if(replaced!=NULL){
+		free(replaced->path);
+		free(replaced->offset);
+		free(replaced);
+	}
+}
+
+static int readFile(int fd, unsigned char* data, size_t length) {
+	/**
+	 * Read exactly <length> bytes of <fd> into <data>
+	 *
+	 * RETN:
+	 * 	0, or -1 on error or early end of file
+	 */
+	size_t done=0;
+	while(done<length){
+		ssize_t n=read(fd, data+done, length-done);
+		if(n<0 && errno==EINTR){
+			continue;
+		}
+		if(n<=0){
+			return(-1);
+		}
+		done+=n;
+	}
+	return(0);
+}
+
+static void* bundleMalloc(size_t size) {
+	void* memory=malloc(size);
+	if(memory==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_BUNDLE_MALLOC_FAIL);
+	}
+	return(memory);
+}
+
+static int sameFile(const bundleOffsets_t* offsets, const struct stat* fileStat) {
+	return(offsets->device==fileStat->st_dev && offsets->inode==fileStat->st_ino
+			&& offsets->mtime==fileStat->st_mtime && offsets->size==fileStat->st_size);
+}
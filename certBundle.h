@@ -0,0 +1,69 @@
+/*
+ * certBundle.h
+ *
+ * Certificates read from PEM bundles and DER files, see certBundle.c.
+ */
+
+#ifndef CERTBUNDLE_H_
+#define CERTBUNDLE_H_
+
+#include <openssl/x509.h>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* Separates a bundle path from the index of a certificate in it, bundle.pem#3 */
+#define CERT_BUNDLE_SEPARATOR '#'
+#define CERT_BUNDLE_WHOLE_FILE -1
+
+#define CERT_BUNDLE_TABLE_BUCKETS 256
+
+/* A file of certificates, PEM blocks or concatenated DER, read in order */
+typedef struct cert_bundle certBundle_t;
+struct cert_bundle {
+	unsigned char* data;
+	size_t length;
+	size_t position;		/* Where reading the next certificate starts */
+	int der;
+	int mapped;
+};
+
+/* Offsets of the certificates of a bundle, so one can be read without
+ * reading those before it */
+typedef struct bundle_offsets bundleOffsets_t;
+struct bundle_offsets {
+	char* path;
+	dev_t device;			/* File identity the offsets were read from */
+	ino_t inode;
+	time_t mtime;
+	off_t size;
+	size_t* offset;
+	int nCert;
+	bundleOffsets_t* next;
+};
+
+/* Offsets of every bundle read so far */
+typedef struct cert_bundle_table certBundleTable_t;
+struct cert_bundle_table {
+	bundleOffsets_t* bucket[CERT_BUNDLE_TABLE_BUCKETS];
+	pthread_mutex_t lock;
+};
+
+int splitBundlePath(const char* path, char* file, size_t fileSize, int* index);
+certBundle_t* openCertBundle(const char* path);
+certBundle_t* openCertBundleBuffer(unsigned char* data, size_t length);
+X509* nextCert_certBundle(certBundle_t* bundle, size_t* offset);
+void seek_certBundle(certBundle_t* bundle, size_t offset);
+void closeCertBundle(certBundle_t* bundle);
+
+certBundleTable_t* create_certBundleTable(void);
+void delete_certBundleTable(certBundleTable_t* table);
+int findOffset_certBundleTable(certBundleTable_t* table, const char* path,
+		const struct stat* fileStat, int index, size_t* offset);
+void record_certBundleTable(certBundleTable_t* table, const char* path,
+		const struct stat* fileStat, const size_t* offset, int nCert);
+
+#endif /* CERTBUNDLE_H_ */
@@ -0,0 +1,296 @@
+/*
+ * certCache.c
+ *
+ * Cache of decoded certificates keyed by path. An entry is only returned while
+ * the file it was decoded from is unchanged (same device, inode, mtime and
+ * size). Entries are evicted least recently used first once the approximate
+ * memory held exceeds the cache's cap.
+ *
+ * The cache may be shared between threads. Entries in use by a caller are
+ * reference counted so eviction cannot free them underneath it.
+ */
+#include "certCache.h"
+#include "hashTool.h"
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define CERT_CACHE_INIT_BUCKETS 256
+#define EXIT_CACHE_MALLOC_FAIL 112
+
+static certCacheEntry_t** findSlot(certCache_t* cache, const char* path);
+static void unlinkLru(certCache_t* cache, certCacheEntry_t* entry);
+static void pushLru(certCache_t* cache, certCacheEntry_t* entry);
+static void removeEntry(certCache_t* cache, certCacheEntry_t* entry);
+static void freeEntry(certCacheEntry_t* entry);
+static void growBuckets(certCache_t* cache);
+static void* cacheMalloc(size_t size);
+static void cacheMallocFail(void);
+
+certCache_t* create_certCache(size_t memoryCap) {
+	/**
+	 * Create an empty certificate cache holding at most ~<memoryCap> bytes
+	 *
+	 * A cap of 0 keeps only the most recently inserted entry.
+	 */
+	certCache_t* cache=cacheMalloc(sizeof(*cache));
+
+	cache->nBucket=CERT_CACHE_INIT_BUCKETS;
+	cache->bucket=cacheMalloc(sizeof(certCacheEntry_t*)*cache->nBucket);
+	memset(cache->bucket, 0, sizeof(certCacheEntry_t*)*cache->nBucket);
+	cache->nEntry=0;
+	cache->lruHead=cache->lruTail=NULL;
+	cache->memoryUsed=0;
+	cache->memoryCap=memoryCap;
+	cache->hit=cache->miss=0;
+	pthread_mutex_init(&cache->lock, NULL);
+	return(cache);
+}
+
+void delete_certCache(certCache_t* cache) {
+	/**
+	 * Free <cache> and every certificate it holds. No entry may still be held.
+	 */
+	if(cache==NULL){return;}
+	while(cache->lruHead!=NULL){
+		removeEntry(cache, cache->lruHead);
+	}
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->bucket);
+	free(cache);
+}
+
+certCacheEntry_t* lookup_certCache(certCache_t* cache, const char* path, const char* file,
+		struct stat* fileStat) {
+	/**
+	 * Find the decoded certificate for <path>, read from <file>
+	 *
+	 * ARGS:
+	 * 	path - key of the certificate, the file path or for a certificate of
+	 * 	a bundle the bundle path and index
+	 * 	fileStat - filled with the current stat of <file>, to be handed to
+	 * 	create_certCacheEntry on a miss. Zeroed if <file> cannot be stat'd.
+	 *
+	 * RETN:
+	 * 	The cached entry, now most recently used and held until passed to
+	 * 	release_certCache. NULL if absent or if the file changed since it was
+	 * 	decoded, in which case the stale entry is dropped.
+	 */
+	if(stat(file, fileStat)!=0){
+		memset(fileStat, 0, sizeof(*fileStat));
+	}
+
+	pthread_mutex_lock(&cache->lock);
+	certCacheEntry_t* entry=*findSlot(cache, path);
+
+	/* The file was replaced or rewritten since it was decoded */
+	if(entry!=NULL && (entry->device!=fileStat->st_dev || entry->inode!=fileStat->st_ino
+			|| entry->mtime!=fileStat->st_mtime || entry->size!=fileStat->st_size)){
+		removeEntry(cache, entry);
+		entry=NULL;
+	}
+
+	if(entry==NULL){
+		cache->miss++;
+	} else {
+		unlinkLru(cache, entry);
+		pushLru(cache, entry);
+		entry->refCount++;
+		cache->hit++;
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return(entry);
+}
+
+certCacheEntry_t* create_certCacheEntry(const char* path, const struct stat* fileStat,
+		certSummary_t* summary, int chainStatus) {
+	/**
+	 * Create an entry for <summary> of the certificate at <path>, whose
+	 * issuer chain has <chainStatus>
+	 *
+	 * The entry takes ownership of <summary>, and indexes its names. Pass
+	 * the entry to insert_certCache, after which it is visible to other threads.
+	 *
+	 * ARGS:
+	 * 	fileStat - stat of <path> taken before the certificate was read
+	 */
+	certCacheEntry_t* entry=cacheMalloc(sizeof(*entry));
+	entry->path=strdup(path);
+	entry->device=fileStat->st_dev;
+	entry->inode=fileStat->st_ino;
+	entry->mtime=fileStat->st_mtime;
+	entry->size=fileStat->st_size;
+	entry->summary=summary;
+	entry->chainStatus=chainStatus;
+
+	const char** domainName=cacheMalloc(sizeof(char*)*(summary->nName+1));
+	const char* name=NULL;
+	int nDomainName=0;
+	while((name=nextName_certSummary(summary, name))!=NULL){
+		domainName[nDomainName++]=name;
+	}
+	entry->domainIndex=create_hostnameIndex(domainName, nDomainName);
+	free(domainName);
+	if(entry->domainIndex==NULL){
+		cacheMallocFail();
+	}
+
+	entry->footprint=sizeof(*entry)+strlen(path)+1+footprint_certSummary(summary)+footprint_hostnameIndex(entry->domainIndex);
+	entry->refCount=1;
+	entry->detached=0;
+	return(entry);
+}
+
+certCacheEntry_t* insert_certCache(certCache_t* cache, certCacheEntry_t* entry) {
+	/**
+	 * Add <entry> from create_certCacheEntry to <cache>
+	 *
+	 * Least recently used entries that are not held are evicted until the
+	 * cache is within its cap.
+	 *
+	 * RETN:
+	 * 	<entry>, held until passed to release_certCache
+	 */
+	const char* path=entry->path;
+
+	pthread_mutex_lock(&cache->lock);
+
+	/* Another thread may have decoded the same path concurrently */
+	certCacheEntry_t** slot=findSlot(cache, path);
+	if(*slot!=NULL){
+		removeEntry(cache, *slot);
+		slot=findSlot(cache, path);
+	}
+
+	entry->hashNext=NULL;
+	*slot=entry;
+	pushLru(cache, entry);
+	cache->nEntry++;
+	cache->memoryUsed+=entry->footprint;
+
+	/* Evict down to the cap, skipping entries still held */
+	certCacheEntry_t* victim=cache->lruTail;
+	while(cache->memoryUsed>cache->memoryCap && victim!=NULL){
+		certCacheEntry_t* previous=victim->lruPrev;
+		if(victim->refCount==0){
+			removeEntry(cache, victim);
+		}
+		victim=previous;
+	}
+
+	if(cache->nEntry>cache->nBucket*2){
+		growBuckets(cache);
+	}
+	pthread_mutex_unlock(&cache->lock);
+	return(entry);
+}
+
+void release_certCache(certCache_t* cache, certCacheEntry_t* entry) {
+	/**
+	 * Release a hold on <entry> obtained from lookup_certCache or insert_certCache
+	 */
+	pthread_mutex_lock(&cache->lock);
+	entry->refCount--;
+	int expired=(entry->refCount==0 && entry->detached);
+	pthread_mutex_unlock(&cache->lock);
+
+	if(expired){
+		freeEntry(entry);
+	}
+}
+
+int contains_certCache(certCache_t* cache, const char* path) {
+	/**
+	 * Whether a certificate is held for <path>, without checking its file
+	 * or counting a use
+	 */
+	pthread_mutex_lock(&cache->lock);
+	int found=(*findSlot(cache, path)!=NULL);
+	pthread_mutex_unlock(&cache->lock);
+	return(found);
+}
+
+static certCacheEntry_t** findSlot(certCache_t* cache, const char* path) {
+	/**
+	 * Return the address of the chain link holding <path>, or of the
+	 * terminating NULL link of its bucket if absent
+	 */
+	certCacheEntry_t** slot=&cache->bucket[hashString(path)&(cache->nBucket-1)];
+	while(*slot!=NULL && strcmp((*slot)->path, path)!=0){
+		slot=&(*slot)->hashNext;
+	}
+	return(slot);
+}
+
+static void unlinkLru(certCache_t* cache, certCacheEntry_t* entry) {
+	if(entry->lruPrev!=NULL){entry->lruPrev->lruNext=entry->lruNext;}
+	else {cache->lruHead=entry->lruNext;}
+	if(entry->lruNext!=NULL){entry->lruNext->lruPrev=entry->lruPrev;}
+	else {cache->lruTail=entry->lruPrev;}
+}
+
+static void pushLru(certCache_t* cache, certCacheEntry_t* entry) {
+	entry->lruPrev=NULL;
+	entry->lruNext=cache->lruHead;
+	if(cache->lruHead!=NULL){cache->lruHead->lruPrev=entry;}
+	cache->lruHead=entry;
+	if(cache->lruTail==NULL){cache->lruTail=entry;}
+}
+
+static void removeEntry(certCache_t* cache, certCacheEntry_t* entry) {
+	/**
+	 * Unlink <entry> from <cache> and free it along with its certificate.
+	 * A held entry is only detached, and freed on its last release.
+	 */
+	certCacheEntry_t** slot=findSlot(cache, entry->path);
+	*slot=entry->hashNext;
+	unlinkLru(cache, entry);
+	cache->nEntry--;
+	cache->memoryUsed-=entry->footprint;
+
+	if(entry->refCount>0){
+		entry->detached=1;
+		return;
+	}
+	freeEntry(entry);
+}
+
+static void freeEntry(certCacheEntry_t* entry) {
+	delete_certSummary(entry->summary);
+	delete_hostnameIndex(entry->domainIndex);
+	free(entry->path);
+	free(entry);
+}
+
+static void growBuckets(certCache_t* cache) {
+	/**
+	 * Double the bucket count of <cache> and rehash every entry
+	 */
+	int nBucket=cache->nBucket*2;
+	certCacheEntry_t** bucket=cacheMalloc(sizeof(certCacheEntry_t*)*nBucket);
+	memset(bucket, 0, sizeof(certCacheEntry_t*)*nBucket);
+
+	for(certCacheEntry_t* entry=cache->lruHead;entry!=NULL;entry=entry->lruNext){
+		certCacheEntry_t** slot=&bucket[hashString(entry->path)&(nBucket-1)];
+		entry->hashNext=*slot;
+		*slot=entry;
+	}
+	free(cache->bucket);
+	cache->bucket=bucket;
+	cache->nBucket=nBucket;
+}
+
+static void* cacheMalloc(size_t size) {
+	void* memory=malloc(size);
+	if(memory==NULL){
+		cacheMallocFail();
+	}
+	return(memory);
+}
+
+static void cacheMallocFail(void) {
+	mylog("Malloc failed to allocate memory. Program terminating");
+	exit(EXIT_CACHE_MALLOC_FAIL);
+}
@@ -0,0 +1,69 @@
+/*
+ * certCache.h
+ *
+ * Cache of decoded certificates keyed by path, see certCache.c.
+ */
+
+#ifndef CERTCACHE_H_
+#define CERTCACHE_H_
+
+#include "certSummary.h"
+#include "hostnameTool.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* Default memory budget for decoded certificates, in bytes */
+#define CERT_CACHE_DEFAULT_CAP (64*1024*1024)
+
+/* The summary of a decoded certificate, and an index of its names. Entries
+ * handed out by lookup or insert are held until released,
+ * and are never freed while held. */
+typedef struct cert_cache_entry certCacheEntry_t;
+struct cert_cache_entry {
+	char* path;
+	dev_t device;			/* File identity the entry was decoded from */
+	ino_t inode;
+	time_t mtime;
+	off_t size;
+
+	certSummary_t* summary;
+	hostnameIndex_t* domainIndex;	/* Names of <summary> */
+	int chainStatus;		/* CHAIN_* of trustStore.h */
+
+	size_t footprint;		/* Approximate bytes held by this entry */
+	int refCount;			/* Holders of the entry outside the cache */
+	int detached;			/* Removed from the cache, freed on last release */
+	certCacheEntry_t* lruPrev;
+	certCacheEntry_t* lruNext;
+	certCacheEntry_t* hashNext;
+};
+
+typedef struct cert_cache certCache_t;
+struct cert_cache {
+	certCacheEntry_t** bucket;
+	int nBucket;			/* Always a power of 2 */
+	int nEntry;
+	certCacheEntry_t* lruHead;	/* Most recently used */
+	certCacheEntry_t* lruTail;	/* Least recently used, evicted first */
+	size_t memoryUsed;
+	size_t memoryCap;
+	long hit;
+	long miss;
+	pthread_mutex_t lock;
+};
+
+certCache_t* create_certCache(size_t memoryCap);
+void delete_certCache(certCache_t* cache);
+certCacheEntry_t* lookup_certCache(certCache_t* cache, const char* path, const char* file,
+		struct stat* fileStat);
+certCacheEntry_t* create_certCacheEntry(const char* path, const struct stat* fileStat,
+		certSummary_t* summary, int chainStatus);
+certCacheEntry_t* insert_certCache(certCache_t* cache, certCacheEntry_t* entry);
+void release_certCache(certCache_t* cache, certCacheEntry_t* entry);
+int contains_certCache(certCache_t* cache, const char* path);
+
+#endif /* CERTCACHE_H_ */
@@ -0,0 +1,1457 @@
+/*
+ * certCheck.c
+ *
+ * libcertcheck, validation of certificates against domains. The command line
+ * tool and server are built on this, see certCheck.h.
+ */
+#include "certCheck.h"
+#include "certCache.h"
+#include "resultCache.h"
+#include "regexTool.h"
+#include "hostnameTool.h"
+#include "logger.h"
+#include "csvTool.h"
+#include "arena.h"
+#include "timing.h"
+#include "hashTool.h"
+#include "dataStructure.h" // Provides dsa_t - "dynamic string array".
+
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/bio.h>
+#include <openssl/pem.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Outcomes of the row memo hold the failed checks of every scenario */
+_Static_assert(MAX_SCENARIO<=ROW_MEMO_MAX_SCENARIO, "row memo outcomes too small");
+
+/* A wildcard is any contiguous sequence of WILDCARD not located after a literal '.'*/
+#define WILDCARD "*"
+#define WILDCARD_MATCHER "[^.]*[" WILDCARD "]+"
+#define WILDCARD_MATCHES "[A-Za-z0-9-]+"
+
+#define CT_INVALID 1
+#define CT_VALID 0
+
+#define DN_MATCH 10239
+#define DN_NOMATCH 2398
+
+#define SCENARIO_LIST_SEPARATOR ","
+#define POLICY_ITEM_SEPARATOR "/"
+#define SECONDS_PER_MINUTE 60
+#define SECONDS_PER_HOUR (60*SECONDS_PER_MINUTE)
+#define SECONDS_PER_DAY (24*SECONDS_PER_HOUR)
+#define DOMAIN_MATCH_UNKNOWN -1
+#define DEFAULT_KEY_USAGE "TLS Web Server Authentication"
+#define EXIT_CHECK_MALLOC_FAIL 111
+
+/* Room for "#<index>" after a bundle path, and the offsets first reserved for
+ * the certificates of a bundle */
+#define BUNDLE_KEY_INDEX_LEN 16
+#define BUNDLE_OFFSET_INITIAL_SIZE 64
+
+/* Room for a slow row log line: its number, stage times and cells */
+#define SLOW_ROW_LINE_LEN (PATH_MAX+1024)
+
+/* One check plan evaluation in this many on each thread is sampled, and an
+ * adaptive plan is reordered each time this many samples have been taken */
+#define CHECK_PLAN_SAMPLE_INTERVAL 64
+#define CHECK_PLAN_REORDER_INTERVAL 128
+
+/* Stages of validating a certificate, timed in builds with CERTCHECK_TIMING */
+typedef enum check_stage checkStage_t;
+enum check_stage {
+	STAGE_LOAD,
+	STAGE_SUMMARY,
+	STAGE_CHAIN,
+	STAGE_TIME,
+	STAGE_DOMAIN,
+	STAGE_COUNT
+};
+
+#ifdef CERTCHECK_TIMING
+#define STAGE_START(timer) uint64_t timer=nowNanoseconds()
+#define STAGE_STOP(timer, stage) recordStage((stage), nowNanoseconds()-(timer))
+#else
+#define STAGE_START(timer) do {} while(0)
+#define STAGE_STOP(timer, stage) do {} while(0)
+#endif
+
+/* Process wide state shared by validation threads */
+static pthread_once_t openSSLInitOnce=PTHREAD_ONCE_INIT;
+static pthread_once_t rowArenaKeyOnce=PTHREAD_ONCE_INIT;
+static pthread_key_t rowArenaKey;
+static __thread unsigned checkPlanClock;	/* Evaluations since the last sample */
+static const char* const checkName[CHECK_COUNT]={
+	"basic constraints", "key length", "key usage", "time", "domain"
+};
+#ifdef CERTCHECK_TIMING
+static latencyHistogram_t stageLatency[STAGE_COUNT];
+static __thread uint64_t rowStageTime[STAGE_COUNT];	/* Of the row being checked */
+static const char* const stageName[STAGE_COUNT]={
+	"load", "summary", "chain", "time", "domain"
+};
+#endif
+
+static void initOpenSSL(void);
+static X509* loadCertificate(checkContext_t* context, const char* path, const struct stat* fileStat);
+static certCacheEntry_t* loadBundleCertificate(checkContext_t* context, const char* file,
+		const struct stat* fileStat, int index);
+static int verifyDomainName(const certCacheEntry_t* entry, const char* domain, size_t domainLength);
+static int verifyDomainNameRegex(const certCacheEntry_t* entry, const char* domain, size_t domainLength);
+static char* convertWildcardExpressionToRegex(const char* wString, arena_t* arena);
+static int verifyTimeValidity(const certSummary_t* summary, int64_t at);
+static certCacheEntry_t* getCertificate(checkContext_t* context, const char* cPath);
+static void initCheckPlan(checkPlan_t* plan, int adaptive, int sampling);
+static int runCheck(checkContext_t* context, checkId_t check, checkInput_t* input);
+static unsigned runCheckPlan(checkContext_t* context, checkInput_t* input, int evaluateAll);
+static scenario_t* createScenarios(const scenario_t* times, int nTime, const policy_t* policies,
+		int nPolicy);
+static void reorderCheckPlan(checkPlan_t* plan);
+static int compileKeyUsage(dsa_t* usageRequired, uint32_t* required);
+static int verifyExtendedKeyUsage(const certSummary_t* summary, uint32_t usageRequired);
+static void initRowArenaKey(void);
+static arena_t* getRowArena(void);
+static void logSlowRow(const csvRowView_t* row, long number, uint64_t elapsed);
+#ifdef CERTCHECK_TIMING
+static void recordStage(checkStage_t stage, uint64_t elapsed);
+#endif
+static int findCachedDigest(checkContext_t* context, const char* cPath, char* key, size_t keySize,
+		struct stat* fileStat, uint64_t* digest);
+static int lookupScenarios(checkContext_t* context, const uint64_t* digest, const char* domain,
+		size_t domainLength, domainOutcome_t* outcome);
+static int outcomeResults(const checkContext_t* context, domainOutcome_t* outcome,
+		int64_t now, int* result);
+static void memoizeRow(checkContext_t* context, const memoText_t* memoKey, int nDomain,
+		const domainOutcome_t* outcome);
+static unsigned runScenario(checkContext_t* context, checkInput_t* input, const uint64_t* digest);
+static const uint64_t* entryDigest(checkContext_t* context, const certCacheEntry_t* entry,
+		int digestState, const char* key, const struct stat* fileStat, uint64_t* digest);
+static uint64_t policyKey(const checkContext_t* context, const policy_t* policy);
+static void appendChainStatus(const checkContext_t* context, csvRowView_t* row, int chainStatus);
+static int certificateKey(const char* cPath, char* file, size_t fileSize, char* key, size_t keySize,
+		int* index);
+static certBundle_t* openBundle(checkContext_t* context, const char* file,
+		const struct stat* fileStat);
+static certCacheEntry_t* cacheCertificate(checkContext_t* context, const char* key,
+		const struct stat* fileStat, X509* cert);
+static void checkMallocFail(void);
+
+void initCertCheck(void) {
+	/**
+	 * Process wide setup, done before the first check context is created
+	 * and safe to call any number of times from any thread
+	 */
+	pthread_once(&openSSLInitOnce, initOpenSSL);
+}
+
+static void initOpenSSL(void) {
+	/**
+	 * Process wide OpenSSL setup, run once through openSSLInitOnce
+	 */
+	OpenSSL_add_all_algorithms();
+	ERR_load_BIO_strings();
+	ERR_load_crypto_strings();
+	OPENSSL_config(NULL); // Deprecated but in place for bcompat
+}
+
+void defaultCheckOptions(checkOptions_t* options) {
+	/**
+	 * Set <options> to the defaults: evaluate now, under DEFAULT_POLICY,
+	 * for server authentication
+	 */
+	static const scenario_t now={ .time=0, .relative=1 };
+	static const policy_t minKeyBits=DEFAULT_POLICY;
+
+	options->cacheCap=CERT_CACHE_DEFAULT_CAP;
+	options->time=&now;
+	options->nTime=1;
+	options->policy=&minKeyBits;
+	options->nPolicy=1;
+	options->requiredUsage=NULL;
+	options->adaptivePlan=0;
+	options->regexMatcher=0;
+	options->reportStatistics=0;
+	options->slowRowThreshold=0;
+	options->resultCachePath=NULL;
+	options->trustStorePath=NULL;
+	options->rowMemoCap=0;
+	options->evaluateAll=0;
+	options->prefetchDepth=0;
+	options->prefetchThreads=CERT_PREFETCH_DEFAULT_THREADS;
+	options->prefetchCap=CERT_PREFETCH_DEFAULT_CAP;
+}
+
+checkContext_t* create_checkContext(const checkOptions_t* options) {
+	/**
+	 * Create a check context with <options>, which may be released once
+	 * this returns
+	 *
+	 * RETN:
+	 * 	Context, free with delete_checkContext. NULL, with the reason
+	 * 	logged, if <options> are invalid or a file they name cannot be used.
+	 */
+	uint32_t requiredUsage;
+
+	initCertCheck();
+	if(options->nTime<1 || options->nPolicy<1
+			|| options->nTime*options->nPolicy>MAX_SCENARIO){
+		mylog("Invalid number of scenarios");
+		return(NULL);
+	}
+
+	/* Define usage requirements of certificates being validated. */
+	if(options->requiredUsage!=NULL){
+		if(compileKeyUsage(options->requiredUsage, &requiredUsage)!=0){
+			return(NULL);
+		}
+	} else {
+		dsa_t usageRequirement;
+		init_dsa(&usageRequirement);
+		appendto_dsa(&usageRequirement, DEFAULT_KEY_USAGE);
+		int failed=compileKeyUsage(&usageRequirement, &requiredUsage);
+		free_dsa(&usageRequirement);
+		if(failed){
+			return(NULL);
+		}
+	}
+
+	resultCache_t* results=NULL;
+	if(options->resultCachePath!=NULL){
+		results=openResultCache(options->resultCachePath);
+		if(results==NULL){
+			mylog("Failed to open result cache");
+			return(NULL);
+		}
+	}
+
+	trustStore_t* trust=NULL;
+	if(options->trustStorePath!=NULL){
+		trust=openTrustStore(options->trustStorePath);
+		if(trust==NULL){
+			mylog("Failed to load trust store");
+			closeResultCache(results);
+			return(NULL);
+		}
+	}
+
+	certPrefetch_t* prefetch=NULL;
+	if(options->prefetchDepth>0){
+		prefetch=(options->prefetchThreads>0)?create_certPrefetch(options->prefetchDepth,
+				options->prefetchThreads, options->prefetchCap):NULL;
+		if(prefetch==NULL){
+			mylog("Failed to start prefetch");
+			closeTrustStore(trust);
+			closeResultCache(results);
+			return(NULL);
+		}
+	}
+
+	checkContext_t* context=malloc(sizeof(*context));
+	if(context==NULL){
+		checkMallocFail();
+	}
+	/* Decoded certificates, reused for rows that repeat a path */
+	context->cache=create_certCache(options->cacheCap);
+	context->bundles=create_certBundleTable();
+	context->requiredUsage=requiredUsage;
+	/* Reference regex matcher, for differential testing */
+	context->verifyDomain=options->regexMatcher?verifyDomainNameRegex:verifyDomainName;
+	initCheckPlan(&context->plan, options->adaptivePlan,
+			options->adaptivePlan||options->reportStatistics);
+	context->scenario=createScenarios(options->time, options->nTime,
+			options->policy, options->nPolicy);
+	context->nScenario=options->nTime*options->nPolicy;
+	context->rowLatency=options->reportStatistics?create_latencyHistogram():NULL;
+	context->slowRowThreshold=options->slowRowThreshold;
+	context->results=results;
+	context->trust=trust;
+	context->memo=(options->rowMemoCap>0)
+			?create_rowMemo(options->rowMemoCap, context->nScenario):NULL;
+	context->evaluateAll=options->evaluateAll;
+	context->prefetch=prefetch;
+	return(context);
+}
+
+void delete_checkContext(checkContext_t* context) {
+	/**
+	 * Free <context> and every certificate it holds. No batch may be in
+	 * progress on it.
+	 */
+	if(context==NULL){return;}
+	delete_certPrefetch(context->prefetch);
+	delete_certCache(context->cache);
+	delete_certBundleTable(context->bundles);
+	delete_latencyHistogram(context->rowLatency);
+	closeResultCache(context->results);
+	closeTrustStore(context->trust);
+	delete_rowMemo(context->memo);
+	free(context->scenario);
+	free(context);
+}
+
+int validateBatch_checkContext(checkContext_t* context, const checkRequest_t* request,
+		size_t nRequest, int* result, int* chainStatus) {
+	/**
+	 * Validate each of the <nRequest> rows of <request>, a certificate and
+	 * domain, under every scenario of <context>
+	 *
+	 * Safe to call from several threads at once on one context. Rows naming
+	 * the same certificate as the row before reuse its cache entry.
+	 *
+	 * ARGS:
+	 * 	result - nRequest*nScenario results, those of row i from
+	 * 	i*nScenario, each CHECK_RESULT_VALID, CHECK_RESULT_INVALID or, for
+	 * 	every scenario of a row whose certificate could not be read,
+	 * 	CERT_LOAD_ERROR
+	 * 	chainStatus - nRequest CHAIN_* of trustStore.h, CHAIN_NOT_CHECKED
+	 * 	without a trust store or for a certificate that could not be read.
+	 * 	May be NULL.
+	 *
+	 * RETN:
+	 * 	Number of rows whose certificate could not be read
+	 */
+	certCacheEntry_t* entry=NULL;
+	const char* entryPath=NULL;
+	int nLoadError=0;
+	int64_t now=(int64_t)time(NULL);
+	checkInput_t input;
+	char key[PATH_MAX+BUNDLE_KEY_INDEX_LEN];
+	struct stat fileStat;
+	uint64_t digest[RESULT_DIGEST_WORDS];
+	/* Of <entry>, filled by entryDigest only, as each row's lookup overwrites <digest> */
+	uint64_t heldDigest[RESULT_DIGEST_WORDS];
+	const uint64_t* resultDigest=NULL;
+
+	for(size_t rx=0;rx<nRequest;rx++){
+		int* rowResult=result+rx*context->nScenario;
+		domainOutcome_t outcome;
+		uint64_t start=(context->rowLatency!=NULL)?nowNanoseconds():0;
+		size_t domainLength=strlen(request[rx].domain);
+
+		/* Answer from the result cache without reading the certificate */
+		int digestState=findCachedDigest(context, request[rx].certificate, key, sizeof(key),
+				&fileStat, digest);
+		if(digestState==1 && lookupScenarios(context, digest, request[rx].domain,
+				domainLength, &outcome) && outcomeResults(context, &outcome, now, rowResult)){
+			if(chainStatus!=NULL){
+				chainStatus[rx]=outcome.chainStatus;
+			}
+			if(context->rowLatency!=NULL){
+				recordLatency(context->rowLatency, nowNanoseconds()-start);
+			}
+			continue;
+		}
+
+		if(entryPath==NULL || strcmp(entryPath, request[rx].certificate)!=0){
+			if(entry!=NULL){
+				release_certCache(context->cache, entry);
+			}
+			entry=getCertificate(context, request[rx].certificate);
+			entryPath=(entry!=NULL)?request[rx].certificate:NULL;
+			resultDigest=NULL;
+			if(entry!=NULL){
+				resultDigest=entryDigest(context, entry, digestState, key, &fileStat, heldDigest);
+			}
+		}
+		if(chainStatus!=NULL){
+			chainStatus[rx]=(entry!=NULL)?entry->chainStatus:CHAIN_NOT_CHECKED;
+		}
+		if(entry==NULL){
+			for(int sx=0;sx<context->nScenario;sx++){
+				rowResult[sx]=CERT_LOAD_ERROR;
+			}
+			nLoadError++;
+			continue;
+		}
+
+		input.entry=entry;
+		input.domain=request[rx].domain;
+		input.domainLength=domainLength;
+		input.domainMatch=DOMAIN_MATCH_UNKNOWN;
+		for(int sx=0;sx<context->nScenario;sx++){
+			const scenario_t* scenario=&context->scenario[sx];
+			input.time=scenario->relative?now+scenario->time:scenario->time;
+			input.policy=&scenario->policy;
+			rowResult[sx]=(runScenario(context, &input, resultDigest)==0)
+					?CHECK_RESULT_VALID:CHECK_RESULT_INVALID;
+		}
+		reset_arena(getRowArena());
+		if(context->rowLatency!=NULL){
+			recordLatency(context->rowLatency, nowNanoseconds()-start);
+		}
+	}
+
+	if(entry!=NULL){
+		release_certCache(context->cache, entry);
+	}
+	return(nLoadError);
+}
+
+static int findCachedDigest(checkContext_t* context, const char* cPath, char* key, size_t keySize,
+		struct stat* fileStat, uint64_t* digest) {
+	/**
+	 * Find the digest of certificate <cPath> in the result cache, by its
+	 * file as it is now
+	 *
+	 * ARGS:
+	 * 	key, fileStat - set to the cache key and file of <cPath> unless -1
+	 * 	is returned, for entryDigest to record the digest once read
+	 *
+	 * RETN:
+	 * 	1 with <digest> set, 0 if not recorded, -1 if there is no result
+	 * 	cache or <cPath> cannot be stat'd
+	 */
+	char file[PATH_MAX];
+	int index;
+
+	if(context->results==NULL || splitBundlePath(cPath, file, sizeof(file), &index)!=0
+			|| stat(file, fileStat)!=0){
+		return(-1);
+	}
+	if(index==CERT_BUNDLE_WHOLE_FILE){
+		snprintf(key, keySize, "%s", cPath);
+	} else {
+		snprintf(key, keySize, "%s%c%d", file, CERT_BUNDLE_SEPARATOR, index);
+	}
+	return(findDigest_resultCache(context->results, key, fileStat, digest));
+}
+
+static const uint64_t* entryDigest(checkContext_t* context, const certCacheEntry_t* entry,
+		int digestState, const char* key, const struct stat* fileStat, uint64_t* digest) {
+	/**
+	 * Return the digest under which outcomes for <entry> are recorded in the
+	 * result cache, recording it for the file if findCachedDigest gave
+	 * <digestState> 0
+	 *
+	 * RETN:
+	 * 	<digest>, or NULL if outcomes are not to be recorded
+	 */
+	if(digestState==-1 || !entry->summary->hasDigest){
+		return(NULL);
+	}
+	digestWords(entry->summary->digest, digest);
+	if(digestState==0){
+		recordDigest_resultCache(context->results, key, fileStat, digest);
+	}
+	return(digest);
+}
+
+static int lookupScenarios(checkContext_t* context, const uint64_t* digest, const char* domain,
+		size_t domainLength, domainOutcome_t* outcome) {
+	/**
+	 * Look up the certificate with <digest> for <domain> under every
+	 * scenario in the result cache
+	 *
+	 * RETN:
+	 * 	1 with <outcome> filled, 0 if any scenario is missing
+	 */
+	for(int sx=0;sx<context->nScenario;sx++){
+		resultSlot_t slot;
+		if(!lookup_resultCache(context->results, digest, domain, domainLength,
+				policyKey(context, &context->scenario[sx].policy), &slot)){
+			return(0);
+		}
+		outcome->failed[sx]=slot.failed;
+		outcome->notBefore=slot.notBefore;
+		outcome->notAfter=slot.notAfter;
+		outcome->chainStatus=slot.chainStatus;
+		outcome->keyBits=slot.keyBits;
+	}
+	return(1);
+}
+
+static int outcomeResults(const checkContext_t* context, domainOutcome_t* outcome,
+		int64_t now, int* result) {
+	/**
+	 * Result under each scenario of the checks kept in <outcome>, making the
+	 * time check again against the validity period. The time check of each
+	 * scenario in <outcome> is set to the one made.
+	 *
+	 * RETN:
+	 * 	1 with a CHECK_RESULT_* per scenario in <result>, 0 if a scenario whose
+	 * 	time check failed is now current, as the checks it stopped are unknown
+	 */
+	for(int sx=0;sx<context->nScenario;sx++){
+		const scenario_t* scenario=&context->scenario[sx];
+		int64_t at=scenario->relative?now+scenario->time:scenario->time;
+		int current=(at>=outcome->notBefore && at<=outcome->notAfter);
+		unsigned failed=outcome->failed[sx]&~(1u<<CHECK_TIME);
+		if(failed==0 && current && outcome->failed[sx]!=0){
+			return(0);
+		}
+		result[sx]=(failed==0 && current)?CHECK_RESULT_VALID:CHECK_RESULT_INVALID;
+		outcome->failed[sx]=failed|(current?0:1u<<CHECK_TIME);
+	}
+	return(1);
+}
+
+static void memoizeRow(checkContext_t* context, const memoText_t* memoKey, int nDomain,
+		const domainOutcome_t* outcome) {
+	/**
+	 * Keep the <outcome> of each of the <nDomain> domains of a row in the
+	 * row memo
+	 *
+	 * ARGS:
+	 * 	memoKey - path then domains of the row, NULL if there is no memo
+	 */
+	if(memoKey==NULL){return;}
+	for(int ix=1;ix<=nDomain;ix++){
+		insert_rowMemo(context->memo, &memoKey[0], &memoKey[ix], &outcome[ix-1]);
+	}
+}
+
+static unsigned runScenario(checkContext_t* context, checkInput_t* input, const uint64_t* digest) {
+	/**
+	 * Run the check plan for <input>, recording the outcome in the result
+	 * cache under <digest> unless it is NULL. Recorded outcomes run every
+	 * check, so they hold whichever check would have stopped the plan.
+	 *
+	 * RETN:
+	 * 	Bit (1<<checkId_t) per check failed, 0 if the certificate is valid.
+	 * 	Only the first failure unless recorded or the context evaluates all.
+	 */
+	if(digest==NULL){
+		return(runCheckPlan(context, input, context->evaluateAll));
+	}
+
+	unsigned failed=runCheckPlan(context, input, 1);
+	const certSummary_t* summary=input->entry->summary;
+	insert_resultCache(context->results, digest, input->domain, input->domainLength,
+			policyKey(context, input->policy), failed&~(1u<<CHECK_TIME),
+			input->entry->chainStatus, summary->keyBits, summary->notBefore, summary->notAfter);
+	return(failed);
+}
+
+static uint64_t policyKey(const checkContext_t* context, const policy_t* policy) {
+	/**
+	 * Key of the settings an outcome depends on, other than the time
+	 */
+	int64_t settings[KEY_ALGORITHM_COUNT+3]={
+		context->requiredUsage, context->verifyDomain==verifyDomainNameRegex,
+		(context->trust!=NULL)?(int64_t)context->trust->fingerprint:0
+	};
+	for(int ax=0;ax<KEY_ALGORITHM_COUNT;ax++){
+		settings[3+ax]=policy->minKeyBits[ax];
+	}
+	return(hashBytes(settings, sizeof(settings), HASH_SEED));
+}
+
+static void initRowArenaKey(void) {
+	/**
+	 * Create the key of each thread's row arena, run once through rowArenaKeyOnce
+	 */
+	pthread_key_create(&rowArenaKey, delete_arena);
+}
+
+static arena_t* getRowArena(void) {
+	/**
+	 * Return the calling thread's arena for temporaries of the row being
+	 * checked. checkRow resets it once the row is done.
+	 */
+	pthread_once(&rowArenaKeyOnce, initRowArenaKey);
+	arena_t* arena=pthread_getspecific(rowArenaKey);
+	if(arena==NULL){
+		arena=create_arena(ARENA_DEFAULT_BLOCK_SIZE);
+		pthread_setspecific(rowArenaKey, arena);
+	}
+	return(arena);
+}
+
+void releaseRowArena(void) {
+	/**
+	 * Free the calling thread's row arena now rather than at thread exit,
+	 * for the thread that deletes the last check context
+	 */
+	pthread_once(&rowArenaKeyOnce, initRowArenaKey);
+	delete_arena(pthread_getspecific(rowArenaKey));
+	pthread_setspecific(rowArenaKey, NULL);
+}
+
+void prefetch_checkContext(checkContext_t* context, const char* certificate, size_t length,
+		long number) {
+	/**
+	 * Have the file of <certificate>, a path of <length> chars as in an input
+	 * row, read ahead for row <number> unless it is decoded already. Rows
+	 * must be given in order, each once done passed to
+	 * retirePrefetch_checkContext. Does nothing without a prefetch.
+	 */
+	char path[PATH_MAX];
+	char file[PATH_MAX];
+	char key[PATH_MAX+BUNDLE_KEY_INDEX_LEN];
+	int index;
+
+	if(context->prefetch==NULL || length>=PATH_MAX){
+		return;
+	}
+	memcpy(path, certificate, length);
+	path[length]='\0';
+	if(certificateKey(path, file, sizeof(file), key, sizeof(key), &index)!=0
+			|| contains_certCache(context->cache, key)){
+		return;
+	}
+	request_certPrefetch(context->prefetch, file, number);
+}
+
+void retirePrefetch_checkContext(checkContext_t* context, long number) {
+	/**
+	 * Free files read ahead for rows up to <number>, which are done with
+	 */
+	if(context->prefetch!=NULL){
+		retire_certPrefetch(context->prefetch, number);
+	}
+}
+
+int checkRow(checkContext_t* context, csvRowView_t* row, domainOutcome_t* outcome) {
+	/**
+	 * Validate the certificate named by input <row> for each domain of the
+	 * row, and append one result per domain and scenario to <row> to give the
+	 * output row. The results of a domain are adjacent, in scenario order.
+	 * With a trust store the chain status of the certificate follows.
+	 *
+	 * With a row memo, a row whose domains were all seen with its path
+	 * before takes their outcomes rather than being checked again.
+	 *
+	 * An input row is <certificate path>,<domain>[,<domain>...]
+	 *
+	 * ARGS:
+	 * 	outcome - one per domain of the row, at least one, filled with the
+	 * 	checks failed under each scenario. A row without a domain fails the
+	 * 	domain check. May be NULL.
+	 *
+	 * Temporaries of the row are taken from the thread's row arena, which
+	 * is reset in one operation once the row is done.
+	 *
+	 * RETN:
+	 * 	0, or CERT_LOAD_ERROR in which case <row> is unchanged
+	 */
+	char certificatePath[PATH_MAX];
+	char key[PATH_MAX+BUNDLE_KEY_INDEX_LEN];
+	struct stat fileStat;
+	uint64_t digest[RESULT_DIGEST_WORDS];
+	int nDomain=row->length-1;
+	int64_t now=(int64_t)time(NULL);
+
+	/*Extract certificate validation parameters */
+	if(row->cell[0].length>=PATH_MAX){
+		return(CERT_LOAD_ERROR);
+	}
+	memcpy(certificatePath, row->cell[0].data, row->cell[0].length);
+	certificatePath[row->cell[0].length]='\0';
+
+	int* result=alloc_arena(getRowArena(), sizeof(int)*nDomain*context->nScenario);
+	if(outcome==NULL){
+		outcome=alloc_arena(getRowArena(), sizeof(domainOutcome_t)*((nDomain>0)?nDomain:1));
+	}
+
+	/* Answer from the row memo if the run has seen every domain with this path */
+	memoText_t* memoKey=NULL;
+	if(context->memo!=NULL && nDomain>0){
+		memoKey=alloc_arena(getRowArena(), sizeof(memoText_t)*row->length);
+		for(int ix=0;ix<=nDomain;ix++){
+			initMemoText(&memoKey[ix], row->cell[ix].data, row->cell[ix].length);
+		}
+		int held=1;
+		for(int ix=1;ix<=nDomain && held;ix++){
+			held=lookup_rowMemo(context->memo, &memoKey[0], &memoKey[ix], &outcome[ix-1])
+					&& outcomeResults(context, &outcome[ix-1], now,
+							result+(ix-1)*context->nScenario);
+		}
+		countRow_rowMemo(context->memo, held);
+		if(held){
+			for(int rx=0;rx<nDomain*context->nScenario;rx++){
+				appendCellView(row, (result[rx]==CHECK_RESULT_VALID)?"1":"0", 1);
+			}
+			appendChainStatus(context, row, outcome[0].chainStatus);
+			reset_arena(getRowArena());
+			return(0);
+		}
+	}
+
+	/* Answer from the result cache if it holds every domain and scenario */
+	int digestState=findCachedDigest(context, certificatePath, key, sizeof(key), &fileStat, digest);
+	if(digestState==1 && nDomain>0){
+		int cached=1;
+		for(int ix=1;ix<=nDomain && cached;ix++){
+			cached=lookupScenarios(context, digest, row->cell[ix].data, row->cell[ix].length,
+					&outcome[ix-1]) && outcomeResults(context, &outcome[ix-1], now,
+							result+(ix-1)*context->nScenario);
+		}
+		if(cached){
+			for(int rx=0;rx<nDomain*context->nScenario;rx++){
+				appendCellView(row, (result[rx]==CHECK_RESULT_VALID)?"1":"0", 1);
+			}
+			appendChainStatus(context, row, outcome[0].chainStatus);
+			memoizeRow(context, memoKey, nDomain, outcome);
+			reset_arena(getRowArena());
+			return(0);
+		}
+	}
+
+	certCacheEntry_t* entry = getCertificate(context, certificatePath);
+	if(entry==NULL){
+		reset_arena(getRowArena());
+		return(CERT_LOAD_ERROR);
+	}
+	const uint64_t* resultDigest=entryDigest(context, entry, digestState, key, &fileStat, digest);
+
+	checkInput_t input;
+	input.entry=entry;
+
+	/* A row without a domain cannot match, its other checks are made for <outcome> */
+	if(nDomain==0){
+		outcome->notBefore=entry->summary->notBefore;
+		outcome->notAfter=entry->summary->notAfter;
+		outcome->chainStatus=entry->chainStatus;
+		outcome->keyBits=entry->summary->keyBits;
+		input.domain="";
+		input.domainLength=0;
+		input.domainMatch=DN_NOMATCH;
+		for(int sx=0;sx<context->nScenario;sx++){
+			const scenario_t* scenario=&context->scenario[sx];
+			input.time=scenario->relative?now+scenario->time:scenario->time;
+			input.policy=&scenario->policy;
+			outcome->failed[sx]=runScenario(context, &input, NULL);
+			appendCellView(row, "0", 1);
+		}
+	}
+
+	/*Validate, and mutate input row to output row form */
+	for(int ix=1;ix<=nDomain;ix++){
+		domainOutcome_t* domainOutcome=&outcome[ix-1];
+		domainOutcome->notBefore=entry->summary->notBefore;
+		domainOutcome->notAfter=entry->summary->notAfter;
+		domainOutcome->chainStatus=entry->chainStatus;
+		domainOutcome->keyBits=entry->summary->keyBits;
+		input.domain=row->cell[ix].data;
+		input.domainLength=row->cell[ix].length;
+		input.domainMatch=DOMAIN_MATCH_UNKNOWN;
+
+		for(int sx=0;sx<context->nScenario;sx++){
+			const scenario_t* scenario=&context->scenario[sx];
+			input.time=scenario->relative?now+scenario->time:scenario->time;
+			input.policy=&scenario->policy;
+			domainOutcome->failed[sx]=runScenario(context, &input, resultDigest);
+			appendCellView(row, (domainOutcome->failed[sx]==0)?"1":"0", 1);
+		}
+	}
+	appendChainStatus(context, row, entry->chainStatus);
+	memoizeRow(context, memoKey, nDomain, outcome);
+
+	release_certCache(context->cache, entry);
+	reset_arena(getRowArena());
+	return(0);
+}
+
+static void appendChainStatus(const checkContext_t* context, csvRowView_t* row, int chainStatus) {
+	/**
+	 * Append the chain column to output <row>, if <context> has a trust store
+	 */
+	if(context->trust!=NULL){
+		const char* name=chainStatusName(chainStatus);
+		appendCellView(row, name, strlen(name));
+	}
+}
+
+int checkRowTimed(checkContext_t* context, csvRowView_t* row, long number,
+		domainOutcome_t* outcome) {
+	/**
+	 * checkRow, recording its duration when the run reports statistics and
+	 * logging it if slow
+	 *
+	 * ARGS:
+	 * 	number - position of <row> in the input, for the slow row log
+	 */
+	if(context->rowLatency==NULL && context->slowRowThreshold==0){
+		return(checkRow(context, row, outcome));
+	}
+#ifdef CERTCHECK_TIMING
+	memset(rowStageTime, 0, sizeof(rowStageTime));
+#endif
+	uint64_t start=nowNanoseconds();
+	int nCell=row->length;
+	int result=checkRow(context, row, outcome);
+	uint64_t elapsed=nowNanoseconds()-start;
+
+	if(context->rowLatency!=NULL){
+		recordLatency(context->rowLatency, elapsed);
+	}
+	if(context->slowRowThreshold!=0 && elapsed>=context->slowRowThreshold){
+		/* Log the input cells only */
+		int nOutputCell=row->length;
+		row->length=nCell;
+		logSlowRow(row, number, elapsed);
+		row->length=nOutputCell;
+	}
+	return(result);
+}
+
+static void logSlowRow(const csvRowView_t* row, long number, uint64_t elapsed) {
+	/**
+	 * Report <row> as slow to stderr, with the time of each stage in timed
+	 * builds. One fprintf per line keeps lines of concurrent rows whole.
+	 */
+	char line[SLOW_ROW_LINE_LEN];
+	int used=snprintf(line, sizeof(line), "slow row %ld: %.1fus", number, elapsed/1000.0);
+
+#ifdef CERTCHECK_TIMING
+	for(int stage=0;stage<STAGE_COUNT;stage++){
+		if(rowStageTime[stage]!=0 && used<(int)sizeof(line)){
+			used+=snprintf(line+used, sizeof(line)-used, " %s=%.1fus",
+					stageName[stage], rowStageTime[stage]/1000.0);
+		}
+	}
+#endif
+	for(int ix=0;ix<row->length && used<(int)sizeof(line);ix++){
+		used+=snprintf(line+used, sizeof(line)-used, "%s%.*s", (ix==0)?" ":",",
+				(int)row->cell[ix].length, row->cell[ix].data);
+	}
+	fprintf(stderr, "%s\n", line);
+}
+
+#ifdef CERTCHECK_TIMING
+static void recordStage(checkStage_t stage, uint64_t elapsed) {
+	/**
+	 * Count <elapsed> ns against <stage>, for the run and for the current row
+	 */
+	recordLatency(&stageLatency[stage], elapsed);
+	rowStageTime[stage]+=elapsed;
+}
+
+void printStageStatistics(void) {
+	/**
+	 * Report the totals and latency histogram of each stage to stderr.
+	 * Stages the certificate cache skips on a hit have fewer calls than rows.
+	 */
+	for(int stage=0;stage<STAGE_COUNT;stage++){
+		const latencyHistogram_t* latency=&stageLatency[stage];
+		fprintf(stderr, "stage %s: %lu calls %.3fms total, p50 %.1fus p99 %.1fus max %.1fus\n",
+				stageName[stage], (unsigned long)latency->total, latency->sum/1e6,
+				percentileLatency(latency, 50)/1000.0, percentileLatency(latency, 99)/1000.0,
+				latency->max/1000.0);
+		printLatencyHistogram(stderr, latency);
+	}
+}
+#endif
+
+
+static void initCheckPlan(checkPlan_t* plan, int adaptive, int sampling) {
+	/**
+	 * Start <plan> in checkId_t order, with no samples
+	 *
+	 * ARGS:
+	 * 	adaptive - reorder the plan from samples as the run progresses
+	 * 	sampling - take samples, implied by <adaptive>
+	 */
+	plan->order=0;
+	for(int ix=0;ix<CHECK_COUNT;ix++){
+		plan->order|=(uint64_t)ix<<(ix*CHECK_ORDER_BITS);
+		plan->nRejected[ix]=0;
+		plan->timeSpent[ix]=0;
+	}
+	plan->adaptive=adaptive;
+	plan->sampling=sampling||adaptive;
+	plan->nSample=0;
+}
+
+static int runCheck(checkContext_t* context, checkId_t check, checkInput_t* input) {
+	/**
+	 * RETN:
+	 * 	1 if <input> passes <check>, else 0
+	 */
+	const certSummary_t* summary=input->entry->summary;
+	int pass=0;
+
+	switch(check){
+	case CHECK_BASIC_CONSTRAINTS:
+		pass=!summary->ca;
+		break;
+	case CHECK_KEY_LENGTH:
+		pass=(summary->keyAlgorithm!=KEY_UNKNOWN
+				&& summary->keyBits>=input->policy->minKeyBits[summary->keyAlgorithm]);
+		break;
+	case CHECK_KEY_USAGE:
+		pass=verifyExtendedKeyUsage(summary, context->requiredUsage);
+		break;
+	case CHECK_DOMAIN: {
+		/* Looked up for the first scenario of a domain only */
+		if(input->domainMatch==DOMAIN_MATCH_UNKNOWN){
+			STAGE_START(domainStart);
+			input->domainMatch=context->verifyDomain(input->entry, input->domain,
+					input->domainLength);
+			STAGE_STOP(domainStart, STAGE_DOMAIN);
+		}
+		pass=(input->domainMatch==DN_MATCH);
+		break;
+	}
+	case CHECK_TIME: {
+		STAGE_START(timeStart);
+		pass=(verifyTimeValidity(summary, input->time)==CT_VALID);
+		STAGE_STOP(timeStart, STAGE_TIME);
+		break;
+	}
+	default:
+		break;
+	}
+	return(pass);
+}
+
+static unsigned runCheckPlan(checkContext_t* context, checkInput_t* input, int evaluateAll) {
+	/**
+	 * Run the checks of the context's plan against <input>, in plan order
+	 *
+	 * ARGS:
+	 * 	evaluateAll - run every check rather than stopping at the first failure
+	 *
+	 * RETN:
+	 * 	Bit (1<<checkId_t) set for each check failed, 0 if all ran passed
+	 */
+	checkPlan_t* plan=&context->plan;
+	uint64_t order=__atomic_load_n(&plan->order, __ATOMIC_RELAXED);
+	unsigned failed=0;
+
+	if(plan->sampling && ++checkPlanClock>=CHECK_PLAN_SAMPLE_INTERVAL){
+		/* Sample, timing every check so each is measured on the same rows */
+		checkPlanClock=0;
+		for(int ix=0;ix<CHECK_COUNT;ix++){
+			checkId_t check=(order>>(ix*CHECK_ORDER_BITS))&CHECK_ORDER_MASK;
+			uint64_t start=nowNanoseconds();
+			int pass=runCheck(context, check, input);
+			__atomic_fetch_add(&plan->timeSpent[check], nowNanoseconds()-start, __ATOMIC_RELAXED);
+			if(!pass){
+				__atomic_fetch_add(&plan->nRejected[check], 1, __ATOMIC_RELAXED);
+				failed|=1u<<check;
+			}
+		}
+		long nSample=__atomic_add_fetch(&plan->nSample, 1, __ATOMIC_RELAXED);
+		if(plan->adaptive && nSample%CHECK_PLAN_REORDER_INTERVAL==0){
+			reorderCheckPlan(plan);
+		}
+		return(failed);
+	}
+
+	for(int ix=0;ix<CHECK_COUNT;ix++){
+		checkId_t check=(order>>(ix*CHECK_ORDER_BITS))&CHECK_ORDER_MASK;
+		if(!runCheck(context, check, input)){
+			failed|=1u<<check;
+			if(!evaluateAll){
+				break;
+			}
+		}
+	}
+	return(failed);
+}
+
+static void reorderCheckPlan(checkPlan_t* plan) {
+	/**
+	 * Order the checks of <plan> by sampled cost per rejection, least first.
+	 * This minimises the expected cost of rejecting a row when checks fail
+	 * independently. Checks yet to reject a sample run last, cheapest first.
+	 */
+	checkId_t check[CHECK_COUNT];
+	long nRejected[CHECK_COUNT];
+	uint64_t timeSpent[CHECK_COUNT];
+
+	for(int ix=0;ix<CHECK_COUNT;ix++){
+		nRejected[ix]=__atomic_load_n(&plan->nRejected[ix], __ATOMIC_RELAXED);
+		timeSpent[ix]=__atomic_load_n(&plan->timeSpent[ix], __ATOMIC_RELAXED);
+	}
+
+	/* Insertion sort, comparing timeSpent/nRejected by cross multiplication */
+	for(int ix=0;ix<CHECK_COUNT;ix++){
+		int jx=ix;
+		while(jx>0){
+			checkId_t a=check[jx-1];
+			int before;
+			if(nRejected[a]==0 || nRejected[ix]==0){
+				before=(nRejected[a]!=0 && nRejected[ix]==0)
+						|| (nRejected[a]==0 && nRejected[ix]==0 && timeSpent[a]<=timeSpent[ix]);
+			} else {
+				before=((double)timeSpent[a]*nRejected[ix]<=(double)timeSpent[ix]*nRejected[a]);
+			}
+			if(before){
+				break;
+			}
+			check[jx]=a;
+			jx--;
+		}
+		check[jx]=ix;
+	}
+
+	uint64_t order=0;
+	for(int ix=0;ix<CHECK_COUNT;ix++){
+		order|=(uint64_t)check[ix]<<(ix*CHECK_ORDER_BITS);
+	}
+	__atomic_store_n(&plan->order, order, __ATOMIC_RELAXED);
+}
+
+void printCheckPlanStatistics(const checkPlan_t* plan) {
+	/**
+	 * Report the sampled cost and rejection rate of each check to stderr,
+	 * in the final plan order
+	 */
+	if(plan->nSample==0){
+		return;
+	}
+	fprintf(stderr, "check plan%s, %ld rows sampled:\n", plan->adaptive?" (adaptive)":"",
+			plan->nSample);
+	for(int ix=0;ix<CHECK_COUNT;ix++){
+		checkId_t check=(plan->order>>(ix*CHECK_ORDER_BITS))&CHECK_ORDER_MASK;
+		fprintf(stderr, "\t%-18s mean %7.2fus rejects %5.1f%%\n", checkName[check],
+				plan->timeSpent[check]/1000.0/plan->nSample,
+				100.0*plan->nRejected[check]/plan->nSample);
+	}
+}
+
+static certCacheEntry_t* getCertificate(checkContext_t* context, const char* cPath) {
+	/**
+	 * Return the cache entry for the certificate at <cPath>, loading it on a miss
+	 *
+	 * <cPath> is a certificate file, whose first certificate is taken, or
+	 * a bundle file and certificate index as bundle.pem#index. Files are PEM
+	 * or DER.
+	 *
+	 * On load the certificate is summarised, so repeated paths skip decoding
+	 * entirely.
+	 *
+	 * RETN:
+	 * 	Entry held for the caller to release, NULL if the certificate could not be read
+	 */
+	char file[PATH_MAX];
+	char key[PATH_MAX+BUNDLE_KEY_INDEX_LEN];
+	int index;
+	struct stat fileStat;
+
+	if(certificateKey(cPath, file, sizeof(file), key, sizeof(key), &index)!=0){
+		return(NULL);
+	}
+
+	certCacheEntry_t* entry = lookup_certCache(context->cache, key, file, &fileStat);
+	if(entry!=NULL){
+		return(entry);
+	}
+	if(index!=CERT_BUNDLE_WHOLE_FILE){
+		return(loadBundleCertificate(context, file, &fileStat, index));
+	}
+
+	STAGE_START(loadStart);
+	X509* cert = loadCertificate(context, file, &fileStat);
+	STAGE_STOP(loadStart, STAGE_LOAD);
+	if(cert==NULL){
+		return(NULL);
+	}
+
+	return(cacheCertificate(context, key, &fileStat, cert));
+}
+
+static certCacheEntry_t* cacheCertificate(checkContext_t* context, const char* key,
+		const struct stat* fileStat, X509* cert) {
+	/**
+	 * Decode everything the checks need from <cert> in one pass, verify its
+	 * chain if there is a trust store, and cache the result under <key>.
+	 * <cert> is freed.
+	 *
+	 * RETN:
+	 * 	Entry held for the caller to release
+	 */
+	STAGE_START(summaryStart);
+	certSummary_t* summary = create_certSummary(cert);
+	STAGE_STOP(summaryStart, STAGE_SUMMARY);
+	int chainStatus=CHAIN_NOT_CHECKED;
+	if(context->trust!=NULL){
+		STAGE_START(chainStart);
+		chainStatus=verify_trustStore(context->trust, cert);
+		STAGE_STOP(chainStart, STAGE_CHAIN);
+	}
+	X509_free(cert);
+
+	return(insert_certCache(context->cache, create_certCacheEntry(key, fileStat, summary, chainStatus)));
+}
+
+static certCacheEntry_t* loadBundleCertificate(checkContext_t* context, const char* file,
+		const struct stat* fileStat, int index) {
+	/**
+	 * Load certificate <index> of the bundle <file>, whose stat is <fileStat>
+	 *
+	 * The first time a bundle is read every certificate in it is summarised
+	 * into the cache in one pass, and their offsets recorded, so rows naming
+	 * its other certificates neither reopen nor rescan it. Later misses,
+	 * after eviction, read only the certificate needed.
+	 *
+	 * RETN:
+	 * 	Entry held for the caller to release, NULL if the certificate could not be read
+	 */
+	char key[PATH_MAX+BUNDLE_KEY_INDEX_LEN];
+	size_t offset;
+	X509* cert;
+
+	STAGE_START(loadStart);
+	certBundle_t* bundle=openBundle(context, file, fileStat);
+	if(bundle==NULL){
+		return(NULL);
+	}
+
+	int known=findOffset_certBundleTable(context->bundles, file, fileStat, index, &offset);
+	if(known!=0){
+		cert=NULL;
+		if(known==1){
+			seek_certBundle(bundle, offset);
+			cert=nextCert_certBundle(bundle, NULL);
+		}
+		closeCertBundle(bundle);
+		STAGE_STOP(loadStart, STAGE_LOAD);
+		if(cert==NULL){
+			return(NULL);
+		}
+
+		snprintf(key, sizeof(key), "%s%c%d", file, CERT_BUNDLE_SEPARATOR, index);
+		return(cacheCertificate(context, key, fileStat, cert));
+	}
+
+	/* First read of the bundle */
+	certCacheEntry_t* requested=NULL;
+	int nCert=0;
+	int nOffset=BUNDLE_OFFSET_INITIAL_SIZE;
+	size_t* offsets=malloc(sizeof(size_t)*nOffset);
+	if(offsets==NULL){
+		checkMallocFail();
+	}
+
+	while((cert=nextCert_certBundle(bundle, &offset))!=NULL){
+		if(nCert==nOffset){
+			nOffset*=2;
+			offsets=realloc(offsets, sizeof(size_t)*nOffset);
+			if(offsets==NULL){
+				checkMallocFail();
+			}
+		}
+		offsets[nCert]=offset;
+
+		snprintf(key, sizeof(key), "%s%c%d", file, CERT_BUNDLE_SEPARATOR, nCert);
+		certCacheEntry_t* entry=cacheCertificate(context, key, fileStat, cert);
+		if(nCert==index){
+			requested=entry;
+		} else {
+			release_certCache(context->cache, entry);
+		}
+		nCert++;
+	}
+	closeCertBundle(bundle);
+	STAGE_STOP(loadStart, STAGE_LOAD);
+
+	record_certBundleTable(context->bundles, file, fileStat, offsets, nCert);
+	free(offsets);
+	return(requested);
+}
+
+static X509* loadCertificate(checkContext_t* context, const char* path, const struct stat* fileStat){
+	/**
+	 * load the first certificate of <path>, PEM or DER. NULL if it cannot be read
+	 */
+	certBundle_t* bundle = openBundle(context, path, fileStat);
+	if(bundle==NULL){
+		return(NULL);
+	}
+
+	X509* cert = nextCert_certBundle(bundle, NULL);
+	closeCertBundle(bundle);
+	return cert;
+}
+
+static int certificateKey(const char* cPath, char* file, size_t fileSize, char* key, size_t keySize,
+		int* index) {
+	/**
+	 * Split certificate path <cPath> into its <file> and bundle <index>, and
+	 * give the <key> it is cached under
+	 *
+	 * RETN:
+	 * 	0, or -1 if the file path does not fit <file>
+	 */
+	if(splitBundlePath(cPath, file, fileSize, index)!=0){
+		return(-1);
+	}
+	if(*index==CERT_BUNDLE_WHOLE_FILE){
+		snprintf(key, keySize, "%s", cPath);
+	} else {
+		snprintf(key, keySize, "%s%c%d", file, CERT_BUNDLE_SEPARATOR, *index);
+	}
+	return(0);
+}
+
+static certBundle_t* openBundle(checkContext_t* context, const char* file,
+		const struct stat* fileStat) {
+	/**
+	 * Open certificate <file>, from memory if it was read ahead and is
+	 * unchanged since, <fileStat> being its current stat
+	 */
+	unsigned char* data;
+	size_t length;
+
+	if(context->prefetch!=NULL
+			&& take_certPrefetch(context->prefetch, file, fileStat, &data, &length)){
+		return(openCertBundleBuffer(data, length));
+	}
+	return(openCertBundle(file));
+}
+
+static int compileKeyUsage(dsa_t* usageRequired, uint32_t* required) {
+	/**
+	 * Compile text usage identifiers into <required>, a mask of EKU_* bits,
+	 * once for the run
+	 *
+	 * ARGS:
+	 * 	usageRequired - usages as OpenSSL names them, e.g. "TLS Web Server
+	 * 	Authentication" or "serverAuth", or dotted OIDs
+	 *
+	 * RETN:
+	 * 	0, or -1 if a usage is unknown
+	 */
+	*required=0;
+
+	for(int ix=0;ix<(usageRequired->length);ix++){
+		uint32_t usage=extendedKeyUsageOf(getItem_dsa(usageRequired, ix));
+		if(usage==0){
+			mylog("Unknown extended key usage required");
+			return(-1);
+		}
+		*required|=usage;
+	}
+	return(0);
+}
+
+static int verifyExtendedKeyUsage(const certSummary_t* summary, uint32_t usageRequired){
+	/**
+	 * Check the certificate of <summary> is valid for <usageRequired>
+	 *
+	 * ARGS:
+	 * 	usageRequired - EKU_* bits from compileKeyUsage
+	 *
+	 * RETN:
+	 * 	1 - indicate cert is valid for all given usages. Otherwise 0
+	 */
+	return((summary->extendedKeyUsage&usageRequired)==usageRequired);
+}
+
+static int verifyDomainName(const certCacheEntry_t* entry, const char* domain, size_t domainLength){
+	/**
+	 * Check that the given domain matches any one of the domain names of <entry>.
+	 *
+	 * Names are looked up through the index built when the certificate was
+	 * loaded, so an exact name costs one probe and a "*.parent" name another.
+	 *
+	 * ARG:
+	 * 	<entry>    - Loaded certificate, names may contain wildcards
+	 * 	<domain>   - domain to check names against for a match, <domainLength> chars
+	 *
+	 * RETURN:
+	 * 	DN_MATCH - <domain> matches some name of <entry>
+	 * 	DN_NOMATCH - <domain> does not match some name of <entry>
+	 */
+	if(lookup_hostnameIndex(entry->domainIndex, domain, domainLength)==HOSTNAME_MATCH){
+		return(DN_MATCH);
+	}
+	return(DN_NOMATCH);
+}
+
+static int verifyDomainNameRegex(const certCacheEntry_t* entry, const char* domainView, size_t domainLength){
+	/**
+	 * Reference implementation of verifyDomainName, kept for differential testing.
+	 *
+	 * Names are converted to regexes and searched for in <domain>, so unlike
+	 * verifyDomainName the match is not anchored to the whole domain.
+	 */
+	arena_t* arena=getRowArena();
+	char* domain=strndup_arena(arena, domainView, domainLength);
+	const char* name=NULL;
+
+	/* Check if certificate domain names match <domain> */
+	while((name=nextName_hostnameIndex(entry->domainIndex, name))!=NULL){
+		char* domainRegex=convertWildcardExpressionToRegex(name, arena);
+		if(isMatch(domainRegex,domain)==MATCH){
+			return(DN_MATCH);
+		}
+	}
+	return(DN_NOMATCH);
+}
+
+static char* convertWildcardExpressionToRegex(const char* wString, arena_t* arena){
+	/**
+	 * Replace any wildcards found in <wString> with an equivalent ERE.
+	 *
+	 * wString must be null terminated. Wildcards are standins for any number
+	 * of chars in WILDCARD_MATCHES (valid domain name chars)
+	 *
+	 * Wildcards can only occur in the leftmost portion of <wString>, where a
+	 * portion is delineated with a '.' (as per WILDCARD_MATCHER)
+	 *
+	 * RETN:
+	 *	 Return converted expression, allocated from <arena>
+	 */
+	char* buffer;
+	char* result=strndup_arena(arena, wString, strlen(wString));
+
+	while((buffer=replaceMatchArena(arena, WILDCARD_MATCHER, result, WILDCARD_MATCHES))!=NULL){
+		result=buffer;
+	}
+
+	/* Return a copy of wString if it contains no wildcards. */
+	return(result);
+}
+
+static int verifyTimeValidity(const certSummary_t* summary, int64_t at){
+	/**
+	 * Given a certificate summary, verify it's valid at <at> seconds since the epoch
+	 */
+
+	/* Time should be within not before and not after */
+	if(at<summary->notBefore || at>summary->notAfter){
+		return(CT_INVALID);
+	}
+
+	/* Time is within the certificate validity period.*/
+	return(CT_VALID);
+}
+
+int parseScenarioTimes(const char* list, scenario_t* times, int maxTime) {
+	/**
+	 * Parse a comma separated list of evaluation times into the times of
+	 * <times>. A time is "now", an offset from now such as "+7d" or "-12h"
+	 * (units s, m, h, d, default s), or "@<seconds since the epoch>".
+	 *
+	 * RETN:
+	 * 	Number of times parsed, -1 if <list> is malformed or has more than <maxTime>
+	 */
+	int nTime=0;
+	const char* item=list;
+
+	while(1){
+		size_t length=strcspn(item, SCENARIO_LIST_SEPARATOR);
+		char* end=NULL;
+		if(nTime==maxTime){
+			return(-1);
+		}
+
+		if(length==3 && strncmp(item, "now", 3)==0){
+			times[nTime].time=0;
+			times[nTime].relative=1;
+			end=(char*)item+length;
+		} else if(item[0]=='@'){
+			times[nTime].time=strtoll(item+1, &end, 10);
+			times[nTime].relative=0;
+		} else if(item[0]=='+' || item[0]=='-'){
+			int64_t offset=strtoll(item, &end, 10);
+			switch(*end){
+			case 'd': offset*=SECONDS_PER_DAY; end++; break;
+			case 'h': offset*=SECONDS_PER_HOUR; end++; break;
+			case 'm': offset*=SECONDS_PER_MINUTE; end++; break;
+			case 's': end++; break;
+			default: break;
+			}
+			times[nTime].time=offset;
+			times[nTime].relative=1;
+		}
+		if(end!=item+length || length<2){
+			return(-1);
+		}
+		nTime++;
+
+		if(item[length]=='\0'){
+			return(nTime);
+		}
+		item+=length+1;
+	}
+}
+
+int parsePolicies(const char* list, policy_t* policies, int maxPolicy) {
+	/**
+	 * Parse a comma separated list of policies into <policies>. A policy is
+	 * minimum key strengths joined by '/', each "<algorithm>:<bits>" with
+	 * algorithm "rsa", "ec" or "ed", or bare bits for RSA. Algorithms a
+	 * policy leaves out keep the minimum of DEFAULT_POLICY, so "3072/ec:384"
+	 * and "2048" are both policies.
+	 *
+	 * RETN:
+	 * 	Number of policies parsed, -1 if <list> is malformed or has more than <maxPolicy>
+	 */
+	static const policy_t defaultPolicy=DEFAULT_POLICY;
+	static const char* algorithmName[KEY_ALGORITHM_COUNT]={
+		[KEY_RSA]="rsa", [KEY_EC]="ec", [KEY_EDDSA]="ed"
+	};
+	int nPolicy=0;
+	const char* item=list;
+
+	if(maxPolicy<1){
+		return(-1);
+	}
+	policies[0]=defaultPolicy;
+	while(1){
+		keyAlgorithm_t algorithm=KEY_RSA;
+		size_t nameLength=strcspn(item, ":" POLICY_ITEM_SEPARATOR SCENARIO_LIST_SEPARATOR);
+		if(item[nameLength]==':'){
+			algorithm=KEY_UNKNOWN;
+			for(int ax=0;ax<KEY_ALGORITHM_COUNT;ax++){
+				if(strlen(algorithmName[ax])==nameLength
+						&& strncmp(item, algorithmName[ax], nameLength)==0){
+					algorithm=ax;
+				}
+			}
+			if(algorithm==KEY_UNKNOWN){
+				return(-1);
+			}
+			item+=nameLength+1;
+		}
+
+		char* end;
+		long bits=strtol(item, &end, 10);
+		if(end==item || bits<0 || bits>INT_MAX
+				|| (*end!='\0' && *end!=POLICY_ITEM_SEPARATOR[0] && *end!=SCENARIO_LIST_SEPARATOR[0])){
+			return(-1);
+		}
+		policies[nPolicy].minKeyBits[algorithm]=(int)bits;
+
+		if(*end=='\0'){
+			return(nPolicy+1);
+		}
+		if(*end==SCENARIO_LIST_SEPARATOR[0]){
+			if(++nPolicy==maxPolicy){
+				return(-1);
+			}
+			policies[nPolicy]=defaultPolicy;
+		}
+		item=end+1;
+	}
+}
+
+static scenario_t* createScenarios(const scenario_t* times, int nTime, const policy_t* policies,
+		int nPolicy) {
+	/**
+	 * Return every combination of the times of <times> with <policies>, time
+	 * major: all policies at the first time, then all at the second...
+	 */
+	scenario_t* scenario=malloc(sizeof(*scenario)*nTime*nPolicy);
+	if(scenario==NULL){
+		checkMallocFail();
+	}
+	for(int tx=0;tx<nTime;tx++){
+		for(int px=0;px<nPolicy;px++){
+			scenario[tx*nPolicy+px]=times[tx];
+			scenario[tx*nPolicy+px].policy=policies[px];
+		}
+	}
+	return(scenario);
+}
+
+static void checkMallocFail(void) {
+	mylog("Malloc failed to allocate memory. Program terminating");
+	exit(EXIT_CHECK_MALLOC_FAIL);
+}
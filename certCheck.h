@@ -0,0 +1,167 @@
+/*
+ * certCheck.h
+ *
+ * libcertcheck, certificate validation for embedding in other programs.
+ *
+ * A check context holds the settings of a run and the certificates decoded so
+ * far. Create one with create_checkContext and validate rows with
+ * validateBatch_checkContext, from any number of threads at once. Errors are
+ * returned rather than ending the process; only failure to allocate memory is
+ * fatal, as throughout the utilities.
+ */
+
+#ifndef CERTCHECK_H_
+#define CERTCHECK_H_
+
+#include "certBundle.h"
+#include "certCache.h"
+#include "certPrefetch.h"
+#include "csvTool.h"
+#include "dataStructure.h"
+#include "resultCache.h"
+#include "rowMemo.h"
+#include "timing.h"
+#include "trustStore.h"
+
+#include <stdint.h>
+
+/* Results of a certificate for one domain and scenario */
+#define CHECK_RESULT_VALID 1
+#define CHECK_RESULT_INVALID 0
+#define CERT_LOAD_ERROR -1
+
+/* Minimum key strength of the default policy, in the units of each algorithm */
+#define MIN_ALLOWABLE_RSA_BITS 2048
+#define MIN_ALLOWABLE_EC_BITS 256
+#define MIN_ALLOWABLE_EDDSA_BITS 256
+#define DEFAULT_POLICY { .minKeyBits={ [KEY_RSA]=MIN_ALLOWABLE_RSA_BITS, \
+		[KEY_EC]=MIN_ALLOWABLE_EC_BITS, [KEY_EDDSA]=MIN_ALLOWABLE_EDDSA_BITS } }
+#define MAX_SCENARIO 64
+
+/* Checks a certificate must pass for a domain, in their initial order. Fields
+ * of the certificate summary are cheapest, the domain costs an index lookup. */
+typedef enum check_id checkId_t;
+enum check_id {
+	CHECK_BASIC_CONSTRAINTS,
+	CHECK_KEY_LENGTH,
+	CHECK_KEY_USAGE,
+	CHECK_TIME,
+	CHECK_DOMAIN,
+	CHECK_COUNT
+};
+
+#define CHECK_ORDER_BITS 4
+#define CHECK_ORDER_MASK ((1<<CHECK_ORDER_BITS)-1)
+
+/* Order checks run in, stopping at the first failure. Some rows are sampled,
+ * running and timing every check, to measure each check's cost and rejection
+ * rate. An adaptive plan is reordered from those so checks likely to reject a
+ * row cheaply run first. */
+typedef struct check_plan checkPlan_t;
+struct check_plan {
+	uint64_t order;			/* Check ids, CHECK_ORDER_BITS each, first to run lowest */
+	int adaptive;
+	int sampling;
+	long nSample;
+	long nRejected[CHECK_COUNT];	/* Of sampled rows */
+	uint64_t timeSpent[CHECK_COUNT];	/* In ns, of sampled rows */
+};
+
+/* Key strength a certificate must meet. Keys of an algorithm without a
+ * minimum, KEY_UNKNOWN, never do. */
+typedef struct policy policy_t;
+struct policy {
+	int minKeyBits[KEY_ALGORITHM_COUNT];	/* By keyAlgorithm_t */
+};
+
+/* A time and policy to evaluate certificates under. Each scenario of a run
+ * gives every domain an output column. */
+typedef struct scenario scenario_t;
+struct scenario {
+	int64_t time;			/* Seconds since the epoch, or offset if <relative> */
+	int relative;			/* <time> is an offset from when the row is checked */
+	policy_t policy;
+};
+
+/* One certificate and domain, under one scenario */
+typedef struct check_input checkInput_t;
+struct check_input {
+	certCacheEntry_t* entry;
+	const char* domain;
+	size_t domainLength;
+	int64_t time;			/* Seconds since the epoch to evaluate at */
+	const policy_t* policy;
+	int domainMatch;		/* Shared by the scenarios of a domain, -1 until looked up */
+};
+
+/* Settings of a check context. Start from defaultCheckOptions. */
+typedef struct check_options checkOptions_t;
+struct check_options {
+	size_t cacheCap;			/* Bytes of decoded certificates to keep */
+	const scenario_t* time;		/* Times to evaluate at, <nTime> of them */
+	int nTime;
+	const policy_t* policy;		/* Policies to evaluate under, <nPolicy> of them */
+	int nPolicy;
+	dsa_t* requiredUsage;		/* Extended key usage names, NULL for server authentication */
+	int adaptivePlan;			/* Reorder checks as the run goes */
+	int regexMatcher;			/* Match domains with the reference regex matcher */
+	int reportStatistics;		/* Record row latency and sample the check plan */
+	uint64_t slowRowThreshold;	/* Log rows taking at least this many ns, 0 for none */
+	const char* resultCachePath;	/* File keeping outcomes between runs, NULL for none */
+	const char* trustStorePath;	/* CA directory or bundle to verify chains against, NULL for none */
+	size_t rowMemoCap;			/* Bytes of outcomes to keep for rows repeated by checkRow, 0 for none */
+	int evaluateAll;			/* Run every check, so outcomes name each check failed */
+	int prefetchDepth;			/* Files read ahead with prefetch_checkContext, 0 for none */
+	int prefetchThreads;		/* Threads reading them */
+	size_t prefetchCap;			/* Bytes of files read ahead to hold */
+};
+
+/* One row of a batch, a certificate and a domain to check it for */
+typedef struct check_request checkRequest_t;
+struct check_request {
+	const char* certificate;	/* Path, or bundle path and index as bundle.pem#index */
+	const char* domain;
+};
+
+/* State shared by every row of a run */
+typedef struct check_context checkContext_t;
+struct check_context {
+	certCache_t* cache;
+	certBundleTable_t* bundles;	/* Certificate offsets of bundles read */
+	uint32_t requiredUsage;		/* EKU_* bits, compiled from text at startup */
+	int (*verifyDomain)(const certCacheEntry_t* entry, const char* domain, size_t domainLength);
+	checkPlan_t plan;
+	scenario_t* scenario;
+	int nScenario;
+	latencyHistogram_t* rowLatency;	/* Time to check each row, NULL unless reporting */
+	uint64_t slowRowThreshold;		/* Log rows taking at least this many ns, 0 for none */
+	resultCache_t* results;			/* Outcomes shared between runs, NULL for none */
+	trustStore_t* trust;			/* CAs to verify issuer chains against, NULL for none */
+	rowMemo_t* memo;				/* Outcomes of rows seen, NULL for none */
+	int evaluateAll;				/* Checks do not stop at the first failure */
+	certPrefetch_t* prefetch;		/* Files read ahead of their rows, NULL for none */
+};
+
+void initCertCheck(void);
+void defaultCheckOptions(checkOptions_t* options);
+checkContext_t* create_checkContext(const checkOptions_t* options);
+void delete_checkContext(checkContext_t* context);
+int validateBatch_checkContext(checkContext_t* context, const checkRequest_t* request,
+		size_t nRequest, int* result, int* chainStatus);
+
+void prefetch_checkContext(checkContext_t* context, const char* certificate, size_t length,
+		long number);
+void retirePrefetch_checkContext(checkContext_t* context, long number);
+
+int checkRow(checkContext_t* context, csvRowView_t* row, domainOutcome_t* outcome);
+int checkRowTimed(checkContext_t* context, csvRowView_t* row, long number,
+		domainOutcome_t* outcome);
+void releaseRowArena(void);
+int parseScenarioTimes(const char* list, scenario_t* times, int maxTime);
+int parsePolicies(const char* list, policy_t* policies, int maxPolicy);
+void printCheckPlanStatistics(const checkPlan_t* plan);
+#ifdef CERTCHECK_TIMING
+void printStageStatistics(void);
+#endif
+
+#endif /* CERTCHECK_H_ */
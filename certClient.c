@@ -0,0 +1,163 @@
+/*
+ * certClient.c
+ *
+ * Client of a certcheck server (certcheck -D socket). Sends the rows of an
+ * input csv to the server and writes the answers to standard output, one
+ * output row per input row as certcheck would write to output.csv.
+ *
+ * Rows are streamed to the server while answers are read back, so any number
+ * of rows may be pipelined down one connection without either side blocking
+ * the other.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CLIENT_BUFFER_SIZE 65536
+
+#define EXIT_CLIENT_FAIL 1
+#define EXIT_USAGE 64
+
+static int connectServer(const char* socketPath);
+static int writeAll(int fd, const char* data, size_t length);
+static void clientExit(const char* m);
+
+int main(int argc, char** argv) {
+	char request[CLIENT_BUFFER_SIZE];
+	char answer[CLIENT_BUFFER_SIZE];
+	size_t requestLength=0;
+	size_t requestSent=0;
+	int inputOpen=1;
+
+	if(argc<2 || argc>3){
+		fprintf(stderr, "usage: %s socket [input.csv]\n", argv[0]);
+		exit(EXIT_USAGE);
+	}
+	/* A server going away shows as a failed write */
+	signal(SIGPIPE, SIG_IGN);
+	int input=(argc==3 && strcmp(argv[2], "-")!=0)?open(argv[2], O_RDONLY):STDIN_FILENO;
+	if(input<0){
+		clientExit("Failed to read input");
+	}
+	int server=connectServer(argv[1]);
+	if(server<0){
+		clientExit("Failed to connect to server");
+	}
+
+	/* Send input while it lasts and read answers until the server is done */
+	for(;;){
+		struct pollfd watch[2]={
+			{ .fd=server, .events=POLLIN },
+			{ .fd=input, .events=POLLIN }
+		};
+		int nWatch=1;
+		if(requestSent<requestLength){
+			watch[0].events|=POLLOUT;
+		} else if(inputOpen){
+			nWatch=2;
+		}
+		if(poll(watch, nWatch, -1)<0){
+			if(errno==EINTR){continue;}
+			clientExit("Failed to wait for server");
+		}
+
+		if(watch[0].revents&(POLLIN|POLLHUP|POLLERR)){
+			ssize_t nRead=read(server, answer, sizeof(answer));
+			if(nRead<0){
+				clientExit("Failed to read from server");
+			}
+			if(nRead==0){
+				break;
+			}
+			if(writeAll(STDOUT_FILENO, answer, nRead)!=0){
+				clientExit("Failed to write output");
+			}
+		}
+		if(watch[0].revents&POLLOUT){
+			ssize_t nWrite=write(server, request+requestSent, requestLength-requestSent);
+			if(nWrite<0 && errno!=EAGAIN && errno!=EINTR){
+				clientExit("Failed to write to server");
+			}
+			requestSent+=(nWrite>0)?nWrite:0;
+		}
+		if(nWatch==2 && (watch[1].revents&(POLLIN|POLLHUP|POLLERR))){
+			ssize_t nRead=read(input, request, sizeof(request));
+			if(nRead<0){
+				clientExit("Failed to read input");
+			}
+			requestLength=(nRead>0)?nRead:0;
+			requestSent=0;
+			if(nRead==0){
+				/* Tell the server no more rows are coming */
+				inputOpen=0;
+				shutdown(server, SHUT_WR);
+			}
+		}
+	}
+
+	close(server);
+	if(input!=STDIN_FILENO){
+		close(input);
+	}
+	if(inputOpen || requestSent<requestLength){
+		clientExit("Server closed the connection early");
+	}
+	return(0);
+}
+
+static int connectServer(const char* socketPath) {
+	/**
+	 * Connect to the server listening on <socketPath>, non blocking so
+	 * writes never hold up reading answers
+	 *
+	 * RETN:
+	 * 	Socket, or -1 on failure
+	 */
+	struct sockaddr_un address;
+
+	if(strlen(socketPath)>=sizeof(address.sun_path)){
+		return(-1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family=AF_UNIX;
+	strcpy(address.sun_path, socketPath);
+
+	int fd=socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd<0){
+		return(-1);
+	}
+	if(connect(fd, (struct sockaddr*)&address, sizeof(address))!=0){
+		close(fd);
+		return(-1);
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL)|O_NONBLOCK);
+	return(fd);
+}
+
+static int writeAll(int fd, const char* data, size_t length) {
+	/**
+	 * Write <length> bytes of <data> to <fd>, 0 on success
+	 */
+	while(length>0){
+		ssize_t nWrite=write(fd, data, length);
+		if(nWrite<0){
+			if(errno==EINTR){continue;}
+			return(-1);
+		}
+		data+=nWrite;
+		length-=nWrite;
+	}
+	return(0);
+}
+
+static void clientExit(const char* m) {
+	fprintf(stderr, "%s\n", m);
+	exit(EXIT_CLIENT_FAIL);
+}
@@ -0,0 +1,110 @@
+/*
+ * certDump.c
+ *
+ * certcheck-dump, printing the binary records written by certcheck -b as text,
+ * one line per record, or with -s counting the records failing each check.
+ * The records file is mapped and read in place, as any tool aggregating
+ * results would read it.
+ */
+#include "resultRecord.h"
+#include "trustStore.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define EXIT_INPUT_FAIL 36
+#define EXIT_USAGE 64
+
+/* Names of the RESULT_FAILED_* bits, by bit */
+#define FAILED_BIT_COUNT 16
+static const char* const failedName[FAILED_BIT_COUNT]={
+	[0]="basic-constraints", [1]="key-length", [2]="key-usage", [3]="time", [4]="domain",
+	[15]="load-error"
+};
+
+static void printRecord(const resultRecord_t* record);
+static void printSummary(const resultRecordMap_t* records);
+
+int main(int argc, char** argv) {
+	int option;
+	int summary=0;
+
+	while((option=getopt(argc, argv, "s"))!=-1){
+		switch(option){
+		case 's':
+			summary=1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-s] records\n", argv[0]);
+			exit(EXIT_USAGE);
+		}
+	}
+	if(optind!=argc-1){
+		fprintf(stderr, "usage: %s [-s] records\n", argv[0]);
+		exit(EXIT_USAGE);
+	}
+
+	resultRecordMap_t* records=openResultRecordMap(argv[optind]);
+	if(records==NULL){
+		fprintf(stderr, "Failed to read records: %s\n", argv[optind]);
+		exit(EXIT_INPUT_FAIL);
+	}
+
+	printf("# version %u, %u scenarios, started %" PRId64 ", %zu records\n",
+			records->header->version, records->header->nScenario,
+			records->header->startTime, records->nRecord);
+	if(summary){
+		printSummary(records);
+	} else {
+		printf("row,domain,scenario,failed,notAfter,keyBits,chain\n");
+		for(size_t ix=0;ix<records->nRecord;ix++){
+			printRecord(&records->record[ix]);
+		}
+	}
+	closeResultRecordMap(records);
+	return(0);
+}
+
+static void printRecord(const resultRecord_t* record) {
+	/**
+	 * Print <record> as a csv line, its failed checks joined by '|', or
+	 * "none"
+	 */
+	printf("%" PRIu64 ",%u,%u,", record->row, record->domain, record->scenario);
+	if(record->failed==0){
+		printf("none");
+	}
+	const char* separator="";
+	for(int bx=0;bx<FAILED_BIT_COUNT;bx++){
+		if(record->failed&(1u<<bx)){
+			printf("%s%s", separator, (failedName[bx]!=NULL)?failedName[bx]:"unknown");
+			separator="|";
+		}
+	}
+	printf(",%" PRId64 ",%d,%s\n", record->notAfter, record->keyBits,
+			chainStatusName(record->chainStatus));
+}
+
+static void printSummary(const resultRecordMap_t* records) {
+	/**
+	 * Print the number of records valid and failing each check
+	 */
+	long nFailed[FAILED_BIT_COUNT]={ 0 };
+	long nValid=0;
+
+	for(size_t ix=0;ix<records->nRecord;ix++){
+		unsigned failed=records->record[ix].failed;
+		nValid+=(failed==0);
+		for(int bx=0;bx<FAILED_BIT_COUNT;bx++){
+			nFailed[bx]+=(failed>>bx)&1;
+		}
+	}
+	printf("valid,%ld\n", nValid);
+	for(int bx=0;bx<FAILED_BIT_COUNT;bx++){
+		if(failedName[bx]!=NULL){
+			printf("%s,%ld\n", failedName[bx], nFailed[bx]);
+		}
+	}
+}
@@ -0,0 +1,197 @@
+/*
+ * certMerge.c
+ *
+ * certcheck-merge, joining the outputs of a run split with certcheck --shard
+ * back into one output in input order.
+ *
+ * Each row of a shard output leads with its number in the whole input, and
+ * each shard's rows are in input order, so the shards are merged by always
+ * taking the lowest numbered row at the head of any shard, from a min-heap of
+ * one row per shard. Only those heads are held, so memory does not grow with
+ * the outputs. Every number from 1 on must appear exactly once; a gap means a
+ * shard's output is missing or cut short, and fails the merge.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MERGE_BUFFER_SIZE (1024*1024)
+#define OUTPUT_STDOUT_PATH "-"
+
+#define EXIT_INPUT_FAIL 36
+#define EXIT_OUTPUT_FAIL 37
+#define EXIT_USAGE 64
+#define EXIT_MALLOC_FAIL 111
+
+/* The next unmerged row of a shard output */
+typedef struct shard_head shardHead_t;
+struct shard_head {
+	FILE* file;
+	const char* path;
+	char* line;
+	size_t capacity;
+	ssize_t length;
+	long number;		/* Of the row in <line> */
+	const char* row;	/* The output row in <line>, after its number */
+};
+
+static int readHead(shardHead_t* head);
+static void siftDown(shardHead_t** heap, int nHeap, int ix);
+static void mergeExit(const char* m, const char* path, int status);
+
+int main(int argc, char** argv) {
+	int option;
+	const char* outputPath=OUTPUT_STDOUT_PATH;
+	long next=1;
+
+	while((option=getopt(argc, argv, "o:"))!=-1){
+		switch(option){
+		case 'o':
+			outputPath=optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-o output] shard.csv...\n", argv[0]);
+			exit(EXIT_USAGE);
+		}
+	}
+	int nShard=argc-optind;
+	if(nShard<1){
+		fprintf(stderr, "usage: %s [-o output] shard.csv...\n", argv[0]);
+		exit(EXIT_USAGE);
+	}
+
+	FILE* output=(strcmp(outputPath, OUTPUT_STDOUT_PATH)==0)?stdout:fopen(outputPath, "w");
+	if(output==NULL){
+		mergeExit("Failed to open output", outputPath, EXIT_OUTPUT_FAIL);
+	}
+	setvbuf(output, NULL, _IOFBF, MERGE_BUFFER_SIZE);
+
+	/* Open every shard and heap those with a row */
+	shardHead_t* shard=calloc(nShard, sizeof(shardHead_t));
+	shardHead_t** heap=malloc(sizeof(shardHead_t*)*nShard);
+	if(shard==NULL || heap==NULL){
+		mergeExit("Malloc failed to allocate memory", NULL, EXIT_MALLOC_FAIL);
+	}
+	int nHeap=0;
+	for(int ix=0;ix<nShard;ix++){
+		shard[ix].path=argv[optind+ix];
+		shard[ix].file=fopen(shard[ix].path, "r");
+		if(shard[ix].file==NULL){
+			mergeExit("Failed to read shard", shard[ix].path, EXIT_INPUT_FAIL);
+		}
+		setvbuf(shard[ix].file, NULL, _IOFBF, MERGE_BUFFER_SIZE/nShard+BUFSIZ);
+		if(readHead(&shard[ix])){
+			heap[nHeap++]=&shard[ix];
+		}
+	}
+	for(int ix=nHeap/2-1;ix>=0;ix--){
+		siftDown(heap, nHeap, ix);
+	}
+
+	/* Write out the lowest numbered head until every shard is done */
+	while(nHeap>0){
+		shardHead_t* head=heap[0];
+		if(head->number!=next){
+			mergeExit((head->number<next)?"Row numbered twice in shards":"Row missing from shards",
+					head->path, EXIT_INPUT_FAIL);
+		}
+		fwrite(head->row, 1, head->length-(head->row-head->line), output);
+		next++;
+
+		long previous=head->number;
+		if(!readHead(head)){
+			heap[0]=heap[--nHeap];
+		} else if(head->number<=previous){
+			mergeExit("Shard rows out of order", head->path, EXIT_INPUT_FAIL);
+		}
+		siftDown(heap, nHeap, 0);
+	}
+
+	for(int ix=0;ix<nShard;ix++){
+		free(shard[ix].line);
+		fclose(shard[ix].file);
+	}
+	free(shard);
+	free(heap);
+	if(fflush(output)!=0 || (output!=stdout && fclose(output)!=0)){
+		mergeExit("Failed to write output", outputPath, EXIT_OUTPUT_FAIL);
+	}
+	return(0);
+}
+
+static int readHead(shardHead_t* head) {
+	/**
+	 * Read the next row of a shard into <head>, numbered and newline ended
+	 *
+	 * RETN:
+	 * 	1 if a row was read, 0 at the end of the shard
+	 */
+	char* end;
+
+	do{
+		head->length=getline(&head->line, &head->capacity, head->file);
+		if(head->length<0){
+			if(ferror(head->file)){
+				mergeExit("Failed to read shard", head->path, EXIT_INPUT_FAIL);
+			}
+			return(0);
+		}
+	} while(head->length==1 && head->line[0]=='\n');
+
+	head->number=strtol(head->line, &end, 10);
+	if(end==head->line || *end!=',' || head->number<1){
+		mergeExit("Shard row without a row number", head->path, EXIT_INPUT_FAIL);
+	}
+	head->row=end+1;
+
+	/* The last row of a file may lack its newline */
+	if(head->line[head->length-1]!='\n'){
+		if((size_t)head->length+1>=head->capacity){
+			char* line=realloc(head->line, head->length+2);
+			if(line==NULL){
+				mergeExit("Malloc failed to allocate memory", NULL, EXIT_MALLOC_FAIL);
+			}
+			head->row=line+(head->row-head->line);
+			head->line=line;
+			head->capacity=head->length+2;
+		}
+		head->line[head->length++]='\n';
+		head->line[head->length]='\0';
+	}
+	return(1);
+}
+
+static void siftDown(shardHead_t** heap, int nHeap, int ix) {
+	/**
+	 * Restore the heap order of <heap> below <ix>, lowest row number first
+	 */
+	for(;;){
+		int lowest=ix;
+		int left=2*ix+1;
+		int right=left+1;
+		if(left<nHeap && heap[left]->number<heap[lowest]->number){
+			lowest=left;
+		}
+		if(right<nHeap && heap[right]->number<heap[lowest]->number){
+			lowest=right;
+		}
+		if(lowest==ix){
+			return;
+		}
+		shardHead_t* swap=heap[ix];
+		heap[ix]=heap[lowest];
+		heap[lowest]=swap;
+		ix=lowest;
+	}
+}
+
+static void mergeExit(const char* m, const char* path, int status) {
+	if(path!=NULL){
+		fprintf(stderr, "%s: %s\n", m, path);
+	} else {
+		fprintf(stderr, "%s\n", m);
+	}
+	exit(status);
+}
@@ -0,0 +1,341 @@
+/*
+ * certPrefetch.c
+ *
+ * Reading certificate files ahead of the rows that name them. The row reader
+ * requests the file of each row some rows before it is checked; a pool of
+ * threads reads each requested file whole into memory, and the loader takes
+ * the buffer to parse in place rather than blocking on open and read. On cold
+ * caches and network file systems this overlaps the latency of many files
+ * with the parsing of others.
+ *
+ * Slots are retired as the rows they were requested for are written, in row
+ * order, so a file read ahead and never taken, as when the row is answered
+ * from a cache, is freed soon after.
+ */
+#include "certPrefetch.h"
+#include "hashTool.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define EXIT_PREFETCH_MALLOC_FAIL 122
+
+static void* readAhead(void* prefetch);
+static int readSlot(certPrefetch_t* prefetch, const char* file, unsigned char** data,
+		size_t* length, struct stat* fileStat);
+static prefetchSlot_t* findSlot(certPrefetch_t* prefetch, const char* file, uint64_t hash);
+static int sameIdentity(const struct stat* a, const struct stat* b);
+static void emptySlot(certPrefetch_t* prefetch, prefetchSlot_t* slot);
+static void* prefetchMalloc(size_t size);
+
+certPrefetch_t* create_certPrefetch(int depth, int nThread, size_t memoryCap) {
+	/**
+	 * Start <nThread> threads reading ahead up to <depth> files, holding at
+	 * most <memoryCap> bytes of them
+	 *
+	 * RETN:
+	 * 	Prefetch, stop with delete_certPrefetch. NULL if the threads could
+	 * 	not be started.
+	 */
+	certPrefetch_t* prefetch=prefetchMalloc(sizeof(*prefetch));
+
+	prefetch->slot=prefetchMalloc(sizeof(prefetchSlot_t)*depth);
+	memset(prefetch->slot, 0, sizeof(prefetchSlot_t)*depth);
+	prefetch->nSlot=depth;
+	prefetch->tail=prefetch->head=prefetch->nextRead=0;
+	prefetch->memoryUsed=0;
+	prefetch->memoryCap=memoryCap;
+	prefetch->stopping=0;
+	prefetch->nRead=prefetch->nTaken=prefetch->nWaited=prefetch->nDropped=0;
+	pthread_mutex_init(&prefetch->lock, NULL);
+	pthread_cond_init(&prefetch->requested, NULL);
+	pthread_cond_init(&prefetch->read, NULL);
+
+	prefetch->thread=prefetchMalloc(sizeof(pthread_t)*nThread);
+	for(prefetch->nThread=0;prefetch->nThread<nThread;prefetch->nThread++){
+		if(pthread_create(&prefetch->thread[prefetch->nThread], NULL, readAhead, prefetch)!=0){
+			delete_certPrefetch(prefetch);
+			return(NULL);
+		}
+	}
+	return(prefetch);
+}
+
+void delete_certPrefetch(certPrefetch_t* prefetch) {
+	/**
+	 * Stop the reader threads, once any read under way is done, and free
+	 * every file held
+	 */
+	if(prefetch==NULL){return;}
+	pthread_mutex_lock(&prefetch->lock);
+	prefetch->stopping=1;
+	pthread_cond_broadcast(&prefetch->requested);
+	pthread_mutex_unlock(&prefetch->lock);
+	for(int ix=0;ix<prefetch->nThread;ix++){
+		pthread_join(prefetch->thread[ix], NULL);
+	}
+
+	for(int ix=0;ix<prefetch->nSlot;ix++){
+		emptySlot(prefetch, &prefetch->slot[ix]);
+	}
+	pthread_cond_destroy(&prefetch->read);
+	pthread_cond_destroy(&prefetch->requested);
+	pthread_mutex_destroy(&prefetch->lock);
+	free(prefetch->thread);
+	free(prefetch->slot);
+	free(prefetch);
+}
+
+void request_certPrefetch(certPrefetch_t* prefetch, const char* file, long number) {
+	/**
+	 * Ask for <file> to be read ahead of row <number>, which must not be
+	 * before that of any earlier request. Files already requested and not
+	 * yet taken are not asked for again, and a request finding every slot
+	 * in use is dropped.
+	 */
+	uint64_t hash=hashString(file);
+
+	pthread_mutex_lock(&prefetch->lock);
+	if(findSlot(prefetch, file, hash)!=NULL){
+		pthread_mutex_unlock(&prefetch->lock);
+		return;
+	}
+	prefetchSlot_t* slot=&prefetch->slot[prefetch->head%prefetch->nSlot];
+	if(prefetch->head-prefetch->tail==prefetch->nSlot || slot->state!=PREFETCH_EMPTY){
+		prefetch->nDropped++;
+		pthread_mutex_unlock(&prefetch->lock);
+		return;
+	}
+
+	slot->file=prefetchMalloc(strlen(file)+1);
+	strcpy(slot->file, file);
+	slot->hash=hash;
+	slot->number=number;
+	slot->data=NULL;
+	slot->state=PREFETCH_PENDING;
+	prefetch->head++;
+	pthread_cond_signal(&prefetch->requested);
+	pthread_mutex_unlock(&prefetch->lock);
+}
+
+int take_certPrefetch(certPrefetch_t* prefetch, const char* file, const struct stat* fileStat,
+		unsigned char** data, size_t* length) {
+	/**
+	 * Take <file> if it was read ahead, waiting for it if it is being read.
+	 * A request not yet started is cancelled, as the caller is about to
+	 * read the file itself.
+	 *
+	 * ARGS:
+	 * 	fileStat - current stat of <file>. A file changed since it was read
+	 * 	ahead is not taken.
+	 *
+	 * RETN:
+	 * 	1 with <data> set to the <length> bytes of the whole file, for the
+	 * 	caller to free. 0 if <file> was not read ahead.
+	 */
+	uint64_t hash=hashString(file);
+	int waited=0;
+	int taken=0;
+
+	pthread_mutex_lock(&prefetch->lock);
+	prefetchSlot_t* slot=findSlot(prefetch, file, hash);
+	while(slot!=NULL && slot->state==PREFETCH_READING){
+		waited=1;
+		pthread_cond_wait(&prefetch->read, &prefetch->lock);
+		slot=findSlot(prefetch, file, hash);
+	}
+	if(slot!=NULL){
+		if(slot->state==PREFETCH_READY && sameIdentity(&slot->fileStat, fileStat)){
+			*data=slot->data;
+			*length=slot->length;
+			prefetch->memoryUsed-=slot->length;
+			slot->data=NULL;
+			prefetch->nTaken++;
+			prefetch->nWaited+=waited;
+			taken=1;
+		} else if(slot->state==PREFETCH_READY){
+			free(slot->data);
+			prefetch->memoryUsed-=slot->length;
+			slot->data=NULL;
+		}
+		slot->state=PREFETCH_TAKEN;
+	}
+	pthread_mutex_unlock(&prefetch->lock);
+	return(taken);
+}
+
+void retire_certPrefetch(certPrefetch_t* prefetch, long number) {
+	/**
+	 * Free the slots of rows up to <number>, which are done with. Files
+	 * being read are freed once read.
+	 */
+	pthread_mutex_lock(&prefetch->lock);
+	while(prefetch->tail<prefetch->head){
+		prefetchSlot_t* slot=&prefetch->slot[prefetch->tail%prefetch->nSlot];
+		if(slot->number>number){
+			break;
+		}
+		if(slot->state==PREFETCH_READING){
+			slot->state=PREFETCH_ABANDONED;
+		} else {
+			emptySlot(prefetch, slot);
+		}
+		prefetch->tail++;
+	}
+	if(prefetch->nextRead<prefetch->tail){
+		prefetch->nextRead=prefetch->tail;
+	}
+	pthread_mutex_unlock(&prefetch->lock);
+}
+
+static void* readAhead(void* prefetchArg) {
+	/**
+	 * Reader thread, reading pending slots in the order requested until the
+	 * prefetch stops
+	 */
+	certPrefetch_t* prefetch=prefetchArg;
+	unsigned char* data;
+	size_t length;
+	struct stat fileStat;
+
+	pthread_mutex_lock(&prefetch->lock);
+	for(;;){
+		while(!prefetch->stopping && (prefetch->nextRead==prefetch->head
+				|| prefetch->slot[prefetch->nextRead%prefetch->nSlot].state!=PREFETCH_PENDING)){
+			if(prefetch->nextRead<prefetch->head){
+				prefetch->nextRead++;
+			} else {
+				pthread_cond_wait(&prefetch->requested, &prefetch->lock);
+			}
+		}
+		if(prefetch->stopping){
+			break;
+		}
+		prefetchSlot_t* slot=&prefetch->slot[prefetch->nextRead++%prefetch->nSlot];
+		slot->state=PREFETCH_READING;
+		pthread_mutex_unlock(&prefetch->lock);
+
+		/* The slot and its file are kept while it is being read */
+		int failed=readSlot(prefetch, slot->file, &data, &length, &fileStat);
+
+		pthread_mutex_lock(&prefetch->lock);
+		if(slot->state==PREFETCH_ABANDONED){
+			if(!failed){
+				free(data);
+				prefetch->memoryUsed-=length;
+			}
+			emptySlot(prefetch, slot);
+		} else if(failed){
+			slot->state=PREFETCH_FAILED;
+		} else {
+			slot->data=data;
+			slot->length=length;
+			slot->fileStat=fileStat;
+			slot->state=PREFETCH_READY;
+			prefetch->nRead++;
+		}
+		pthread_cond_broadcast(&prefetch->read);
+	}
+	pthread_mutex_unlock(&prefetch->lock);
+	return(NULL);
+}
+
+static int readSlot(certPrefetch_t* prefetch, const char* file, unsigned char** data,
+		size_t* length, struct stat* fileStat) {
+	/**
+	 * Read the whole of <file> into memory counted against the cap
+	 *
+	 * RETN:
+	 * 	0 with <data> set to its <length> bytes, or -1 if it could not be
+	 * 	read or would pass the cap
+	 */
+	int fd=open(file, O_RDONLY);
+	if(fd<0){
+		return(-1);
+	}
+	if(fstat(fd, fileStat)!=0 || !S_ISREG(fileStat->st_mode) || fileStat->st_size==0){
+		close(fd);
+		return(-1);
+	}
+	*length=fileStat->st_size;
+
+	pthread_mutex_lock(&prefetch->lock);
+	int fits=(prefetch->memoryUsed+*length<=prefetch->memoryCap);
+	if(fits){
+		prefetch->memoryUsed+=*length;
+	}
+	pthread_mutex_unlock(&prefetch->lock);
+	if(!fits){
+		close(fd);
+		return(-1);
+	}
+
+	*data=prefetchMalloc(*length);
+	size_t done=0;
+	while(done<*length){
+		ssize_t n=read(fd, *data+done, *length-done);
+		if(n<0 && errno==EINTR){
+			continue;
+		}
+		if(n<=0){
+			break;
+		}
+		done+=n;
+	}
+	close(fd);
+	if(done<*length){
+		free(*data);
+		pthread_mutex_lock(&prefetch->lock);
+		prefetch->memoryUsed-=*length;
+		pthread_mutex_unlock(&prefetch->lock);
+		return(-1);
+	}
+	return(0);
+}
+
+static prefetchSlot_t* findSlot(certPrefetch_t* prefetch, const char* file, uint64_t hash) {
+	/**
+	 * RETN:
+	 * 	Slot of <file> that has not been taken, NULL if there is none
+	 */
+	for(long ix=prefetch->tail;ix<prefetch->head;ix++){
+		prefetchSlot_t* slot=&prefetch->slot[ix%prefetch->nSlot];
+		if(slot->state>=PREFETCH_PENDING && slot->state<=PREFETCH_FAILED
+				&& slot->hash==hash && strcmp(slot->file, file)==0){
+			return(slot);
+		}
+	}
+	return(NULL);
+}
+
+static int sameIdentity(const struct stat* a, const struct stat* b) {
+	return(a->st_dev==b->st_dev && a->st_ino==b->st_ino && a->st_size==b->st_size
+			&& a->st_mtime==b->st_mtime);
+}
+
+static void emptySlot(certPrefetch_t* prefetch, prefetchSlot_t* slot) {
+	/**
+	 * Free what <slot> holds, under the lock or once the threads are stopped
+	 */
+	if(slot->state==PREFETCH_READY){
+		free(slot->data);
+		prefetch->memoryUsed-=slot->length;
+	}
+	free(slot->file);
+	slot->file=NULL;
+	slot->data=NULL;
+	slot->state=PREFETCH_EMPTY;
+}
+
+static void* prefetchMalloc(size_t size) {
+	void* memory=malloc(size);
+	if(memory==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_PREFETCH_MALLOC_FAIL);
+	}
+	return(memory);
+}
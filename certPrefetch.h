@@ -0,0 +1,72 @@
+/*
+ * certPrefetch.h
+ *
+ * Certificate files read ahead of their rows, see certPrefetch.c.
+ */
+
+#ifndef CERTPREFETCH_H_
+#define CERTPREFETCH_H_
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define CERT_PREFETCH_DEFAULT_THREADS 4
+#define CERT_PREFETCH_DEFAULT_CAP (16*1024*1024)
+
+/* States of a prefetch slot */
+#define PREFETCH_EMPTY 0
+#define PREFETCH_PENDING 1		/* Waiting for a reader thread */
+#define PREFETCH_READING 2
+#define PREFETCH_READY 3		/* <data> holds the whole file */
+#define PREFETCH_FAILED 4		/* Not read, the loader reads it itself */
+#define PREFETCH_TAKEN 5		/* Handed to the loader, or cancelled */
+#define PREFETCH_ABANDONED 6	/* Retired while being read, emptied once read */
+
+/* A certificate file requested ahead of the row that names it */
+typedef struct prefetch_slot prefetchSlot_t;
+struct prefetch_slot {
+	int state;
+	char* file;
+	uint64_t hash;			/* Of <file> */
+	long number;			/* Of the row the file was requested for */
+	unsigned char* data;
+	size_t length;
+	struct stat fileStat;	/* Of the file read */
+};
+
+/* Certificate files read ahead of the rows naming them by a pool of reader
+ * threads, so checking a row does not wait on the file system. Slots form a
+ * ring of the files requested, oldest first; a request is dropped rather
+ * than waited on if the ring is full. Bytes read and not yet taken are held
+ * within a cap. */
+typedef struct cert_prefetch certPrefetch_t;
+struct cert_prefetch {
+	prefetchSlot_t* slot;
+	int nSlot;
+	long tail;				/* Oldest slot in use, slots are used in turn */
+	long head;				/* Next slot to use */
+	long nextRead;			/* Next slot a reader thread looks at */
+	size_t memoryUsed;
+	size_t memoryCap;
+	pthread_t* thread;
+	int nThread;
+	int stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t requested;	/* A slot is pending, or the pool is stopping */
+	pthread_cond_t read;		/* A slot has been read */
+	long nRead;				/* Files read ahead */
+	long nTaken;			/* Of those, handed to the loader */
+	long nWaited;			/* Taken while still being read */
+	long nDropped;			/* Requests made with the ring full */
+};
+
+certPrefetch_t* create_certPrefetch(int depth, int nThread, size_t memoryCap);
+void delete_certPrefetch(certPrefetch_t* prefetch);
+void request_certPrefetch(certPrefetch_t* prefetch, const char* file, long number);
+int take_certPrefetch(certPrefetch_t* prefetch, const char* file, const struct stat* fileStat,
+		unsigned char** data, size_t* length);
+void retire_certPrefetch(certPrefetch_t* prefetch, long number);
+
+#endif /* CERTPREFETCH_H_ */
@@ -0,0 +1,314 @@
+/*
+ * certServer.c
+ *
+ * Validation served over a Unix domain socket, so short lived callers do not
+ * each pay OpenSSL initialisation and start with a cold certificate cache.
+ *
+ * Clients write input rows, as in input.csv, and read back one output row per
+ * input row in the order they were sent. Rows may be pipelined: every whole row
+ * received is answered and the answers written out together. A row whose
+ * certificate cannot be read is answered with CERT_SERVER_LOAD_ERROR appended
+ * rather than ending the server. Each connection is served by its own thread,
+ * all sharing the run's certificate cache.
+ */
+#include "certServer.h"
+#include "certVerifier.h"
+#include "csvTool.h"
+#include "logger.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVER_LISTEN_BACKLOG 64
+#define SERVER_READ_SIZE 4096
+#define SERVER_MAX_ROW (1024*1024)
+#define SERVER_ROW_DELIMITER '\n'
+
+static volatile sig_atomic_t serverStop=0;
+
+static int claimSocketPath(const char* socketPath);
+static void stopServer(int signal);
+static void* serveConnection(void* connection);
+static void answerRow(certServer_t* server, csvWriter_t* output, csvRowView_t* row, long number);
+static void closeConnection(certConnection_t* connection);
+static void* serverMalloc(size_t size);
+
+int runCertServer(checkContext_t* context, const char* socketPath) {
+	/**
+	 * Serve validation of rows on the Unix socket <socketPath> until
+	 * SIGINT or SIGTERM
+	 *
+	 * A stale socket left at <socketPath> by a server no longer running is
+	 * replaced. On stopping, open connections are shut down and waited
+	 * for, and the socket removed.
+	 *
+	 * RETN:
+	 * 	0 once stopped, -1 if the socket could not be set up
+	 */
+	certServer_t server;
+	struct sockaddr_un address;
+	struct sigaction action;
+	sigset_t stopSignals;
+	sigset_t previous;
+
+	if(strlen(socketPath)>=sizeof(address.sun_path) || claimSocketPath(socketPath)!=0){
+		return(-1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family=AF_UNIX;
+	strcpy(address.sun_path, socketPath);
+
+	server.listenFd=socket(AF_UNIX, SOCK_STREAM, 0);
+	if(server.listenFd<0){
+		return(-1);
+	}
+	if(bind(server.listenFd, (struct sockaddr*)&address, sizeof(address))!=0
+			|| listen(server.listenFd, SERVER_LISTEN_BACKLOG)!=0){
+		close(server.listenFd);
+		return(-1);
+	}
+	server.context=context;
+	server.connection=NULL;
+	server.nConnection=0;
+	pthread_mutex_init(&server.lock, NULL);
+	pthread_cond_init(&server.closed, NULL);
+
+	/* Stop signals are blocked but while waiting for a connection, which
+	 * pselect unblocks them for atomically, so one arriving just before the
+	 * wait still ends it. Connection threads inherit the mask, so the signals
+	 * reach only this thread. A client going away shows as a failed write
+	 * rather than SIGPIPE. */
+	memset(&action, 0, sizeof(action));
+	action.sa_handler=stopServer;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+	sigemptyset(&stopSignals);
+	sigaddset(&stopSignals, SIGINT);
+	sigaddset(&stopSignals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stopSignals, &previous);
+
+	/* Nonblocking, so a connection gone between pselect and accept does not block */
+	fcntl(server.listenFd, F_SETFL, fcntl(server.listenFd, F_GETFL)|O_NONBLOCK);
+
+	while(!serverStop){
+		fd_set listening;
+		FD_ZERO(&listening);
+		FD_SET(server.listenFd, &listening);
+		if(pselect(server.listenFd+1, &listening, NULL, NULL, NULL, &previous)<0){
+			if(errno!=EINTR){
+				mylog("Failed to wait for connection");
+			}
+			continue;
+		}
+
+		int fd=accept(server.listenFd, NULL, NULL);
+		if(fd<0){
+			if(errno!=EAGAIN && errno!=EWOULDBLOCK && errno!=ECONNABORTED && errno!=EINTR){
+				mylog("Failed to accept connection");
+			}
+			continue;
+		}
+
+		certConnection_t* connection=serverMalloc(sizeof(*connection));
+		connection->server=&server;
+		connection->fd=fd;
+		pthread_mutex_lock(&server.lock);
+		connection->prev=NULL;
+		connection->next=server.connection;
+		if(server.connection!=NULL){
+			server.connection->prev=connection;
+		}
+		server.connection=connection;
+		server.nConnection++;
+		pthread_mutex_unlock(&server.lock);
+
+		pthread_t thread;
+		if(pthread_create(&thread, NULL, serveConnection, connection)!=0){
+			mylog("Failed to start connection thread");
+			closeConnection(connection);
+		} else {
+			pthread_detach(thread);
+		}
+	}
+
+	/* Stop taking connections, then end the open ones */
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	close(server.listenFd);
+	unlink(socketPath);
+	pthread_mutex_lock(&server.lock);
+	for(certConnection_t* connection=server.connection;connection!=NULL;connection=connection->next){
+		shutdown(connection->fd, SHUT_RDWR);
+	}
+	while(server.nConnection>0){
+		pthread_cond_wait(&server.closed, &server.lock);
+	}
+	pthread_mutex_unlock(&server.lock);
+	pthread_mutex_destroy(&server.lock);
+	pthread_cond_destroy(&server.closed);
+	return(0);
+}
+
+static int claimSocketPath(const char* socketPath) {
+	/**
+	 * Make <socketPath> free to bind, removing a socket no server is
+	 * listening on
+	 *
+	 * RETN:
+	 * 	0, or -1 if a server is listening there or the path is not a socket
+	 */
+	struct stat pathStat;
+	struct sockaddr_un address;
+
+	if(lstat(socketPath, &pathStat)!=0){
+		return((errno==ENOENT)?0:-1);
+	}
+	if(!S_ISSOCK(pathStat.st_mode)){
+		return(-1);
+	}
+
+	int fd=socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd<0){
+		return(-1);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family=AF_UNIX;
+	strcpy(address.sun_path, socketPath);
+	int live=(connect(fd, (struct sockaddr*)&address, sizeof(address))==0);
+	int refused=(!live && errno==ECONNREFUSED);
+	close(fd);
+
+	if(!refused || unlink(socketPath)!=0){
+		return(-1);
+	}
+	return(0);
+}
+
+static void stopServer(int signal) {
+	(void)signal;
+	serverStop=1;
+}
+
+static void* serveConnection(void* arg) {
+	/**
+	 * Answer the rows of a connection until the client closes it
+	 *
+	 * Received bytes are buffered; every whole row in the buffer is checked
+	 * and the answers flushed in one write before reading again. A final row
+	 * without a delimiter is answered once the client stops writing.
+	 */
+	certConnection_t* connection=arg;
+	certServer_t* server=connection->server;
+	size_t capacity=SERVER_READ_SIZE;
+	size_t length=0;
+	char* buffer=serverMalloc(capacity);
+	csvWriter_t* output=openCsvWriterFd(connection->fd, 0, CSV_WRITER_DEFAULT_CAPACITY);
+	csvRowView_t row;
+	long rowNumber=0;
+	int reading=1;
+
+	initRowView(&row);
+	while(reading){
+		if(length==capacity){
+			if(capacity>=SERVER_MAX_ROW){
+				mylog("Row too long, closing connection");
+				break;
+			}
+			capacity*=2;
+			buffer=realloc(buffer, capacity);
+			if(buffer==NULL){
+				programExit("Malloc failed to allocate memory. Program terminating", EXIT_MALLOC_FAIL);
+			}
+		}
+
+		ssize_t nRead=read(connection->fd, buffer+length, capacity-length);
+		if(nRead<0 && errno==EINTR){
+			continue;
+		}
+		if(nRead<=0){
+			reading=0;
+		} else {
+			length+=nRead;
+		}
+
+		/* Answer each whole row, and the unterminated last row at the end */
+		size_t position=0;
+		while(position<length){
+			const char* line=buffer+position;
+			const char* lineEnd=memchr(line, SERVER_ROW_DELIMITER, length-position);
+			if(lineEnd==NULL && reading){
+				break;
+			}
+			size_t lineLength=(lineEnd==NULL)?length-position:(size_t)(lineEnd-line);
+			position+=lineLength+(lineEnd!=NULL);
+
+			/* Skip empty rows, as in input files */
+			if(lineLength>0){
+				splitRowView(line, lineLength, &row);
+				answerRow(server, output, &row, ++rowNumber);
+			}
+		}
+		if(flushCsvWriter(output)!=0){
+			break;
+		}
+		memmove(buffer, buffer+position, length-position);
+		length-=position;
+	}
+
+	freeRowView(&row);
+	closeCsvWriter(output);
+	free(buffer);
+	closeConnection(connection);
+	return(NULL);
+}
+
+static void answerRow(certServer_t* server, csvWriter_t* output, csvRowView_t* row, long number) {
+	/**
+	 * Check input <row>, the <number>th of its connection, and buffer the
+	 * answer in <output>. Write failures show at the next flush.
+	 */
+	if(checkRowTimed(server->context, row, number, NULL)==CERT_LOAD_ERROR){
+		appendCellView(row, CERT_SERVER_LOAD_ERROR, strlen(CERT_SERVER_LOAD_ERROR));
+	}
+	writeRowBuffered(output, row);
+}
+
+static void closeConnection(certConnection_t* connection) {
+	/**
+	 * Close <connection> and drop it from its server, waking the server if
+	 * it is waiting for connections to end
+	 */
+	certServer_t* server=connection->server;
+
+	pthread_mutex_lock(&server->lock);
+	if(connection->prev!=NULL){
+		connection->prev->next=connection->next;
+	} else {
+		server->connection=connection->next;
+	}
+	if(connection->next!=NULL){
+		connection->next->prev=connection->prev;
+	}
+	server->nConnection--;
+	close(connection->fd);
+	pthread_cond_signal(&server->closed);
+	pthread_mutex_unlock(&server->lock);
+	free(connection);
+}
+
+static void* serverMalloc(size_t size) {
+	void* memory=malloc(size);
+	if(memory==NULL){
+		programExit("Malloc failed to allocate memory. Program terminating", EXIT_MALLOC_FAIL);
+	}
+	return(memory);
+}
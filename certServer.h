@@ -0,0 +1,40 @@
+/*
+ * certServer.h
+ *
+ * Validation served over a Unix domain socket, see certServer.c.
+ */
+
+#ifndef CERTSERVER_H_
+#define CERTSERVER_H_
+
+#include "certCheck.h"
+
+#include <pthread.h>
+
+/* Cell answering a row whose certificate could not be read */
+#define CERT_SERVER_LOAD_ERROR "error"
+
+typedef struct cert_server certServer_t;
+
+/* A client connection, answered on its own thread */
+typedef struct cert_connection certConnection_t;
+struct cert_connection {
+	certServer_t* server;
+	int fd;
+	certConnection_t* next;
+	certConnection_t* prev;
+};
+
+/* Connections of a running server */
+struct cert_server {
+	checkContext_t* context;
+	int listenFd;
+	certConnection_t* connection;	/* Open connections */
+	int nConnection;
+	pthread_mutex_t lock;
+	pthread_cond_t closed;		/* Signalled as each connection ends */
+};
+
+int runCertServer(checkContext_t* context, const char* socketPath);
+
+#endif /* CERTSERVER_H_ */
@@ -0,0 +1,295 @@
+/*
+ * certSummary.c
+ *
+ * Decoding of the fields the checks need from a certificate into one summary.
+ */
+
+#include "certSummary.h"
+#include "logger.h"
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/x509v3.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define EXIT_SUMMARY_MALLOC_FAIL 116
+#define OID_BUFFER_LEN 128
+
+/* Extended key usages with a bit. The OID is matched when the linked OpenSSL
+ * has no NID for a usage, so certificates are read the same whatever its
+ * object table holds. */
+typedef struct eku_name ekuName_t;
+struct eku_name {
+	int nid;
+	const char* oid;
+	uint32_t bit;
+};
+
+static const ekuName_t ekuName[]={
+	{ NID_server_auth,		"1.3.6.1.5.5.7.3.1",		EKU_SERVER_AUTH },
+	{ NID_client_auth,		"1.3.6.1.5.5.7.3.2",		EKU_CLIENT_AUTH },
+	{ NID_code_sign,		"1.3.6.1.5.5.7.3.3",		EKU_CODE_SIGNING },
+	{ NID_email_protect,		"1.3.6.1.5.5.7.3.4",		EKU_EMAIL_PROTECTION },
+	{ NID_time_stamp,		"1.3.6.1.5.5.7.3.8",		EKU_TIME_STAMPING },
+	{ NID_OCSP_sign,		"1.3.6.1.5.5.7.3.9",		EKU_OCSP_SIGNING },
+	{ NID_anyExtendedKeyUsage,	"2.5.29.37.0",			EKU_ANY },
+	{ NID_ipsec_IKE,		"1.3.6.1.5.5.7.3.17",		EKU_IPSEC_IKE },
+	{ NID_ms_sgc,			"1.3.6.1.4.1.311.10.3.3",	EKU_MS_SGC },
+	{ NID_ns_sgc,			"2.16.840.1.113730.4.1",	EKU_NS_SGC },
+};
+#define N_EKU_NAME ((int)(sizeof(ekuName)/sizeof(ekuName[0])))
+
+static int64_t timeToEpoch(const ASN1_TIME* t, int64_t fallback);
+static uint32_t extendedKeyUsageBit(const ASN1_OBJECT* usage);
+static const ASN1_STRING* getCommonNameString(X509* cert);
+static int isUsableName(const ASN1_STRING* name);
+static keyAlgorithm_t getKeyAlgorithm(const EVP_PKEY* key);
+
+certSummary_t* create_certSummary(X509* cert) {
+	/**
+	 * Decode the summary of <cert>, visiting each extension once
+	 *
+	 * OpenSSL structures decoded along the way are freed before return. Names
+	 * containing a null byte are left out, as they cannot be compared safely
+	 * as strings.
+	 *
+	 * RETN:
+	 * 	Summary to delete with delete_certSummary
+	 */
+	GENERAL_NAMES* altNames=NULL;
+	int ca=0;
+	int hasBasicConstraints=0;
+	int hasExtendedKeyUsage=0;
+	uint32_t extendedKeyUsage=0;
+
+	/* Single pass over the extensions, first of any repeated extension wins */
+	int nExtension=X509_get_ext_count(cert);
+	for(int ix=0;ix<nExtension;ix++){
+		X509_EXTENSION* extension=X509_get_ext(cert, ix);
+
+		switch(OBJ_obj2nid(X509_EXTENSION_get_object(extension))){
+		case NID_subject_alt_name:
+			if(altNames==NULL){
+				altNames=X509V3_EXT_d2i(extension);
+			}
+			break;
+		case NID_basic_constraints: {
+			BASIC_CONSTRAINTS* constraints=X509V3_EXT_d2i(extension);
+			if(constraints!=NULL && !hasBasicConstraints){
+				hasBasicConstraints=1;
+				ca=(constraints->ca!=0);
+			}
+			BASIC_CONSTRAINTS_free(constraints);
+			break;
+		}
+		case NID_ext_key_usage: {
+			EXTENDED_KEY_USAGE* usages=X509V3_EXT_d2i(extension);
+			if(usages!=NULL && !hasExtendedKeyUsage){
+				hasExtendedKeyUsage=1;
+				for(int ux=0;ux<sk_ASN1_OBJECT_num(usages);ux++){
+					extendedKeyUsage|=extendedKeyUsageBit(sk_ASN1_OBJECT_value(usages, ux));
+				}
+			}
+			EXTENDED_KEY_USAGE_free(usages);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	/* Size the name buffer, then copy names in */
+	int nAltName=(altNames!=NULL)?sk_GENERAL_NAME_num(altNames):0;
+	const ASN1_STRING* commonName=getCommonNameString(cert);
+	size_t nameLength=0;
+	for(int ix=0;ix<nAltName;ix++){
+		const GENERAL_NAME* altName=sk_GENERAL_NAME_value(altNames, ix);
+		if(altName->type==GEN_DNS && isUsableName(altName->d.dNSName)){
+			nameLength+=ASN1_STRING_length(altName->d.dNSName)+1;
+		}
+	}
+	if(commonName!=NULL && isUsableName(commonName)){
+		nameLength+=ASN1_STRING_length(commonName)+1;
+	}
+
+	certSummary_t* summary=malloc(sizeof(*summary)+nameLength);
+	if(summary==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_SUMMARY_MALLOC_FAIL);
+	}
+	summary->nName=0;
+	summary->nameLength=0;
+	for(int ix=0;ix<=nAltName;ix++){
+		const ASN1_STRING* name=commonName;
+		if(ix<nAltName){
+			const GENERAL_NAME* altName=sk_GENERAL_NAME_value(altNames, ix);
+			name=(altName->type==GEN_DNS)?altName->d.dNSName:NULL;
+		}
+		if(name==NULL || !isUsableName(name)){
+			continue;
+		}
+		memcpy(summary->name+summary->nameLength, ASN1_STRING_get0_data(name),
+				ASN1_STRING_length(name));
+		summary->nameLength+=ASN1_STRING_length(name);
+		summary->name[summary->nameLength++]='\0';
+		summary->nName++;
+	}
+	GENERAL_NAMES_free(altNames);
+
+	summary->notBefore=timeToEpoch(X509_get0_notBefore(cert), INT64_MAX);
+	summary->notAfter=timeToEpoch(X509_get0_notAfter(cert), INT64_MIN);
+	/* Borrowed from the certificate. OpenSSL 3 decodes the key as it parses
+	 * the SubjectPublicKeyInfo, so reading the size from the SPKI ourselves
+	 * would save nothing. */
+	const EVP_PKEY* key=X509_get0_pubkey(cert);
+	summary->keyAlgorithm=getKeyAlgorithm(key);
+	summary->keyBits=(summary->keyAlgorithm!=KEY_UNKNOWN)?EVP_PKEY_get_bits(key):0;
+	summary->ca=ca;
+	summary->extendedKeyUsage=extendedKeyUsage;
+
+	/* Identifies the content for caches outliving the file, such as a result cache */
+	unsigned int digestLength=0;
+	summary->hasDigest=X509_digest(cert, EVP_sha256(), summary->digest, &digestLength);
+	if(!summary->hasDigest){
+		ERR_clear_error();
+	}
+	return(summary);
+}
+
+void delete_certSummary(certSummary_t* summary) {
+	free(summary);
+}
+
+size_t footprint_certSummary(const certSummary_t* summary) {
+	/**
+	 * Return the bytes held by <summary>
+	 */
+	return(sizeof(*summary)+summary->nameLength);
+}
+
+const char* nextName_certSummary(const certSummary_t* summary, const char* previous) {
+	/**
+	 * Iterate the names of <summary>
+	 *
+	 * ARGS:
+	 * 	previous - name returned by the last call, NULL to start
+	 *
+	 * RETN:
+	 * 	The next name, NULL once all have been returned
+	 */
+	const char* next=(previous==NULL)?summary->name:previous+strlen(previous)+1;
+	if(next>=summary->name+summary->nameLength){
+		return(NULL);
+	}
+	return(next);
+}
+
+uint32_t extendedKeyUsageOf(const char* usage) {
+	/**
+	 * Return the EKU_* bit of <usage>, named as OpenSSL names it in short
+	 * ("serverAuth") or long ("TLS Web Server Authentication") form, or as
+	 * a dotted OID
+	 *
+	 * RETN:
+	 * 	The bit, 0 if <usage> is not an extended key usage with a bit
+	 */
+	for(int ix=0;ix<N_EKU_NAME;ix++){
+		int nid=ekuName[ix].nid;
+		if(strcmp(ekuName[ix].oid, usage)==0
+				|| (nid!=NID_undef && (strcasecmp(OBJ_nid2ln(nid), usage)==0
+				|| strcasecmp(OBJ_nid2sn(nid), usage)==0))){
+			return(ekuName[ix].bit);
+		}
+	}
+
+	/* Aliases OpenSSL knows */
+	ASN1_OBJECT* object=OBJ_txt2obj(usage, 0);
+	if(object==NULL){
+		return(0);
+	}
+	uint32_t bit=extendedKeyUsageBit(object);
+	ASN1_OBJECT_free(object);
+	return((bit==EKU_OTHER)?0:bit);
+}
+
+static int64_t timeToEpoch(const ASN1_TIME* t, int64_t fallback) {
+	/**
+	 * Return <t> in seconds since the epoch, <fallback> if it is malformed.
+	 * Fallbacks are chosen so that a malformed period is never current.
+	 */
+	struct tm broken;
+	if(t==NULL || !ASN1_TIME_to_tm(t, &broken)){
+		return(fallback);
+	}
+	return((int64_t)timegm(&broken));
+}
+
+static uint32_t extendedKeyUsageBit(const ASN1_OBJECT* usage) {
+	/**
+	 * Return the EKU_* bit of <usage>, by NID or failing that by OID
+	 *
+	 * RETN:
+	 * 	The bit, EKU_OTHER for usages without one
+	 */
+	int nid=OBJ_obj2nid(usage);
+	if(nid!=NID_undef){
+		for(int ix=0;ix<N_EKU_NAME;ix++){
+			if(ekuName[ix].nid==nid){
+				return(ekuName[ix].bit);
+			}
+		}
+	}
+
+	char oid[OID_BUFFER_LEN];
+	if(OBJ_obj2txt(oid, sizeof(oid), usage, 1)>0){
+		for(int ix=0;ix<N_EKU_NAME;ix++){
+			if(strcmp(ekuName[ix].oid, oid)==0){
+				return(ekuName[ix].bit);
+			}
+		}
+	}
+	return(EKU_OTHER);
+}
+
+static const ASN1_STRING* getCommonNameString(X509* cert) {
+	/**
+	 * Return the first subject common name of <cert>, owned by <cert>. NULL if none.
+	 */
+	X509_NAME* subject=X509_get_subject_name(cert);
+	int cnIndex=X509_NAME_get_index_by_NID(subject, NID_commonName, -1);
+	if(cnIndex<0){
+		return(NULL);
+	}
+	return(X509_NAME_ENTRY_get_data(X509_NAME_get_entry(subject, cnIndex)));
+}
+
+static int isUsableName(const ASN1_STRING* name) {
+	return(memchr(ASN1_STRING_get0_data(name), '\0', ASN1_STRING_length(name))==NULL);
+}
+
+static keyAlgorithm_t getKeyAlgorithm(const EVP_PKEY* key) {
+	/**
+	 * Return the algorithm of <key>, KEY_UNKNOWN for one without a minimum
+	 * strength or if <key> is NULL
+	 */
+	if(key==NULL){
+		return(KEY_UNKNOWN);
+	}
+	switch(EVP_PKEY_get_base_id(key)){
+	case EVP_PKEY_RSA:
+	case EVP_PKEY_RSA_PSS:
+		return(KEY_RSA);
+	case EVP_PKEY_EC:
+		return(KEY_EC);
+	case EVP_PKEY_ED25519:
+	case EVP_PKEY_ED448:
+		return(KEY_EDDSA);
+	default:
+		return(KEY_UNKNOWN);
+	}
+}
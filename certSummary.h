@@ -0,0 +1,70 @@
+/*
+ * certSummary.h
+ *
+ * Summary of the fields the checks need from a certificate, see certSummary.c.
+ */
+
+#ifndef CERTSUMMARY_H_
+#define CERTSUMMARY_H_
+
+#include <openssl/opensslv.h>
+#include <openssl/x509.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Keys are sized with EVP_PKEY_get_bits and times read with ASN1_TIME_to_tm */
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+#error "certcheck requires OpenSSL 3.0 or later"
+#endif
+
+/* Extended key usages, as bits of certSummary_t.extendedKeyUsage */
+#define EKU_SERVER_AUTH		(1u<<0)
+#define EKU_CLIENT_AUTH		(1u<<1)
+#define EKU_CODE_SIGNING	(1u<<2)
+#define EKU_EMAIL_PROTECTION	(1u<<3)
+#define EKU_TIME_STAMPING	(1u<<4)
+#define EKU_OCSP_SIGNING	(1u<<5)
+#define EKU_ANY			(1u<<6)
+#define EKU_IPSEC_IKE		(1u<<7)
+#define EKU_MS_SGC		(1u<<8)
+#define EKU_NS_SGC		(1u<<9)
+#define EKU_OTHER		(1u<<31)	/* Some usage not listed above */
+
+#define CERT_DIGEST_LENGTH 32	/* SHA-256 */
+
+/* Algorithms of subject keys, as certSummary_t.keyAlgorithm. Key strength is
+ * judged against a minimum for each. */
+typedef enum key_algorithm keyAlgorithm_t;
+enum key_algorithm {
+	KEY_RSA,			/* Bits of the modulus */
+	KEY_EC,				/* Bits of the curve order, 256 for P-256 */
+	KEY_EDDSA,			/* 256 for Ed25519, 456 for Ed448 */
+	KEY_ALGORITHM_COUNT,
+	KEY_UNKNOWN=-1		/* Any other algorithm, or an unreadable key */
+};
+
+/* Everything the checks need from a certificate, decoded in one pass over its
+ * extensions into a single allocation */
+typedef struct cert_summary certSummary_t;
+struct cert_summary {
+	int64_t notBefore;		/* Validity period, seconds since the epoch */
+	int64_t notAfter;
+	keyAlgorithm_t keyAlgorithm;
+	int keyBits;			/* Size of the key, in the units of its algorithm */
+	int ca;				/* Basic constraints CA:TRUE */
+	uint32_t extendedKeyUsage;	/* EKU_* bits of the usages listed, 0 without the extension */
+	int hasDigest;
+	unsigned char digest[CERT_DIGEST_LENGTH];	/* Of the DER encoding, if <hasDigest> */
+	int nName;
+	size_t nameLength;		/* Bytes of <name> in use */
+	char name[];			/* SAN DNS names then common name, each null terminated */
+};
+
+certSummary_t* create_certSummary(X509* cert);
+void delete_certSummary(certSummary_t* summary);
+size_t footprint_certSummary(const certSummary_t* summary);
+const char* nextName_certSummary(const certSummary_t* summary, const char* previous);
+uint32_t extendedKeyUsageOf(const char* usage);
+
+#endif /* CERTSUMMARY_H_ */
@@ -4,384 +4,532 @@
  *  Created on: 13 May 2018
  *      Author: Ben Tomlin
  *   Student #: 834198
+ *
+ * The certcheck command, validating the rows of an input file or serving
+ * validation on a socket with libcertcheck.
  */
 #include "certVerifier.h"
-#include "regexTool.h"
+#include "certCheck.h"
+#include "certServer.h"
 #include "logger.h"
 #include "csvTool.h"
-#include "dataStructure.h" // Provides dsa_t - "dynamic string array".
+#include "hashTool.h"
+#include "pipeline.h"
+#include "timing.h"
 
-#include <openssl/x509.h>
-#include <openssl/x509v3.h>
-#include <openssl/bio.h>
-#include <openssl/pem.h>
 #include <openssl/err.h>
 #include <openssl/evp.h>
 
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <regex.h>
 #include <time.h>
+#include <unistd.h>
 
-
-/* A wildcard is any contiguous sequence of WILDCARD not located after a literal '.'*/
-#define WILDCARD "*"
-#define WILDCARD_MATCHER "[^.]*[" WILDCARD "]+"
-#define WILDCARD_MATCHES "[A-Za-z0-9-]+"
-
-#define DN_MATCH 10239
-#define DN_NOMATCH 2398
-
-#define BITS_PER_BYTE 8
 #define OUTPUT_FILENAME "output.csv"
-#define MIN_ALLOWABLE_KEYLENGTH 2048
-
-/* Maximum Possible length of text usage identifiers - 1 */
-#define CERT_USAGE_BUFFER_LEN 512
-
-
-X509* loadCertificate(char* path);
-int verifyDomainName(dsa_t* a, const char* domain);
-char* convertWildcardExpressionToRegex(const char* wString);
-char* getASNString(const ASN1_STRING* s);
-int verifyTimeValidity(const X509* cert);
-void programExit(char* m, int status);
-int getPublicKeyLength(const X509* cert);
-char* getCommonName(const X509* cert);
-dsa_t* getSubjectAlternativeName(const X509* cert);
-BASIC_CONSTRAINTS* getBasicConstraints(const X509* cert);
-EXTENDED_KEY_USAGE* getExtendedKeyUsage(const X509* cert);
-int validateCertificate(const char* cPath, const char* domain, dsa_t* requiredKeyUsage);
-int verifyExtendedKeyUsage(const X509* cert, dsa_t* requiredKeyUsage);
+#define SHARD_OUTPUT_FILENAME "output-shard%d.csv"
+#define BYTES_PER_KIB 1024
+
+/* Long options without a short form */
+#define OPTION_SHARD 256
+#define OPTION_PREFETCH 257
+#define OPTION_PREFETCH_MIB 258
+#define OPTION_PREFETCH_THREADS 259
+
+/* Rows in flight between the reader and writer, per validation worker */
+#define PIPELINE_WINDOW_PER_WORKER 64
+
+static pthread_mutex_t programExitLock=PTHREAD_MUTEX_INITIALIZER;
+
+void printUsage(const char* program);
+void printRunStatistics(const checkContext_t* context, uint64_t elapsed);
+void* readJob(void* run);
+void processJob(void* run, void* job);
+void writeJob(void* run, void* job);
+void initRowJob(rowJob_t* job);
+void freeRowJob(rowJob_t* job);
+void writeOutputRow(checkRun_t* run, const rowJob_t* job);
+int parseShard(const char* spec, int* shard, int* nShard);
+int inShard(const checkRun_t* run, const csvRowView_t* row);
+void prefetchAhead(checkRun_t* run, long number);
 
 int main(int argc, char** argv) {
 
 	/* Initialize*/
-	OpenSSL_add_all_algorithms();
-	ERR_load_BIO_strings();
-	ERR_load_crypto_strings();
-	OPENSSL_config(NULL); // Deprecated but in place for bcompat
-
-	int certificateValid;
-	dsa_t* row;
-
-	FILE* csv = fopen(argv[1],"r");
-	FILE* outputCsv = fopen(OUTPUT_FILENAME, "w");
-
-	/* Define usage requirements of certificates being validated. */
-	dsa_t* usageRequirement = create_dsa();
-	appendto_dsa(usageRequirement, "TLS Web Server Authentication");
-
-	/* Iterate over certificates of CSV file */
-	while((row=readRow(csv))!=NULL) {
+	initCertCheck();
+
+	int option;
+	int nWorker=0;
+	rowJob_t job;
+	size_t flushAt=CSV_WRITER_DEFAULT_CAPACITY;
+	const char* outputPath=NULL;
+	const char* recordsPath=NULL;
+	char shardOutputPath[sizeof(SHARD_OUTPUT_FILENAME)+16];
+	const char* socketPath=NULL;
+	long rowNumber=0;
+	scenario_t times[MAX_SCENARIO]={ { .time=0, .relative=1 } };
+	policy_t policies[MAX_SCENARIO]={ DEFAULT_POLICY };
+	checkOptions_t options;
+	checkRun_t run;
+	static const struct option longOptions[]={
+		{ "shard", required_argument, NULL, OPTION_SHARD },
+		{ "prefetch", required_argument, NULL, OPTION_PREFETCH },
+		{ "prefetch-mib", required_argument, NULL, OPTION_PREFETCH_MIB },
+		{ "prefetch-threads", required_argument, NULL, OPTION_PREFETCH_THREADS },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	defaultCheckOptions(&options);
+	run.shard=run.nShard=0;
+	run.lookahead=0;
+	options.time=times;
+	options.policy=policies;
+
+	/* Parse options */
+	while((option=getopt_long(argc, argv, "Ab:C:c:D:f:j:M:m:o:P:RST:t:", longOptions, NULL))!=-1){
+		switch(option){
+		case OPTION_SHARD:
+			if(parseShard(optarg, &run.shard, &run.nShard)!=0){
+				printUsage(argv[0]);
+				exit(EXIT_USAGE);
+			}
+			break;
+		case OPTION_PREFETCH:
+			run.lookahead=atoi(optarg);
+			if(run.lookahead<1){
+				printUsage(argv[0]);
+				exit(EXIT_USAGE);
+			}
+			break;
+		case OPTION_PREFETCH_MIB:
+			options.prefetchCap=((size_t)strtoul(optarg, NULL, 10))*BYTES_PER_MIB;
+			break;
+		case OPTION_PREFETCH_THREADS:
+			options.prefetchThreads=atoi(optarg);
+			if(options.prefetchThreads<1){
+				printUsage(argv[0]);
+				exit(EXIT_USAGE);
+			}
+			break;
+		case 'A':
+			options.adaptivePlan=1;
+			break;
+		case 'b':
+			/* Records name every check failed, so none stop the others */
+			recordsPath=optarg;
+			options.evaluateAll=1;
+			break;
+		case 'C':
+			options.resultCachePath=optarg;
+			break;
+		case 'c':
+			options.trustStorePath=optarg;
+			break;
+		case 'D':
+			socketPath=optarg;
+			break;
+		case 'f':
+			flushAt=((size_t)strtoul(optarg, NULL, 10))*BYTES_PER_KIB;
+			break;
+		case 'j':
+			nWorker=atoi(optarg);
+			if(nWorker<1){
+				printUsage(argv[0]);
+				exit(EXIT_USAGE);
+			}
+			break;
+		case 'M':
+			options.rowMemoCap=((size_t)strtoul(optarg, NULL, 10))*BYTES_PER_MIB;
+			break;
+		case 'm':
+			options.cacheCap=((size_t)strtoul(optarg, NULL, 10))*BYTES_PER_MIB;
+			break;
+		case 'o':
+			outputPath=optarg;
+			break;
+		case 'P':
+			options.nPolicy=parsePolicies(optarg, policies, MAX_SCENARIO);
+			if(options.nPolicy<1){
+				printUsage(argv[0]);
+				exit(EXIT_USAGE);
+			}
+			break;
+		case 't':
+			options.nTime=parseScenarioTimes(optarg, times, MAX_SCENARIO);
+			if(options.nTime<1){
+				printUsage(argv[0]);
+				exit(EXIT_USAGE);
+			}
+			break;
+		case 'R':
+			/* Reference regex matcher, for differential testing */
+			options.regexMatcher=1;
+			break;
+		case 'S':
+			options.reportStatistics=1;
+			break;
+		case 'T':
+			/* Slow row threshold, in microseconds */
+			options.slowRowThreshold=strtoull(optarg, NULL, 10)*1000;
+			if(options.slowRowThreshold==0){
+				printUsage(argv[0]);
+				exit(EXIT_USAGE);
+			}
+			break;
+		default:
+			printUsage(argv[0]);
+			exit(EXIT_USAGE);
+		}
+	}
+	/* A server takes its rows from the socket rather than an input file */
+	if(optind!=argc-(socketPath==NULL)
+			|| (socketPath!=NULL && (run.nShard>0 || recordsPath!=NULL))){
+		printUsage(argv[0]);
+		exit(EXIT_USAGE);
+	}
+	/* A server runs for longer than its certificate files stay unchanged */
+	if(socketPath!=NULL){
+		options.rowMemoCap=0;
+		run.lookahead=0;
+	}
+	/* Files are held from the row read ahead until that row is written,
+	 * past the rows in flight on the workers */
+	if(run.lookahead>0){
+		options.prefetchDepth=run.lookahead+1+((nWorker>0)?nWorker*PIPELINE_WINDOW_PER_WORKER:0);
+	}
+	if(options.nTime*options.nPolicy>MAX_SCENARIO){
+		printUsage(argv[0]);
+		exit(EXIT_USAGE);
+	}
+	/* Options are valid, so failing here is a file named by them */
+	checkContext_t* context=create_checkContext(&options);
+	if(context==NULL){
+		programExit("Failed to create check context", EXIT_INPUT_FAIL);
+	}
 
-		char* certificateValidString=malloc(sizeof(char)*2); // null and 1|0 char
+	run.context=context;
+	run.input=NULL;
+	run.output=NULL;
+	run.records=NULL;
+	run.freeJob=NULL;
+	run.nRowRead=0;
+	pthread_mutex_init(&run.jobLock, NULL);
+	if(outputPath==NULL && run.nShard>0){
+		snprintf(shardOutputPath, sizeof(shardOutputPath), SHARD_OUTPUT_FILENAME, run.shard+1);
+		outputPath=shardOutputPath;
+	} else if(outputPath==NULL){
+		outputPath=OUTPUT_FILENAME;
+	}
+	if(socketPath==NULL){
+		run.input = openCsvMap(argv[optind]);
+		if(run.input==NULL){
+			programExit("Failed to read input", EXIT_INPUT_FAIL);
+		}
+		run.output = openCsvWriter(outputPath, flushAt);
+		if(run.output==NULL){
+			programExit("Failed to open output", EXIT_OUTPUT_FAIL);
+		}
+		run.ahead=*run.input;
+		run.nRowAhead=0;
+		if(recordsPath!=NULL){
+			run.records=openResultRecordWriter(recordsPath, context->nScenario, (int64_t)time(NULL));
+			if(run.records==NULL){
+				programExit("Failed to open records", EXIT_OUTPUT_FAIL);
+			}
+		}
+	}
+	initRowView(&run.aheadRow);
+	uint64_t startTime=nowNanoseconds();
 
-		/*Extract certificate validation parameters */
-		const char* certificatePath=getItem_dsa(row,0);
-		const char* domain=getItem_dsa(row,1);
+	if(socketPath!=NULL){
+		/* Serve until stopped, each connection on its own thread */
+		if(runCertServer(context, socketPath)!=0){
+			programExit("Failed to listen on socket", EXIT_SERVER_FAIL);
+		}
 
-		/*Validate*/
-		certificateValid=validateCertificate(certificatePath, domain, usageRequirement);
-		snprintf(certificateValidString, ((size_t)2), "%d", certificateValid);
+	} else if(nWorker>0){
+		/* Validate on a pool of workers, output remains in input order */
+		if(runPipeline(nWorker, nWorker*PIPELINE_WINDOW_PER_WORKER,
+				readJob, processJob, writeJob, &run)!=0){
+			programExit("Failed to start validation threads", EXIT_THREAD_FAIL);
+		}
 
-		/*Mutate input row to output row form and write out */
-		appendto_dsa(row, certificateValidString);
-		writeRow(outputCsv, row);
-		delete_dsa(row); /* Frees all allocated strings also */
+	} else {
+		/* Iterate over certificates of CSV file, one job is reused throughout */
+		initRowJob(&job);
+		while(readRowView(run.input, &job.row)) {
+			job.number=++rowNumber;
+			prefetchAhead(&run, job.number);
+			/* Rows of other shards are numbered and passed over */
+			if(inShard(&run, &job.row)){
+				processJob(&run, &job);
+				writeOutputRow(&run, &job);
+			}
+		}
+		freeRowJob(&job);
 	}
 
 	/* Cleanup */
-	fclose(csv);
-	fclose(outputCsv);
-	delete_dsa(usageRequirement);
+	while(run.freeJob!=NULL){
+		rowJob_t* job=run.freeJob;
+		run.freeJob=job->next;
+		freeRowJob(job);
+		free(job);
+	}
+	freeRowView(&run.aheadRow);
+	pthread_mutex_destroy(&run.jobLock);
+	releaseRowArena();
+	closeCsvMap(run.input);
+	if(run.output!=NULL && closeCsvWriter(run.output)!=0){
+		programExit("Failed to write output", EXIT_OUTPUT_FAIL);
+	}
+	if(closeResultRecordWriter(run.records)!=0){
+		programExit("Failed to write records", EXIT_OUTPUT_FAIL);
+	}
+	if(context->rowLatency!=NULL){
+		printRunStatistics(context, nowNanoseconds()-startTime);
+	}
+#ifdef CERTCHECK_TIMING
+	printStageStatistics();
+#endif
+	delete_checkContext(context);
 	EVP_cleanup();
 	CRYPTO_cleanup_all_ex_data();
 	ERR_free_strings();
 	return(0);
 }
 
-int validateCertificate(const char* cPath, const char* domain, dsa_t* requiredKeyUsage) {
+void printRunStatistics(const checkContext_t* context, uint64_t elapsed) {
 	/**
-	 * Validate certificate at <cPath> for <domain>
-	 *
-	 * A certificate is valid if,
-	 * 		*) It is valid for current time.
-	 * 		*) PKey for certificale has length >=2048bit
-	 * 		*) Basic Constraints show CA:False
-	 * 		*) Extended usage shows TLS Web Server Authentication
+	 * Report throughput, row latency and memory of the run to stderr
 	 *
 	 * ARGS:
-	 * 		cPath - path to certificate to check
-	 * 		domain - domain name against which to check certificate
-	 *
-	 * RETN:
-	 * 		1 - Certificate valid for <domain>
-	 * 		0 - Certificate invalid
-	 *
-	 * ASSN:
-	 * 		All certificates have subject RSA keys
+	 * 	elapsed - wall time of the run in nanoseconds
 	 */
-
-	const X509* cert = loadCertificate(cPath);
-
-	/* Extract domain names */
-	dsa_t* altName = getSubjectAlternativeName(cert);
-	char* dName = getCommonName(cert);
-	appendto_dsa(altName, dName);
-	free(dName);
-
-	/* Inspect certificate */
-	int dateValid=(verifyTimeValidity(cert)==CT_VALID);
-	int keyLength=getPublicKeyLength(cert);
-	int keyLengthValid=(keyLength>=MIN_ALLOWABLE_KEYLENGTH);
-	int domainValid = verifyDomainName(altName, domain);
-	BASIC_CONSTRAINTS* certificateBasicConstraints = getBasicConstraints(cert);
-	int basicConstraintCA = certificateBasicConstraints->ca;
-	int usageValid = verifyExtendedKeyUsage(cert, requiredKeyUsage);
-
-	/* Check validity */
-	int certValid = dateValid \
-			&& keyLengthValid
-			&& (domainValid==DN_MATCH)
-			&& !basicConstraintCA
-			&& usageValid;
-
-	return(certValid);
+	const latencyHistogram_t* latency=context->rowLatency;
+	double seconds=(double)elapsed/NANOSECONDS_PER_SECOND;
+
+	fprintf(stderr, "rows: %lu in %.3fs, %.0f rows/sec\n", (unsigned long)latency->total,
+			seconds, (seconds>0)?latency->total/seconds:0.0);
+	fprintf(stderr, "row latency: p50 %.1fus p99 %.1fus max %.1fus mean %.1fus\n",
+			percentileLatency(latency, 50)/1000.0, percentileLatency(latency, 99)/1000.0,
+			latency->max/1000.0, (latency->total>0)?latency->sum/1000.0/latency->total:0.0);
+	fprintf(stderr, "certificate cache: %ld hits %ld misses\n",
+			context->cache->hit, context->cache->miss);
+	if(context->results!=NULL){
+		fprintf(stderr, "result cache: %ld hits %ld misses\n",
+				context->results->hit, context->results->miss);
+	}
+	if(context->memo!=NULL){
+		long nRow=context->memo->hit+context->memo->miss;
+		fprintf(stderr, "row memo: %ld hits %ld misses, %.1f%% hit, %ld resets\n",
+				context->memo->hit, context->memo->miss,
+				(nRow>0)?100.0*context->memo->hit/nRow:0.0, context->memo->nReset);
+	}
+	if(context->prefetch!=NULL){
+		fprintf(stderr, "prefetch: %ld files read ahead, %ld used, %ld waited on, %ld requests dropped\n",
+				context->prefetch->nRead, context->prefetch->nTaken, context->prefetch->nWaited,
+				context->prefetch->nDropped);
+	}
+	if(context->trust!=NULL){
+		fprintf(stderr, "chain: %d CAs, %ld signatures verified, %ld issuers reused\n",
+				context->trust->nEntry, context->trust->nSignature, context->trust->nIssuerReused);
+	}
+	fprintf(stderr, "peak rss: %ld KiB\n", peakResidentKiB());
+	printCheckPlanStatistics(&context->plan);
 }
 
-X509* loadCertificate(char* path){
+void* readJob(void* run) {
 	/**
-	 * load certificate at <path>
+	 * Pipeline read stage, wrap the next input row as a job
+	 *
+	 * Jobs are taken from those already written where possible, so their
+	 * cell arrays are reused.
 	 */
+	checkRun_t* checkRun=run;
 
-	X509* cert = NULL;
-	BIO* cBio = BIO_new(BIO_s_file());
-
-	if (!(BIO_read_filename(cBio, path))){
-		programExit("Failed to read certificate", EXIT_CERTLOAD_FAIL);
+	pthread_mutex_lock(&checkRun->jobLock);
+	rowJob_t* job=checkRun->freeJob;
+	if(job!=NULL){
+		checkRun->freeJob=job->next;
 	}
+	pthread_mutex_unlock(&checkRun->jobLock);
 
-	if (!(cert = PEM_read_bio_X509(cBio, NULL, 0 ,NULL))) {
-		programExit("Failed to read certificate", EXIT_CERTLOAD_FAIL);
+	if(job==NULL){
+		job=malloc(sizeof(*job));
+		if(job==NULL){
+			programExit("Malloc failed to allocate memory. Program terminating", EXIT_THREAD_FAIL);
+		}
+		initRowJob(job);
 	}
 
-	BIO_free(cBio);
-	return cert;
-}
-
-dsa_t* getSubjectAlternativeName(const X509* cert) {
-
-	dsa_t* a=create_dsa();
-
-	/* Check for subject alternative name - data for san is a sequence
-	 * of general names. (4.2.1.6 RFC5280) A sequence is represented internally in
-	 * openssl as a STACK_OF(<seq_type>). We convert the serialized data to internal rep here. */
-    STACK_OF(GENERAL_NAME)* saName = X509_get_ext_d2i(cert, NID_subject_alt_name, NULL, NULL);
-    GENERAL_NAME* altName;
-
-    while((altName=sk_GENERAL_NAME_pop(saName))!=NULL){
-    	unsigned char* buffer;
-    	/* Write any domain names (decoded from ia5string) into the dynamic string array */
-    	if(altName->type==GEN_DNS){
-			ASN1_STRING_to_UTF8(&buffer, altName->d.dNSName);
-    		writeto_dsa(a, (char*)buffer, a->length);
-    		free(buffer);
-    	}
-    }
-    return(a);
-
-}
-
-EXTENDED_KEY_USAGE* getExtendedKeyUsage(const X509* cert) {
-	return((EXTENDED_KEY_USAGE*)X509_get_ext_d2i(cert, NID_ext_key_usage, NULL, NULL));
+	/* Rows of other shards are numbered and passed over */
+	do{
+		if(!readRowView(checkRun->input, &job->row)){
+			freeRowJob(job);
+			free(job);
+			return(NULL);
+		}
+		job->number=++checkRun->nRowRead;
+		prefetchAhead(checkRun, job->number);
+	} while(!inShard(checkRun, &job->row));
+	job->result=0;
+	return(job);
 }
 
-int verifyExtendedKeyUsage(const X509* cert, dsa_t* usageRequired){
+void processJob(void* run, void* job) {
 	/**
-	 * Check <cert> is valid for <usageRequired>
-	 *
-	 * ARGS:
-	 * 	cert - Certificate to check
-	 * 	usageRequired - List of text usage identifiers to check
-	 *
-	 * RETN:
-	 * 	1 - indicate cert is valid for all given usages. Otherwise 0
+	 * Pipeline worker stage, validate a job's row, keeping the outcome of
+	 * each domain if the run writes records
 	 */
-
-	EXTENDED_KEY_USAGE* certUsages = getExtendedKeyUsage(cert);
-	const char* requiredUsageIdentifier;
-	char certUsageIdBuffer[CERT_USAGE_BUFFER_LEN];
-	int nCertUsage = sk_ASN1_OBJECT_num(certUsages);
-
-	int hasCurrentRequiredUsage=0;
-
-	/* Check each required usage is covered by the certificate */
-	for(int ix=0;ix<(usageRequired->length);ix++){
-
-		requiredUsageIdentifier=getItem_dsa(usageRequired, ix);
-
-		/* Search for required usage in certificate usages */
-		for(int ux=0;ux<nCertUsage;ux++){
-
-			/* Extract certificate usage */
-			const ASN1_OBJECT* certUsageItem = sk_ASN1_OBJECT_value(certUsages, ux);
-			i2t_ASN1_OBJECT(certUsageIdBuffer, CERT_USAGE_BUFFER_LEN, certUsageItem);
-
-			/* Check against usage needed */
-			if (strcasecmp(certUsageIdBuffer, requiredUsageIdentifier)==0) {
-				hasCurrentRequiredUsage=1;
-				break;
-			}
-		}
-		/* Search failed */
-		if(!hasCurrentRequiredUsage){
-			return(0);
+	checkRun_t* checkRun=run;
+	rowJob_t* rowJob=job;
+
+	rowJob->nDomain=rowJob->row.length-1;
+	int nOutcome=(rowJob->nDomain>0)?rowJob->nDomain:1;
+	if(checkRun->records!=NULL && nOutcome>rowJob->nOutcomeSlot){
+		domainOutcome_t* outcome=realloc(rowJob->outcome, sizeof(domainOutcome_t)*nOutcome);
+		if(outcome==NULL){
+			programExit("Malloc failed to allocate memory. Program terminating", EXIT_MALLOC_FAIL);
 		}
+		rowJob->outcome=outcome;
+		rowJob->nOutcomeSlot=nOutcome;
 	}
-	return(1);
+	rowJob->result=checkRowTimed(checkRun->context, &rowJob->row, rowJob->number,
+			rowJob->outcome);
 }
 
-BASIC_CONSTRAINTS* getBasicConstraints(const X509* cert) {
-	return((BASIC_CONSTRAINTS*)X509_get_ext_d2i(cert, NID_basic_constraints, NULL, NULL));
+void writeJob(void* run, void* job) {
+	/**
+	 * Pipeline write stage. Rows arrive in input order, so a load failure
+	 * terminates after exactly the rows a sequential run would have written.
+	 */
+	checkRun_t* checkRun=run;
+	rowJob_t* rowJob=job;
+	writeOutputRow(checkRun, rowJob);
+
+	pthread_mutex_lock(&checkRun->jobLock);
+	rowJob->next=checkRun->freeJob;
+	checkRun->freeJob=rowJob;
+	pthread_mutex_unlock(&checkRun->jobLock);
 }
 
-char* getCommonName(const X509* cert) {
+void writeOutputRow(checkRun_t* run, const rowJob_t* job) {
 	/**
-	 * Return the common name for a certificate. Null if none.
+	 * Write the output row of a checked <job>, and its records if the run
+	 * writes them. A shard's rows lead with their number in the whole input,
+	 * for certcheck-merge.
+	 *
+	 * A load failure terminates the program, after writing out the rows
+	 * before it and a record of the failure.
 	 */
-
-	int lastpos=-1;
-	int cnIndex;
-
-	/* If the certificate has no subject Common Name it's invalid */
-	X509_NAME* subject = X509_get_subject_name(cert);
-	if ((cnIndex = X509_NAME_get_index_by_NID(subject,NID_commonName,lastpos))<0){
-		return(NULL);
+	if(job->result==CERT_LOAD_ERROR){
+		flushCsvWriter(run->output);
+		if(run->records!=NULL){
+			writeResultRecords(run->records, job->number, NULL, 0);
+			closeResultRecordWriter(run->records);
+		}
+		programExit("Failed to read certificate", EXIT_CERTLOAD_FAIL);
 	}
+	int failed=(run->nShard>0)?writeNumberedRowBuffered(run->output, job->number, &job->row)
+			:writeRowBuffered(run->output, &job->row);
+	if(failed!=0){
+		programExit("Failed to write output", EXIT_OUTPUT_FAIL);
+	}
+	if(run->records!=NULL
+			&& writeResultRecords(run->records, job->number, job->outcome, job->nDomain)!=0){
+		programExit("Failed to write records", EXIT_OUTPUT_FAIL);
+	}
+	retirePrefetch_checkContext(run->context, job->number);
+}
 
-	/* Extract the subject common name */
-	X509_NAME_ENTRY* name=X509_NAME_get_entry(subject, cnIndex); // No need to free
-	ASN1_STRING* cName = X509_NAME_ENTRY_get_data(name);		 //
-	char* commonName = getASNString(cName);
-
-	return(commonName);
+void initRowJob(rowJob_t* job) {
+	initRowView(&job->row);
+	job->outcome=NULL;
+	job->nOutcomeSlot=0;
 }
 
-int verifyDomainName(dsa_t* altNames, const char* domain){
+void freeRowJob(rowJob_t* job) {
 	/**
-	 * Given a list of domain names, check that the given domain matches any one of them.
-	 *
-	 * ARG:
-	 * 	<nameList> - List of names, may contain wildcards
-	 * 	<domain>   - domain to check names against for a match
-	 *
-	 * RETURN:
-	 * 	DN_MATCH - <domain> matches some name in <nameList>
-	 * 	DN_NOMATCH - <domain> does not match some name in <nameList>
+	 * Free what <job> holds, not <job> itself
 	 */
-	char* domainRegex=NULL;
-
-	/* Check if certificate domain names match <domain> */
-	for(int ix=0;ix<(altNames->length);ix++){
-		domainRegex=convertWildcardExpressionToRegex(getItem_dsa(altNames, ix));
-		int matchStatus = isMatch(domainRegex,domain);
-		free(domainRegex);
-		if(matchStatus==MATCH){
-			return(DN_MATCH);
-		}
-	}
-	return(DN_NOMATCH);
+	freeRowView(&job->row);
+	free(job->outcome);
 }
 
-char* convertWildcardExpressionToRegex(const char* wString){
+int parseShard(const char* spec, int* shard, int* nShard) {
 	/**
-	 * Replace any wildcards found in <wString> with an equivalent ERE.
-	 *
-	 * wString must be null terminated. Wildcards are standins for any number
-	 * of chars in WILDCARD_MATCHES (valid domain name chars)
-	 *
-	 * Wildcards can only occur in the leftmost portion of <wString>, where a
-	 * portion is delineated with a '.' (as per WILDCARD_MATCHER)
+	 * Parse a shard <spec> "i/n", the i'th of n shards from 1
 	 *
 	 * RETN:
-	 *	 Return converted expression. Must be free'd
+	 * 	0 with <shard> set from 0 and <nShard>, -1 if <spec> is malformed
 	 */
-	char* buffer;
-	char* result=strdup(wString);
-
-	while((buffer=replaceMatch(WILDCARD_MATCHER, result, WILDCARD_MATCHES))!=NULL){
-		free(result);
-		result=buffer;
+	char* end;
+	long index=strtol(spec, &end, 10);
+	if(end==spec || *end!='/'){
+		return(-1);
 	}
-
-	/* Return a copy of wString if it contains no wildcards. */
-	return(result);
+	const char* count=end+1;
+	long n=strtol(count, &end, 10);
+	if(end==count || *end!='\0' || n<1 || n>MAX_SHARD || index<1 || index>n){
+		return(-1);
+	}
+	*shard=(int)index-1;
+	*nShard=(int)n;
+	return(0);
 }
 
-char* getASNString(const ASN1_STRING* s) {
+int inShard(const checkRun_t* run, const csvRowView_t* row) {
 	/**
-	 * Return null terminated copy of asn1 string
+	 * Whether <row> is one of this run's shard, by the hash of its
+	 * certificate file so the rows of a certificate, or of any certificate
+	 * of a bundle, all fall to one shard whichever machine computes it
 	 */
-	char* str;
-	int needNull=0;
-	int length=ASN1_STRING_length(s);
-
-	/* String is empty*/
-	if (length==0){
-		str=malloc(sizeof(char)*1);
-		str[0]='\0';
-
-	} else {
-		/* Note get0_data result should not be freed as per man page */
-		const char* data=ASN1_STRING_data(s);
-
-		/* Add a null byte if necessary */
-		if(data[length-1]!='\0'){
-			needNull=1;
-		}
-
-		str=malloc(sizeof(char)*(length+needNull));
-		memcpy(str, data, length);
+	if(run->nShard==0){
+		return(1);
+	}
+	const csvCell_t* path=&row->cell[0];
+	size_t length=path->length;
 
-		/* Terminate with a null byte */
-		if (needNull){
-			str[length]='\0';
-		}
+	/* Leave out a bundle index, "#" then digits */
+	size_t ix=length;
+	while(ix>0 && path->data[ix-1]>='0' && path->data[ix-1]<='9'){
+		ix--;
+	}
+	if(ix>0 && ix<length && path->data[ix-1]==CERT_BUNDLE_SEPARATOR){
+		length=ix-1;
 	}
-	return(str);
+	return(hashBytes(path->data, length, HASH_SEED)%run->nShard==(uint64_t)run->shard);
 }
 
-int verifyTimeValidity(const X509* cert){
+void prefetchAhead(checkRun_t* run, long number) {
 	/**
-	 * Given a certificate, verify it's valid for the current time
+	 * Have the certificate files of the rows up to <lookahead> past row
+	 * <number> read ahead, those of other shards left out
 	 */
-
-	int nDayBefore, nSecBefore, nDayAfter, nSecAfter;
-	ASN1_TIME_diff(&nDayBefore, &nSecBefore, X509_get_notBefore(cert), NULL);
-	ASN1_TIME_diff(&nDayAfter, &nSecAfter, NULL, X509_get_notAfter(cert));
-
-	/* Time should be within not before and not after */
-	if(nDayBefore<0 || nSecBefore<0 || nDayAfter<0 || nSecAfter<0){
-		return(CT_INVALID);
+	while(run->nRowAhead<number+run->lookahead && readRowView(&run->ahead, &run->aheadRow)){
+		run->nRowAhead++;
+		if(inShard(run, &run->aheadRow)){
+			prefetch_checkContext(run->context, run->aheadRow.cell[0].data,
+					run->aheadRow.cell[0].length, run->nRowAhead);
+		}
 	}
-
-	/* Current time is within the certificate validity period.*/
-	return(CT_VALID);
 }
 
-int getPublicKeyLength(const X509* cert){
-	EVP_PKEY* evpKey = X509_get_pubkey(cert);
-	RSA* rsaKey = EVP_PKEY_get1_RSA(evpKey);
-	EVP_PKEY_free(evpKey);
-	RSA_free(rsaKey);
-	int size = RSA_size(rsaKey)*BITS_PER_BYTE;
-	/* 1.1 version: return(RSA_bits(EVP_PKEY_get1_RSA(X509_get_pubkey(cert))));*/
-	return(size);
+void printUsage(const char* program) {
+	fprintf(stderr, "usage: %s [-j threads] [-m cacheMiB] [-M memoMiB] [-o output] [-b records] [-f flushKiB] [-t times] [-P policies] [-A] [-R] [-S]\n\t[-T slowRowMicroseconds] [-C resultCache] [-c caPath] [--shard i/n]\n\t[--prefetch rows] [--prefetch-mib MiB] [--prefetch-threads n] input.csv\n       %s -D socket [options]\n",
+			program, program);
 }
 
 void programExit(char* m, int status) {
+	/**
+	 * Log <m> and exit. Safe to call from any thread, the first caller exits
+	 * and any other caller blocks until the process is gone.
+	 */
+	pthread_mutex_lock(&programExitLock);
 	mylog(m);
 	exit(status);
 }
+
@@ -9,12 +9,53 @@
 #ifndef CERTVERIFIER_H_
 #define CERTVERIFIER_H_
 
-#define CN_INVALID 1
-#define CN_VALID 0
+#define EXIT_CERTLOAD_FAIL 34
+#define EXIT_THREAD_FAIL 35
+#define EXIT_INPUT_FAIL 36
+#define EXIT_OUTPUT_FAIL 37
+#define EXIT_SERVER_FAIL 38
+#define EXIT_USAGE 64
+#define EXIT_MALLOC_FAIL 111
 
-#define CT_INVALID 1
-#define CT_VALID 0
+#define BYTES_PER_MIB (1024*1024)
+#define MAX_SHARD 65536
 
-#define EXIT_CERTLOAD_FAIL 34
+#include "certCheck.h"
+#include "csvTool.h"
+#include "resultRecord.h"
+
+#include <pthread.h>
+
+/* A row travelling through the validation pipeline */
+typedef struct row_job rowJob_t;
+struct row_job {
+	csvRowView_t row;
+	long number;		/* Position of the row in the input, from 1 */
+	int result;
+	int nDomain;		/* Of the input row */
+	domainOutcome_t* outcome;	/* Of each domain, NULL unless writing records */
+	int nOutcomeSlot;
+	rowJob_t* next;		/* Link while held for reuse */
+};
+
+/* A run of the command over an input file */
+typedef struct check_run checkRun_t;
+struct check_run {
+	checkContext_t* context;
+	csvMap_t* input;
+	csvWriter_t* output;
+	resultRecordWriter_t* records;	/* NULL unless writing records */
+	rowJob_t* freeJob;		/* Written jobs, reused by the reader */
+	pthread_mutex_t jobLock;
+	long nRowRead;
+	int shard;				/* Rows of this shard only, from 0, if <nShard> */
+	int nShard;				/* 0 for every row */
+	int lookahead;			/* Rows to read certificate files ahead by, 0 for none */
+	csvMap_t ahead;			/* Reads <input> again, <lookahead> rows ahead */
+	csvRowView_t aheadRow;
+	long nRowAhead;
+};
+
+void programExit(char* m, int status);
 
 #endif /* CERTVERIFIER_H_ */
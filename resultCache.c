@@ -0,0 +1,345 @@
+/*
+ * resultCache.c
+ *
+ * Check outcomes kept in a memory mapped file, so unchanged certificates are
+ * not revalidated from run to run. Two open addressing tables share the file:
+ * certificate files, by path and file identity, to the digest of their
+ * content, and (digest, domain, policy) to the outcome of the checks.
+ *
+ * Any number of threads and processes may share a file. Lookups read a slot
+ * between two reads of its sequence number and discard it if a write was in
+ * progress or happened meanwhile, so they take no lock. Writers are serialised
+ * by a mutex within the process and flock on the file across processes.
+ *
+ * Keys whose probe window is full replace the entry in their home slot, so the
+ * file never grows and old entries fall out as new ones arrive.
+ */
+#include "resultCache.h"
+#include "hashTool.h"
+#include "logger.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define RESULT_CACHE_FILE_MODE 0644
+#define DOMAIN_HASH_SEED2 0x9e3779b97f4a7c15ULL
+#define NANOSECONDS_PER_SECOND_INT 1000000000LL
+#define EXIT_RESULT_MALLOC_FAIL 118
+
+static int initResultCacheFile(int fd, resultCacheHeader_t* header);
+static uint64_t fileHome(uint64_t pathHash, const struct stat* fileStat);
+static uint64_t resultHome(const uint64_t* digest, const uint64_t* domainHash, uint64_t policyKey);
+static int64_t mtimeOf(const struct stat* fileStat);
+static void beginWrite(uint32_t* sequence);
+static void endWrite(uint32_t* sequence, uint32_t started);
+static void lockWriters(resultCache_t* cache);
+static void unlockWriters(resultCache_t* cache);
+
+#define LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+
+void digestWords(const unsigned char* digest, uint64_t* words) {
+	/**
+	 * Take the leading RESULT_DIGEST_WORDS words of a certificate <digest>
+	 * as the key kept in the cache
+	 */
+	memcpy(words, digest, sizeof(uint64_t)*RESULT_DIGEST_WORDS);
+}
+
+resultCache_t* openResultCache(const char* path) {
+	/**
+	 * Open the result cache file at <path>, creating it if it does not exist
+	 *
+	 * RETN:
+	 * 	Cache, close with closeResultCache. NULL if <path> cannot be opened
+	 * 	or is not a result cache of this version.
+	 */
+	resultCacheHeader_t header;
+	struct stat fileStat;
+
+	int fd=open(path, O_RDWR|O_CREAT, RESULT_CACHE_FILE_MODE);
+	if(fd<0){
+		return(NULL);
+	}
+
+	/* Hold the file while checking or writing its header */
+	memset(&header, 0, sizeof(header));
+	flock(fd, LOCK_EX);
+	int invalid=(fstat(fd, &fileStat)!=0);
+	if(!invalid && fileStat.st_size==0){
+		invalid=initResultCacheFile(fd, &header);
+	} else if(!invalid){
+		invalid=(pread(fd, &header, sizeof(header), 0)!=sizeof(header));
+	}
+	size_t length=sizeof(header)+header.nFileSlot*sizeof(fileSlot_t)
+			+header.nResultSlot*sizeof(resultSlot_t);
+	invalid=invalid || header.magic!=RESULT_CACHE_MAGIC || header.version!=RESULT_CACHE_VERSION
+			|| (header.nFileSlot&(header.nFileSlot-1))!=0
+			|| (header.nResultSlot&(header.nResultSlot-1))!=0
+			|| fstat(fd, &fileStat)!=0 || (size_t)fileStat.st_size!=length;
+	flock(fd, LOCK_UN);
+	if(invalid){
+		close(fd);
+		return(NULL);
+	}
+
+	void* map=mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if(map==MAP_FAILED){
+		close(fd);
+		return(NULL);
+	}
+
+	resultCache_t* cache=malloc(sizeof(*cache));
+	if(cache==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_RESULT_MALLOC_FAIL);
+	}
+	cache->fd=fd;
+	cache->map=map;
+	cache->length=length;
+	cache->fileSlot=(fileSlot_t*)((char*)map+sizeof(header));
+	cache->resultSlot=(resultSlot_t*)(cache->fileSlot+header.nFileSlot);
+	cache->fileMask=header.nFileSlot-1;
+	cache->resultMask=header.nResultSlot-1;
+	pthread_mutex_init(&cache->writeLock, NULL);
+	cache->hit=0;
+	cache->miss=0;
+	return(cache);
+}
+
+static int initResultCacheFile(int fd, resultCacheHeader_t* header) {
+	/**
+	 * Size the empty file <fd> for the default slot counts and write
+	 * <header>. Slots are left as zeros, which is empty.
+	 *
+	 * RETN:
+	 * 	0, or -1 on failure
+	 */
+	memset(header, 0, sizeof(*header));
+	header->magic=RESULT_CACHE_MAGIC;
+	header->version=RESULT_CACHE_VERSION;
+	header->nFileSlot=RESULT_CACHE_FILE_SLOTS;
+	header->nResultSlot=RESULT_CACHE_RESULT_SLOTS;
+
+	off_t length=sizeof(*header)+header->nFileSlot*sizeof(fileSlot_t)
+			+header->nResultSlot*sizeof(resultSlot_t);
+	if(ftruncate(fd, length)!=0
+			|| pwrite(fd, header, sizeof(*header), 0)!=sizeof(*header)){
+		return(-1);
+	}
+	return(0);
+}
+
+void closeResultCache(resultCache_t* cache) {
+	if(cache==NULL){return;}
+	munmap(cache->map, cache->length);
+	close(cache->fd);
+	pthread_mutex_destroy(&cache->writeLock);
+	free(cache);
+}
+
+int findDigest_resultCache(resultCache_t* cache, const char* path, const struct stat* fileStat,
+		uint64_t* digest) {
+	/**
+	 * Find the digest of the certificate at <path>, whose file has
+	 * <fileStat>, as recorded by recordDigest_resultCache while the file
+	 * was as it is now
+	 *
+	 * RETN:
+	 * 	1 with <digest> set, 0 if not recorded, leaving <digest> as it was
+	 */
+	uint64_t pathHash=hashString(path);
+	uint64_t home=fileHome(pathHash, fileStat);
+	int64_t mtime=mtimeOf(fileStat);
+	uint64_t read[RESULT_DIGEST_WORDS];
+
+	for(int ix=0;ix<RESULT_CACHE_PROBE;ix++){
+		fileSlot_t* slot=&cache->fileSlot[(home+ix)&cache->fileMask];
+		uint32_t sequence=__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if(sequence==0){
+			break;
+		}
+		int match=(sequence&1)==0 && LOAD(slot->pathHash)==pathHash
+				&& LOAD(slot->device)==(uint64_t)fileStat->st_dev
+				&& LOAD(slot->inode)==(uint64_t)fileStat->st_ino
+				&& LOAD(slot->mtime)==mtime && LOAD(slot->size)==fileStat->st_size;
+		for(int wx=0;wx<RESULT_DIGEST_WORDS;wx++){
+			read[wx]=LOAD(slot->digest[wx]);
+		}
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(match && __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED)==sequence){
+			memcpy(digest, read, sizeof(read));
+			return(1);
+		}
+	}
+	return(0);
+}
+
+void recordDigest_resultCache(resultCache_t* cache, const char* path, const struct stat* fileStat,
+		const uint64_t* digest) {
+	/**
+	 * Record <digest> as that of the certificate at <path>, for as long as
+	 * its file has <fileStat>
+	 */
+	uint64_t pathHash=hashString(path);
+	uint64_t home=fileHome(pathHash, fileStat);
+	fileSlot_t* slot=&cache->fileSlot[home&cache->fileMask];
+
+	lockWriters(cache);
+	for(int ix=0;ix<RESULT_CACHE_PROBE;ix++){
+		fileSlot_t* candidate=&cache->fileSlot[(home+ix)&cache->fileMask];
+		if(candidate->sequence==0 || (candidate->pathHash==pathHash
+				&& candidate->device==(uint64_t)fileStat->st_dev
+				&& candidate->inode==(uint64_t)fileStat->st_ino)){
+			slot=candidate;
+			break;
+		}
+	}
+
+	uint32_t started=slot->sequence;
+	beginWrite(&slot->sequence);
+	STORE(slot->pathHash, pathHash);
+	STORE(slot->device, (uint64_t)fileStat->st_dev);
+	STORE(slot->inode, (uint64_t)fileStat->st_ino);
+	STORE(slot->mtime, mtimeOf(fileStat));
+	STORE(slot->size, (int64_t)fileStat->st_size);
+	for(int wx=0;wx<RESULT_DIGEST_WORDS;wx++){
+		STORE(slot->digest[wx], digest[wx]);
+	}
+	endWrite(&slot->sequence, started);
+	unlockWriters(cache);
+}
+
+int lookup_resultCache(resultCache_t* cache, const uint64_t* digest, const char* domain,
+		size_t domainLength, uint64_t policyKey, resultSlot_t* outcome) {
+	/**
+	 * Find the outcome of the certificate with <digest> for the
+	 * <domainLength> chars of <domain> under <policyKey>
+	 *
+	 * RETN:
+	 * 	1 with <outcome> set to a copy of the slot, 0 if there is none
+	 */
+	uint64_t domainHash[2]={
+		hashBytes(domain, domainLength, HASH_SEED),
+		hashBytes(domain, domainLength, DOMAIN_HASH_SEED2)
+	};
+	uint64_t home=resultHome(digest, domainHash, policyKey);
+
+	for(int ix=0;ix<RESULT_CACHE_PROBE;ix++){
+		resultSlot_t* slot=&cache->resultSlot[(home+ix)&cache->resultMask];
+		uint32_t sequence=__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if(sequence==0){
+			break;
+		}
+		int match=(sequence&1)==0 && LOAD(slot->policyKey)==policyKey
+				&& LOAD(slot->domainHash[0])==domainHash[0]
+				&& LOAD(slot->domainHash[1])==domainHash[1];
+		for(int wx=0;wx<RESULT_DIGEST_WORDS;wx++){
+			match=match && LOAD(slot->digest[wx])==digest[wx];
+		}
+		outcome->failed=LOAD(slot->failed);
+		outcome->chainStatus=LOAD(slot->chainStatus);
+		outcome->keyBits=LOAD(slot->keyBits);
+		outcome->notBefore=LOAD(slot->notBefore);
+		outcome->notAfter=LOAD(slot->notAfter);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if(match && __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED)==sequence){
+			__atomic_fetch_add(&cache->hit, 1, __ATOMIC_RELAXED);
+			return(1);
+		}
+	}
+	__atomic_fetch_add(&cache->miss, 1, __ATOMIC_RELAXED);
+	return(0);
+}
+
+void insert_resultCache(resultCache_t* cache, const uint64_t* digest, const char* domain,
+		size_t domainLength, uint64_t policyKey, unsigned failed, int chainStatus,
+		int keyBits, int64_t notBefore, int64_t notAfter) {
+	/**
+	 * Record the outcome of the certificate with <digest> for the
+	 * <domainLength> chars of <domain> under <policyKey>: <failed> checks,
+	 * <chainStatus> and <keyBits>, holding from <notBefore> to <notAfter>
+	 */
+	uint64_t domainHash[2]={
+		hashBytes(domain, domainLength, HASH_SEED),
+		hashBytes(domain, domainLength, DOMAIN_HASH_SEED2)
+	};
+	uint64_t home=resultHome(digest, domainHash, policyKey);
+	resultSlot_t* slot=&cache->resultSlot[home&cache->resultMask];
+
+	lockWriters(cache);
+	for(int ix=0;ix<RESULT_CACHE_PROBE;ix++){
+		resultSlot_t* candidate=&cache->resultSlot[(home+ix)&cache->resultMask];
+		if(candidate->sequence==0 || (candidate->policyKey==policyKey
+				&& candidate->domainHash[0]==domainHash[0]
+				&& candidate->domainHash[1]==domainHash[1]
+				&& memcmp(candidate->digest, digest, sizeof(candidate->digest))==0)){
+			slot=candidate;
+			break;
+		}
+	}
+
+	uint32_t started=slot->sequence;
+	beginWrite(&slot->sequence);
+	STORE(slot->failed, (uint8_t)failed);
+	STORE(slot->chainStatus, (uint8_t)chainStatus);
+	STORE(slot->keyBits, (uint16_t)((keyBits>UINT16_MAX)?UINT16_MAX:keyBits));
+	for(int wx=0;wx<RESULT_DIGEST_WORDS;wx++){
+		STORE(slot->digest[wx], digest[wx]);
+	}
+	STORE(slot->domainHash[0], domainHash[0]);
+	STORE(slot->domainHash[1], domainHash[1]);
+	STORE(slot->policyKey, policyKey);
+	STORE(slot->notBefore, notBefore);
+	STORE(slot->notAfter, notAfter);
+	endWrite(&slot->sequence, started);
+	unlockWriters(cache);
+}
+
+static uint64_t fileHome(uint64_t pathHash, const struct stat* fileStat) {
+	uint64_t key[3]={ pathHash, (uint64_t)fileStat->st_dev, (uint64_t)fileStat->st_ino };
+	return(hashBytes(key, sizeof(key), HASH_SEED));
+}
+
+static uint64_t resultHome(const uint64_t* digest, const uint64_t* domainHash, uint64_t policyKey) {
+	uint64_t key[4]={ digest[0], digest[1], domainHash[0], policyKey };
+	return(hashBytes(key, sizeof(key), HASH_SEED));
+}
+
+static int64_t mtimeOf(const struct stat* fileStat) {
+	return((int64_t)fileStat->st_mtim.tv_sec*NANOSECONDS_PER_SECOND_INT+fileStat->st_mtim.tv_nsec);
+}
+
+static void beginWrite(uint32_t* sequence) {
+	/**
+	 * Mark the slot of <sequence> as being written, before its fields are.
+	 * The sequence is made odd rather than incremented, as a writer that
+	 * died mid write leaves it odd already.
+	 */
+	__atomic_store_n(sequence, *sequence|1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void endWrite(uint32_t* sequence, uint32_t started) {
+	/**
+	 * Publish the slot of <sequence>, whose sequence was <started> before
+	 * beginWrite, at the next even sequence after it. 0 is kept for slots
+	 * never written.
+	 */
+	uint32_t next=(started|1)+1;
+	__atomic_store_n(sequence, (next==0)?2:next, __ATOMIC_RELEASE);
+}
+
+static void lockWriters(resultCache_t* cache) {
+	pthread_mutex_lock(&cache->writeLock);
+	flock(cache->fd, LOCK_EX);
+}
+
+static void unlockWriters(resultCache_t* cache) {
+	flock(cache->fd, LOCK_UN);
+	pthread_mutex_unlock(&cache->writeLock);
+}
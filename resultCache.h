@@ -0,0 +1,96 @@
+/*
+ * resultCache.h
+ *
+ * Check outcomes kept on disk between runs, see resultCache.c.
+ */
+
+#ifndef RESULTCACHE_H_
+#define RESULTCACHE_H_
+
+#include "certSummary.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#define RESULT_CACHE_MAGIC 0x6365727463686b31ULL	/* "certchk1" */
+#define RESULT_CACHE_VERSION 3
+#define RESULT_DIGEST_WORDS 2		/* Of the certificate digest kept, 128 bits */
+#define RESULT_CACHE_FILE_SLOTS (1<<16)
+#define RESULT_CACHE_RESULT_SLOTS (1<<18)
+
+#define RESULT_CACHE_PROBE 8		/* Slots searched from a key's home slot */
+
+/* Start of the cache file, followed by the file then result slots. Slot
+ * counts are powers of two. Header and slots are each 64 bytes. */
+typedef struct result_cache_header resultCacheHeader_t;
+struct result_cache_header {
+	uint64_t magic;
+	uint64_t version;
+	uint64_t nFileSlot;
+	uint64_t nResultSlot;
+	uint64_t reserved[4];
+};
+
+/* A certificate file, by path and identity, and the digest of its content.
+ * <sequence> is 0 for a slot never written, and odd while being written. */
+typedef struct file_slot fileSlot_t;
+struct file_slot {
+	uint32_t sequence;
+	uint32_t reserved;
+	uint64_t pathHash;		/* Of the path, including any #index */
+	uint64_t device;
+	uint64_t inode;
+	int64_t mtime;			/* Nanoseconds since the epoch */
+	int64_t size;
+	uint64_t digest[RESULT_DIGEST_WORDS];
+};
+
+/* Outcome of the checks of a certificate for a domain under a policy.
+ * The time check is not kept, as its outcome changes as time passes; it is
+ * made again at each lookup against <notBefore> and <notAfter>. */
+typedef struct result_slot resultSlot_t;
+struct result_slot {
+	uint32_t sequence;
+	uint8_t failed;			/* Bit (1<<checkId_t) per check failed */
+	uint8_t chainStatus;	/* CHAIN_* of the certificate */
+	uint16_t keyBits;		/* Of the certificate, at most UINT16_MAX */
+	uint64_t digest[RESULT_DIGEST_WORDS];
+	uint64_t domainHash[2];	/* Two hashes of the domain, under different seeds */
+	uint64_t policyKey;
+	int64_t notBefore;
+	int64_t notAfter;
+};
+
+/* Results shared between runs and processes through a mapped file. Lookups
+ * take no lock; writers hold a mutex within the process and flock across
+ * processes. */
+typedef struct result_cache resultCache_t;
+struct result_cache {
+	int fd;
+	void* map;
+	size_t length;
+	fileSlot_t* fileSlot;
+	resultSlot_t* resultSlot;
+	uint64_t fileMask;
+	uint64_t resultMask;
+	pthread_mutex_t writeLock;
+	long hit;
+	long miss;
+};
+
+void digestWords(const unsigned char* digest, uint64_t* words);
+resultCache_t* openResultCache(const char* path);
+void closeResultCache(resultCache_t* cache);
+int findDigest_resultCache(resultCache_t* cache, const char* path, const struct stat* fileStat,
+		uint64_t* digest);
+void recordDigest_resultCache(resultCache_t* cache, const char* path, const struct stat* fileStat,
+		const uint64_t* digest);
+int lookup_resultCache(resultCache_t* cache, const uint64_t* digest, const char* domain,
+		size_t domainLength, uint64_t policyKey, resultSlot_t* outcome);
+void insert_resultCache(resultCache_t* cache, const uint64_t* digest, const char* domain,
+		size_t domainLength, uint64_t policyKey, unsigned failed, int chainStatus,
+		int keyBits, int64_t notBefore, int64_t notAfter);
+
+#endif /* RESULTCACHE_H_ */
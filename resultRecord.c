@@ -0,0 +1,179 @@
+/*
+ * resultRecord.c
+ *
+ * Check outcomes as fixed width binary records, for tools aggregating the
+ * results of a run without parsing the output csv or checking again. Each
+ * record names every check a certificate failed for a domain, along with its
+ * expiry, key size and chain status, so it says why as well as whether.
+ *
+ * A run writes records in output order through a large buffer; readers map
+ * the file and index the records in place.
+ */
+#include "resultRecord.h"
+#include "certCheck.h"
+#include "logger.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define RESULT_RECORD_BUFFER_SIZE (1024*1024)
+#define EXIT_RECORD_MALLOC_FAIL 121
+
+_Static_assert(sizeof(resultRecord_t)==32 && sizeof(resultRecordHeader_t)==32,
+		"result records are fixed width");
+_Static_assert(RESULT_FAILED_BASIC_CONSTRAINTS==1u<<CHECK_BASIC_CONSTRAINTS
+		&& RESULT_FAILED_KEY_LENGTH==1u<<CHECK_KEY_LENGTH
+		&& RESULT_FAILED_KEY_USAGE==1u<<CHECK_KEY_USAGE
+		&& RESULT_FAILED_TIME==1u<<CHECK_TIME
+		&& RESULT_FAILED_DOMAIN==1u<<CHECK_DOMAIN
+		&& RESULT_FAILED_LOAD_ERROR>=1u<<CHECK_COUNT,
+		"record failure bits are check ids");
+_Static_assert(MAX_SCENARIO<=UINT16_MAX, "scenarios fit a record");
+
+resultRecordWriter_t* openResultRecordWriter(const char* path, int nScenario, int64_t startTime) {
+	/**
+	 * Create the records file <path> for a run of <nScenario> scenarios
+	 * started at <startTime>, truncating it, and write its header
+	 *
+	 * RETN:
+	 * 	Writer, close with closeResultRecordWriter. NULL if <path> could not
+	 * 	be written.
+	 */
+	resultRecordHeader_t header;
+
+	FILE* file=fopen(path, "wb");
+	if(file==NULL){
+		return(NULL);
+	}
+	setvbuf(file, NULL, _IOFBF, RESULT_RECORD_BUFFER_SIZE);
+
+	memset(&header, 0, sizeof(header));
+	header.magic=RESULT_RECORD_MAGIC;
+	header.version=RESULT_RECORD_VERSION;
+	header.recordSize=sizeof(resultRecord_t);
+	header.nScenario=nScenario;
+	header.startTime=startTime;
+	if(fwrite(&header, sizeof(header), 1, file)!=1){
+		fclose(file);
+		return(NULL);
+	}
+
+	resultRecordWriter_t* writer=malloc(sizeof(*writer));
+	if(writer==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_RECORD_MALLOC_FAIL);
+	}
+	writer->file=file;
+	writer->nScenario=nScenario;
+	return(writer);
+}
+
+int writeResultRecords(resultRecordWriter_t* writer, long row, const domainOutcome_t* outcome,
+		int nDomain) {
+	/**
+	 * Write the records of input row number <row>, one per domain and
+	 * scenario in output order
+	 *
+	 * ARGS:
+	 * 	outcome - of each domain, as filled by checkRow. NULL for a row
+	 * 	whose certificate could not be read.
+	 * 	nDomain - of the row. A row without a domain has the records of its
+	 * 	one outcome, as domain 0.
+	 *
+	 * RETN:
+	 * 	0, or -1 if writing failed
+	 */
+	resultRecord_t record;
+
+	memset(&record, 0, sizeof(record));
+	record.row=row;
+	if(outcome==NULL){
+		record.failed=RESULT_FAILED_LOAD_ERROR;
+		record.chainStatus=CHAIN_NOT_CHECKED;
+		return((fwrite(&record, sizeof(record), 1, writer->file)==1)?0:-1);
+	}
+
+	for(int dx=0;dx<((nDomain>0)?nDomain:1);dx++){
+		record.domain=dx;
+		record.notAfter=outcome[dx].notAfter;
+		record.keyBits=outcome[dx].keyBits;
+		record.chainStatus=outcome[dx].chainStatus;
+		for(int sx=0;sx<writer->nScenario;sx++){
+			record.scenario=sx;
+			record.failed=outcome[dx].failed[sx];
+			if(fwrite(&record, sizeof(record), 1, writer->file)!=1){
+				return(-1);
+			}
+		}
+	}
+	return(0);
+}
+
+int closeResultRecordWriter(resultRecordWriter_t* writer) {
+	/**
+	 * Write out what is buffered and close <writer>
+	 *
+	 * RETN:
+	 * 	0, or -1 if writing failed
+	 */
+	if(writer==NULL){return(0);}
+	int failed=(fclose(writer->file)!=0);
+	free(writer);
+	return(failed?-1:0);
+}
+
+resultRecordMap_t* openResultRecordMap(const char* path) {
+	/**
+	 * Map the records file <path> for reading
+	 *
+	 * RETN:
+	 * 	Records, close with closeResultRecordMap. NULL if <path> could not
+	 * 	be read or is not a records file of this version and byte order.
+	 */
+	struct stat fileStat;
+
+	int fd=open(path, O_RDONLY);
+	if(fd<0){
+		return(NULL);
+	}
+	if(fstat(fd, &fileStat)!=0 || (size_t)fileStat.st_size<sizeof(resultRecordHeader_t)){
+		close(fd);
+		return(NULL);
+	}
+	size_t length=fileStat.st_size;
+	void* map=mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(map==MAP_FAILED){
+		return(NULL);
+	}
+
+	const resultRecordHeader_t* header=map;
+	if(header->magic!=RESULT_RECORD_MAGIC || header->version!=RESULT_RECORD_VERSION
+			|| header->recordSize!=sizeof(resultRecord_t)
+			|| (length-sizeof(*header))%sizeof(resultRecord_t)!=0){
+		munmap(map, length);
+		return(NULL);
+	}
+
+	resultRecordMap_t* records=malloc(sizeof(*records));
+	if(records==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_RECORD_MALLOC_FAIL);
+	}
+	records->header=header;
+	records->record=(const resultRecord_t*)(header+1);
+	records->nRecord=(length-sizeof(*header))/sizeof(resultRecord_t);
+	records->map=map;
+	records->length=length;
+	return(records);
+}
+
+void closeResultRecordMap(resultRecordMap_t* records) {
+	if(records==NULL){return;}
+	munmap(records->map, records->length);
+	free(records);
+}
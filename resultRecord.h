@@ -0,0 +1,78 @@
+/*
+ * resultRecord.h
+ *
+ * Binary records of check outcomes, see resultRecord.c.
+ */
+
+#ifndef RESULTRECORD_H_
+#define RESULTRECORD_H_
+
+#include "rowMemo.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define RESULT_RECORD_MAGIC 0x6365727472657331ULL	/* "certres1" */
+#define RESULT_RECORD_VERSION 1
+
+/* Bits of a record's <failed>, (1<<checkId_t) of certCheck.h for each check */
+#define RESULT_FAILED_BASIC_CONSTRAINTS (1u<<0)	/* Certificate is a CA */
+#define RESULT_FAILED_KEY_LENGTH (1u<<1)
+#define RESULT_FAILED_KEY_USAGE (1u<<2)			/* Extended key usage */
+#define RESULT_FAILED_TIME (1u<<3)
+#define RESULT_FAILED_DOMAIN (1u<<4)
+#define RESULT_FAILED_LOAD_ERROR (1u<<15)		/* Certificate could not be read */
+
+/* Start of a records file, followed by the records to the end of the file.
+ * Header and records are fixed width, in the byte order of the machine that
+ * wrote them, which <magic> read back as RESULT_RECORD_MAGIC confirms. */
+typedef struct result_record_header resultRecordHeader_t;
+struct result_record_header {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t recordSize;	/* sizeof(resultRecord_t) */
+	uint32_t nScenario;		/* Records per domain of a row */
+	uint32_t reserved;
+	int64_t startTime;		/* Seconds since the epoch the run started at */
+};
+
+/* Outcome of a row's certificate for one domain under one scenario, as one
+ * column of the output. Records are in output order. A row whose certificate
+ * could not be read has a single record, failing RESULT_FAILED_LOAD_ERROR. */
+typedef struct result_record resultRecord_t;
+struct result_record {
+	uint64_t row;			/* Number of the row in the input, from 1 */
+	int64_t notAfter;		/* Seconds since the epoch */
+	uint32_t domain;		/* Of the row, from 0 */
+	uint16_t scenario;		/* From 0, in the order of the output columns */
+	uint16_t failed;		/* RESULT_FAILED_* bits, 0 if valid */
+	int32_t keyBits;		/* In the units of the key's algorithm */
+	int32_t chainStatus;	/* CHAIN_* of trustStore.h */
+};
+
+/* Records written through a large buffer */
+typedef struct result_record_writer resultRecordWriter_t;
+struct result_record_writer {
+	FILE* file;
+	int nScenario;
+};
+
+/* A records file mapped for reading */
+typedef struct result_record_map resultRecordMap_t;
+struct result_record_map {
+	const resultRecordHeader_t* header;
+	const resultRecord_t* record;
+	size_t nRecord;
+	void* map;
+	size_t length;
+};
+
+resultRecordWriter_t* openResultRecordWriter(const char* path, int nScenario, int64_t startTime);
+int writeResultRecords(resultRecordWriter_t* writer, long row, const domainOutcome_t* outcome,
+		int nDomain);
+int closeResultRecordWriter(resultRecordWriter_t* writer);
+resultRecordMap_t* openResultRecordMap(const char* path);
+void closeResultRecordMap(resultRecordMap_t* records);
+
+#endif /* RESULTRECORD_H_ */
@@ -0,0 +1,289 @@
+/*
+ * rowMemo.c
+ *
+ * Outcomes of the (certificate path, domain) pairs seen in a run, for inputs
+ * that repeat rows. Paths and domains are interned, each held once in an
+ * arena however many pairs name it, so a pair is two string pointers and
+ * pairs are compared without touching their text.
+ *
+ * Both tables are open addressing with linear probing, kept at most half
+ * full, and outcomes are held in the pair table itself, so a repeated row
+ * costs few cache misses. Memory held by the arena and tables is counted against a cap; an
+ * insert that would pass it drops every pair and string first, so the memo
+ * stays bounded whatever the length of the input and keeps the rows seen
+ * most recently.
+ *
+ * A certificate file changed during the run keeps the outcome of the first
+ * row that named it. The memo is only shared by the threads of one run.
+ */
+#include "rowMemo.h"
+#include "hashTool.h"
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ROW_MEMO_INIT_SLOTS 1024
+#define PAIR_HASH_MULTIPLIER 0x9e3779b97f4a7c15ULL
+#define EXIT_MEMO_MALLOC_FAIL 120
+
+static const memoString_t* findString(const rowMemo_t* memo, const memoText_t* text);
+static const memoString_t* internString(rowMemo_t* memo, const memoText_t* text);
+static memoPair_t* pairAt(const rowMemo_t* memo, char* table, uint32_t slot);
+static memoPair_t* findPair(const rowMemo_t* memo, const memoString_t* path,
+		const memoString_t* domain);
+static uint64_t pairHash(const memoString_t* path, const memoString_t* domain);
+static size_t outcomeSize(const rowMemo_t* memo);
+static void reserveMemory(rowMemo_t* memo, const memoText_t* path, const memoText_t* domain);
+static void clearMemo(rowMemo_t* memo);
+static void growStrings(rowMemo_t* memo);
+static void growPairs(rowMemo_t* memo);
+static void* memoCalloc(size_t count, size_t size);
+
+rowMemo_t* create_rowMemo(size_t memoryCap, int nScenario) {
+	/**
+	 * Create an empty memo of outcomes of <nScenario> scenarios each,
+	 * holding at most ~<memoryCap> bytes
+	 */
+	rowMemo_t* memo=memoCalloc(1, sizeof(*memo));
+
+	memo->arena=create_arena(ARENA_DEFAULT_BLOCK_SIZE*16);
+	memo->nScenario=nScenario;
+	memo->memoryCap=memoryCap;
+	memo->pairStride=(offsetof(memoPair_t, outcome)+outcomeSize(memo)+sizeof(void*)-1)
+			&~(sizeof(void*)-1);
+	memo->nStringSlot=memo->nPairSlot=ROW_MEMO_INIT_SLOTS;
+	memo->string=memoCalloc(memo->nStringSlot, sizeof(memoString_t*));
+	memo->pair=memoCalloc(memo->nPairSlot, memo->pairStride);
+	memo->memoryUsed=memo->nStringSlot*sizeof(memoString_t*)+memo->nPairSlot*memo->pairStride;
+	pthread_mutex_init(&memo->lock, NULL);
+	return(memo);
+}
+
+void delete_rowMemo(rowMemo_t* memo) {
+	if(memo==NULL){return;}
+	pthread_mutex_destroy(&memo->lock);
+	delete_arena(memo->arena);
+	free(memo->string);
+	free(memo->pair);
+	free(memo);
+}
+
+void initMemoText(memoText_t* text, const char* data, size_t length) {
+	/**
+	 * Set <text> to the <length> bytes of <data>, which it borrows
+	 */
+	text->data=data;
+	text->length=length;
+	text->hash=hashBytes(data, length, HASH_SEED);
+}
+
+int lookup_rowMemo(rowMemo_t* memo, const memoText_t* path, const memoText_t* domain,
+		domainOutcome_t* outcome) {
+	/**
+	 * Find the outcome of certificate <path> for <domain>
+	 *
+	 * RETN:
+	 * 	1 with <outcome> filled for each scenario, 0 if not held
+	 */
+	int found=0;
+
+	pthread_mutex_lock(&memo->lock);
+	const memoString_t* pathString=findString(memo, path);
+	const memoString_t* domainString=(pathString!=NULL)?findString(memo, domain):NULL;
+	if(pathString!=NULL && domainString!=NULL){
+		memoPair_t* pair=findPair(memo, pathString, domainString);
+		if(pair->path!=NULL){
+			memcpy(outcome, &pair->outcome, outcomeSize(memo));
+			found=1;
+		}
+	}
+	pthread_mutex_unlock(&memo->lock);
+	return(found);
+}
+
+void insert_rowMemo(rowMemo_t* memo, const memoText_t* path, const memoText_t* domain,
+		const domainOutcome_t* outcome) {
+	/**
+	 * Hold <outcome> as that of certificate <path> for <domain>, replacing
+	 * any held already
+	 */
+	pthread_mutex_lock(&memo->lock);
+	reserveMemory(memo, path, domain);
+	const memoString_t* pathString=internString(memo, path);
+	const memoString_t* domainString=internString(memo, domain);
+
+	memoPair_t* pair=findPair(memo, pathString, domainString);
+	if(pair->path==NULL){
+		if(2*(memo->nPair+1)>memo->nPairSlot){
+			growPairs(memo);
+			pair=findPair(memo, pathString, domainString);
+		}
+		pair->path=pathString;
+		pair->domain=domainString;
+		memo->nPair++;
+	}
+	memcpy(&pair->outcome, outcome, outcomeSize(memo));
+	pthread_mutex_unlock(&memo->lock);
+}
+
+void countRow_rowMemo(rowMemo_t* memo, int hit) {
+	/**
+	 * Count a row as answered from <memo> if <hit>, else as checked
+	 */
+	__atomic_fetch_add(hit?&memo->hit:&memo->miss, 1, __ATOMIC_RELAXED);
+}
+
+static const memoString_t* findString(const rowMemo_t* memo, const memoText_t* text) {
+	/**
+	 * RETN:
+	 * 	Interned copy of <text>, NULL if there is none
+	 */
+	uint32_t mask=memo->nStringSlot-1;
+	for(uint32_t slot=text->hash&mask;memo->string[slot]!=NULL;slot=(slot+1)&mask){
+		const memoString_t* string=memo->string[slot];
+		if(string->hash==text->hash && string->length==text->length
+				&& memcmp(string->data, text->data, text->length)==0){
+			return(string);
+		}
+	}
+	return(NULL);
+}
+
+static const memoString_t* internString(rowMemo_t* memo, const memoText_t* text) {
+	/**
+	 * RETN:
+	 * 	Interned copy of <text>, added if there is none
+	 */
+	const memoString_t* found=findString(memo, text);
+	if(found!=NULL){
+		return(found);
+	}
+	if(2*(memo->nString+1)>memo->nStringSlot){
+		growStrings(memo);
+	}
+
+	memoString_t* string=alloc_arena(memo->arena, sizeof(memoString_t)+text->length);
+	string->hash=text->hash;
+	string->length=text->length;
+	memcpy(string->data, text->data, text->length);
+	memo->memoryUsed+=sizeof(memoString_t)+text->length;
+
+	uint32_t mask=memo->nStringSlot-1;
+	uint32_t slot=text->hash&mask;
+	while(memo->string[slot]!=NULL){
+		slot=(slot+1)&mask;
+	}
+	memo->string[slot]=string;
+	memo->nString++;
+	return(string);
+}
+
+static memoPair_t* findPair(const rowMemo_t* memo, const memoString_t* path,
+		const memoString_t* domain) {
+	/**
+	 * RETN:
+	 * 	Slot of the pair of interned <path> and <domain>, or the empty slot
+	 * 	it would take
+	 */
+	uint32_t mask=memo->nPairSlot-1;
+	uint32_t slot=pairHash(path, domain)&mask;
+	memoPair_t* pair=pairAt(memo, memo->pair, slot);
+	while(pair->path!=NULL && (pair->path!=path || pair->domain!=domain)){
+		slot=(slot+1)&mask;
+		pair=pairAt(memo, memo->pair, slot);
+	}
+	return(pair);
+}
+
+static memoPair_t* pairAt(const rowMemo_t* memo, char* table, uint32_t slot) {
+	return((memoPair_t*)(table+slot*memo->pairStride));
+}
+
+static uint64_t pairHash(const memoString_t* path, const memoString_t* domain) {
+	/* Mixed so a pair does not hash as its two strings swapped, or to the slot of either */
+	uint64_t hash=(path->hash^(domain->hash*PAIR_HASH_MULTIPLIER))*PAIR_HASH_MULTIPLIER;
+	return(hash^(hash>>32));
+}
+
+static size_t outcomeSize(const rowMemo_t* memo) {
+	/* Only the failed entries of the memo's scenarios are held */
+	return(offsetof(domainOutcome_t, failed)+sizeof(uint16_t)*memo->nScenario);
+}
+
+static void reserveMemory(rowMemo_t* memo, const memoText_t* path, const memoText_t* domain) {
+	/**
+	 * Start the memo over if inserting a pair of these lengths could take it
+	 * past its cap, counting tables that may double. A pair larger than the
+	 * cap on its own is still held, alone.
+	 */
+	size_t needed=2*sizeof(memoString_t)+path->length+domain->length;
+	if(2*(memo->nString+2)>memo->nStringSlot){
+		needed+=memo->nStringSlot*sizeof(memoString_t*);
+	}
+	if(2*(memo->nPair+1)>memo->nPairSlot){
+		needed+=memo->nPairSlot*memo->pairStride;
+	}
+	if(memo->memoryUsed+needed>memo->memoryCap){
+		clearMemo(memo);
+	}
+}
+
+static void clearMemo(rowMemo_t* memo) {
+	/**
+	 * Drop every string and pair, shrinking the tables to their first size
+	 */
+	reset_arena(memo->arena);
+	free(memo->string);
+	free(memo->pair);
+	memo->nStringSlot=memo->nPairSlot=ROW_MEMO_INIT_SLOTS;
+	memo->string=memoCalloc(memo->nStringSlot, sizeof(memoString_t*));
+	memo->pair=memoCalloc(memo->nPairSlot, memo->pairStride);
+	memo->nString=memo->nPair=0;
+	memo->memoryUsed=memo->nStringSlot*sizeof(memoString_t*)+memo->nPairSlot*memo->pairStride;
+	memo->nReset++;
+}
+
+static void growStrings(rowMemo_t* memo) {
+	memoString_t** old=memo->string;
+	uint32_t nOld=memo->nStringSlot;
+
+	memo->nStringSlot*=2;
+	memo->string=memoCalloc(memo->nStringSlot, sizeof(memoString_t*));
+	memo->memoryUsed+=nOld*sizeof(memoString_t*);
+	uint32_t mask=memo->nStringSlot-1;
+	for(uint32_t ix=0;ix<nOld;ix++){
+		if(old[ix]==NULL){continue;}
+		uint32_t slot=old[ix]->hash&mask;
+		while(memo->string[slot]!=NULL){
+			slot=(slot+1)&mask;
+		}
+		memo->string[slot]=old[ix];
+	}
+	free(old);
+}
+
+static void growPairs(rowMemo_t* memo) {
+	char* old=memo->pair;
+	uint32_t nOld=memo->nPairSlot;
+
+	memo->nPairSlot*=2;
+	memo->pair=memoCalloc(memo->nPairSlot, memo->pairStride);
+	memo->memoryUsed+=nOld*memo->pairStride;
+	for(uint32_t ix=0;ix<nOld;ix++){
+		memoPair_t* pair=pairAt(memo, old, ix);
+		if(pair->path!=NULL){
+			memcpy(findPair(memo, pair->path, pair->domain), pair, memo->pairStride);
+		}
+	}
+	free(old);
+}
+
+static void* memoCalloc(size_t count, size_t size) {
+	void* memory=calloc(count, size);
+	if(memory==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_MEMO_MALLOC_FAIL);
+	}
+	return(memory);
+}
@@ -0,0 +1,89 @@
+/*
+ * rowMemo.h
+ *
+ * Outcomes of repeated (certificate path, domain) rows, see rowMemo.c.
+ */
+
+#ifndef ROWMEMO_H_
+#define ROWMEMO_H_
+
+#include "arena.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Scenarios an outcome holds, MAX_SCENARIO of certCheck.h */
+#define ROW_MEMO_MAX_SCENARIO 64
+
+/* Outcome of the checks of a certificate for a domain under each scenario.
+ * A time check that failed may have stopped the others, so its bit alone
+ * leaves them unknown; without it the time check is made again against
+ * <notBefore> and <notAfter> as time passes. */
+typedef struct domain_outcome domainOutcome_t;
+struct domain_outcome {
+	int64_t notBefore;
+	int64_t notAfter;
+	int chainStatus;				/* CHAIN_* of the certificate */
+	int keyBits;					/* Of the certificate's key */
+	uint16_t failed[ROW_MEMO_MAX_SCENARIO];	/* Bit (1<<checkId_t) per check failed */
+};
+
+/* Text of a row to look up or insert, hashed once for every use */
+typedef struct memo_text memoText_t;
+struct memo_text {
+	const char* data;
+	size_t length;
+	uint64_t hash;
+};
+
+/* A string held once however many rows repeat it */
+typedef struct memo_string memoString_t;
+struct memo_string {
+	uint64_t hash;
+	size_t length;
+	char data[];
+};
+
+/* Outcome of a certificate path for a domain, both interned. Slots hold
+ * only the failed entries of the memo's scenarios, so are <pairStride>
+ * bytes apart. */
+typedef struct memo_pair memoPair_t;
+struct memo_pair {
+	const memoString_t* path;
+	const memoString_t* domain;
+	domainOutcome_t outcome;
+};
+
+/* Outcomes of the (certificate path, domain) pairs of a run, so rows
+ * repeating a pair are not checked again. Once the memory held would exceed
+ * the cap everything is dropped and the memo starts over. */
+typedef struct row_memo rowMemo_t;
+struct row_memo {
+	arena_t* arena;				/* Interned strings */
+	memoString_t** string;		/* Open addressing, a power of 2 of slots */
+	uint32_t nStringSlot;
+	uint32_t nString;
+	char* pair;					/* Open addressing, a power of 2 of slots */
+	size_t pairStride;
+	uint32_t nPairSlot;
+	uint32_t nPair;
+	int nScenario;
+	size_t memoryUsed;
+	size_t memoryCap;
+	long hit;
+	long miss;
+	long nReset;				/* Times the cap was reached */
+	pthread_mutex_t lock;
+};
+
+rowMemo_t* create_rowMemo(size_t memoryCap, int nScenario);
+void delete_rowMemo(rowMemo_t* memo);
+void initMemoText(memoText_t* text, const char* data, size_t length);
+int lookup_rowMemo(rowMemo_t* memo, const memoText_t* path, const memoText_t* domain,
+		domainOutcome_t* outcome);
+void insert_rowMemo(rowMemo_t* memo, const memoText_t* path, const memoText_t* domain,
+		const domainOutcome_t* outcome);
+void countRow_rowMemo(rowMemo_t* memo, int hit);
+
+#endif /* ROWMEMO_H_ */
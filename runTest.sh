@@ -2,15 +2,197 @@
 make clean &>/dev/null
 make &> /dev/null
 
+# Time the sample certificates are checked at, within their validity
+PINNED="-t @1527811200"
+
 cp test/*.csv . >/dev/null
 cp test/certificates/*.crt . >/dev/null
 
-./certcheck sample_input.csv 
+./certcheck $PINNED sample_input.csv 
 
 echo "-- START DIFF --"
 diff output.csv sample_output.csv
 echo "-- END DIFF --"
 
+# Hostname matcher against the reference regex matcher
+mv output.csv matcher_output.csv
+./certcheck $PINNED -R sample_input.csv
+
+# Hostnames longer than RFC1035 allows, under a wildcard name or not
+label=$(printf 'a%.0s' $(seq 300))
+printf 'testseven.crt,%s.example.com\ntestnine.crt,%s.certtest.com\ntestseven.crt,%s.other.com\n' \
+	$label $label $label > long_input.csv
+./certcheck $PINNED -o long_output.csv long_input.csv
+./certcheck $PINNED -R -o long_matcher_output.csv long_input.csv
+
+echo "-- START MATCHER DIFF --"
+diff output.csv matcher_output.csv
+diff long_output.csv long_matcher_output.csv
+echo "-- END MATCHER DIFF --"
+
+# Certificates read from a PEM bundle by index, and from DER, against the
+# files they came from
+cat testone.crt testtwo.crt testseven.crt > bundle.pem
+openssl x509 -in testeight.crt -outform der -out testeight.der
+sed -e 's/^testone.crt,/bundle.pem#0,/' -e 's/^testtwo.crt,/bundle.pem#1,/' \
+	-e 's/^testseven.crt,/bundle.pem#2,/' -e 's/^testeight.crt,/testeight.der,/' \
+	sample_input.csv > bundle_input.csv
+./certcheck $PINNED -o bundle_output.csv bundle_input.csv
+sed -e 's/^bundle.pem#0,/testone.crt,/' -e 's/^bundle.pem#1,/testtwo.crt,/' \
+	-e 's/^bundle.pem#2,/testseven.crt,/' -e 's/^testeight.der,/testeight.crt,/' \
+	bundle_output.csv > bundle_renamed.csv
+
+echo "-- START BUNDLE DIFF --"
+diff bundle_renamed.csv sample_output.csv
+echo "-- END BUNDLE DIFF --"
+rm bundle.pem testeight.der
+
+# Rows answered by a server against the same rows checked from a file
+rm -f certcheck.sock
+./certcheck $PINNED -D certcheck.sock &
+server=$!
+# The socket exists a moment before the server listens, so retry refusals
+for wait in $(seq 50); do
+	./certclient certcheck.sock sample_input.csv > client_output.csv 2> /dev/null && break
+	sleep 0.1
+done
+kill $server
+wait $server
+
+echo "-- START SERVER DIFF --"
+diff client_output.csv sample_output.csv
+echo "-- END SERVER DIFF --"
+
+# A rerun answered from the result cache against the run that filled it
+rm -f results.cache
+./certcheck $PINNED -C results.cache -o cold_output.csv sample_input.csv
+./certcheck $PINNED -C results.cache -o warm_output.csv sample_input.csv
+
+echo "-- START RESULT CACHE DIFF --"
+diff cold_output.csv sample_output.csv
+diff warm_output.csv sample_output.csv
+echo "-- END RESULT CACHE DIFF --"
+rm results.cache
+
+# Key sizes of generated RSA, EC and Ed25519 certificates against those
+# OpenSSL reports, and the key length check against the default minimums
+make certgen &> /dev/null
+./certgen -n 60 -r 1 -s 18 -o keys > /dev/null
+nEc=0
+nEd=0
+for cert in keys/cert*.pem; do
+	text=$(openssl x509 -in $cert -noout -text)
+	bits=$(echo "$text" | sed -n 's/.*Public-Key: (\([0-9]*\) bit).*/\1/p')
+	case "$text" in
+	*"rsaEncryption"*) minimum=2048 ;;
+	*"ED25519"*) bits=256; minimum=256; nEd=$((nEd+1)) ;;
+	*) minimum=256; nEc=$((nEc+1)) ;;
+	esac
+	echo "$cert,x" >> keys_input.csv
+	echo "$bits,$([ $bits -lt $minimum ] && echo short || echo ok)" >> keys_expected.csv
+done
+./certcheck $PINNED -o keys_output.csv -b keys.bin keys_input.csv
+./certcheck-dump keys.bin | tail -n +3 | awk -F, '{ print $6 "," (($4 ~ /key-length/) ? "short" : "ok") }' \
+	> keys_dumped.csv
+
+echo "-- START KEY SIZE DIFF --"
+[ $nEc -gt 0 ] || echo "no EC certificates generated"
+[ $nEd -gt 0 ] || echo "no Ed25519 certificates generated"
+diff keys_dumped.csv keys_expected.csv
+echo "-- END KEY SIZE DIFF --"
+rm -r keys keys.bin certgen
+
+# Chains verified against a directory holding one CA: certificates it signed
+# are trusted, the CA itself is a root, and the self signed samples are not
+make certgen &> /dev/null
+./certgen -n 3 -r 1 -s 20 -o chain > /dev/null
+mkdir chain_ca
+cp chain/ca.pem chain_ca/
+printf '%s\n' chain/ca.pem chain/cert000000.pem chain/cert000001.pem chain/cert000002.pem \
+	testone.crt testtwo.crt | sed 's/$/,x/' > chain_input.csv
+printf '%s\n' trusted trusted trusted trusted unknown-issuer unknown-issuer > chain_expected.csv
+./certcheck $PINNED -c chain_ca -o chain_output.csv chain_input.csv
+cut -d, -f4 chain_output.csv > chain_status.csv
+
+echo "-- START CHAIN DIFF --"
+diff chain_status.csv chain_expected.csv
+echo "-- END CHAIN DIFF --"
+rm -r chain chain_ca certgen
+
+# Repeated rows answered from the row memo against checking every row
+cat sample_input.csv sample_input.csv > repeated_input.csv
+./certcheck $PINNED -o repeated_output.csv repeated_input.csv
+./certcheck $PINNED -M 1 -o memo_output.csv repeated_input.csv
+
+echo "-- START MEMO DIFF --"
+diff memo_output.csv repeated_output.csv
+echo "-- END MEMO DIFF --"
+
+# Shard outputs merged against the unsharded output, and a merge missing a
+# shard failing
+for shard in 1 2 3; do
+	./certcheck $PINNED --shard $shard/3 -o shard$shard.csv sample_input.csv
+done
+./certcheck-merge -o merged_output.csv shard1.csv shard2.csv shard3.csv
+
+echo "-- START SHARD DIFF --"
+diff merged_output.csv sample_output.csv
+./certcheck-merge -o missing_output.csv shard1.csv shard3.csv 2> /dev/null \
+	&& echo "merge without shard 2 succeeded"
+echo "-- END SHARD DIFF --"
+
+# Checks failed by each sample row as recorded, every one named
+./certcheck $PINNED -b records.bin -o records_output.csv sample_input.csv
+./certcheck-dump records.bin | tail -n +3 | cut -d, -f1,4 > records_failed.csv
+cat > records_expected.csv <<END
+1,key-length
+2,none
+3,time
+4,time
+5,key-usage
+6,key-usage
+7,none
+8,none
+9,none
+10,none
+11,basic-constraints
+12,domain
+13,domain
+END
+
+echo "-- START RECORDS DIFF --"
+diff records_failed.csv records_expected.csv
+echo "-- END RECORDS DIFF --"
+rm records.bin
+
+# Rows whose files were read ahead against rows reading their own
+./certcheck $PINNED --prefetch 4 -o prefetch_output.csv repeated_input.csv
+./certcheck $PINNED -j 2 --prefetch 4 -o prefetch_threaded_output.csv repeated_input.csv
+
+echo "-- START PREFETCH DIFF --"
+diff prefetch_output.csv repeated_output.csv
+diff prefetch_threaded_output.csv repeated_output.csv
+echo "-- END PREFETCH DIFF --"
+
+# Rows checked through the library's batch call, each row twice so the second
+# reuses the certificate of the first, with and then answered from a result
+# cache. batchtest reports threads sharing the context that disagree, and a
+# missing certificate not failing to load, itself.
+make batchtest &> /dev/null
+sed p sample_input.csv > pair_input.csv
+sed p sample_output.csv > pair_expected.csv
+rm -f batch.cache
+./batchtest @1527811200 pair_input.csv > batch_output.csv
+./batchtest @1527811200 pair_input.csv batch.cache > batch_cold_output.csv
+./batchtest @1527811200 pair_input.csv batch.cache > batch_warm_output.csv
+
+echo "-- START BATCH DIFF --"
+diff batch_output.csv pair_expected.csv
+diff batch_cold_output.csv pair_expected.csv
+diff batch_warm_output.csv pair_expected.csv
+echo "-- END BATCH DIFF --"
+rm batch.cache batchtest
+
 rm *.csv > /dev/null
 rm *.crt > /dev/null
 
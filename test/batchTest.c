@@ -0,0 +1,189 @@
+/*
+ * batchTest.c
+ *
+ * batchtest, driving validateBatch_checkContext as an embedding program
+ * would, for runTest.sh. The rows of an input file are checked once with no
+ * chain statuses, then by several threads at once sharing the context, each
+ * of which must agree with the first. A row naming a missing certificate is
+ * added, which must load as CERT_LOAD_ERROR and be the only one counted.
+ *
+ * The first results are printed as certcheck would print them, to diff
+ * against its output. Disagreements are reported to stderr and fail the run.
+ */
+#include "certCheck.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXIT_TEST_FAIL 1
+#define EXIT_INPUT_FAIL 36
+#define EXIT_USAGE 64
+
+#define MAX_ROW 1024
+#define ROW_LEN 1024
+#define N_THREAD 4
+#define MISSING_CERTIFICATE "batchtest-missing.crt"
+
+/* One thread's check of the whole batch */
+typedef struct batch_run batchRun_t;
+struct batch_run {
+	checkContext_t* context;
+	const checkRequest_t* request;
+	size_t nRequest;
+	int* result;
+	int* chainStatus;
+	int nLoadError;
+};
+
+static size_t readRequests(const char* path, char row[][ROW_LEN], checkRequest_t* request);
+static void* runBatch(void* argument);
+static int compareRun(const batchRun_t* reference, const batchRun_t* run, int thread);
+
+int main(int argc, char** argv) {
+	static char row[MAX_ROW][ROW_LEN];
+	static checkRequest_t request[MAX_ROW+1];
+	scenario_t time[MAX_SCENARIO];
+	checkOptions_t options;
+	int failed=0;
+
+	if(argc<3 || argc>4){
+		fprintf(stderr, "usage: %s times input [result cache]\n", argv[0]);
+		exit(EXIT_USAGE);
+	}
+	defaultCheckOptions(&options);
+	options.nTime=parseScenarioTimes(argv[1], time, MAX_SCENARIO);
+	options.time=time;
+	options.resultCachePath=(argc==4)?argv[3]:NULL;
+	if(options.nTime<1){
+		fprintf(stderr, "Invalid times: %s\n", argv[1]);
+		exit(EXIT_USAGE);
+	}
+
+	size_t nRequest=readRequests(argv[2], row, request);
+	request[nRequest].certificate=MISSING_CERTIFICATE;
+	request[nRequest].domain="www.example.com";
+	nRequest++;
+
+	checkContext_t* context=create_checkContext(&options);
+	if(context==NULL){
+		fprintf(stderr, "Failed to create check context\n");
+		exit(EXIT_INPUT_FAIL);
+	}
+	size_t nResult=nRequest*context->nScenario;
+
+	/* Without chain statuses, on this thread */
+	batchRun_t reference={ context, request, nRequest, malloc(sizeof(int)*nResult), NULL, 0 };
+	runBatch(&reference);
+	if(reference.nLoadError!=1){
+		fprintf(stderr, "%d rows failed to load, expected 1\n", reference.nLoadError);
+		failed=1;
+	}
+	for(int sx=0;sx<context->nScenario;sx++){
+		if(reference.result[nResult-context->nScenario+sx]!=CERT_LOAD_ERROR){
+			fprintf(stderr, "missing certificate not reported as CERT_LOAD_ERROR\n");
+			failed=1;
+		}
+	}
+
+	/* Sharing the context, with chain statuses */
+	pthread_t thread[N_THREAD];
+	batchRun_t run[N_THREAD];
+	for(int tx=0;tx<N_THREAD;tx++){
+		run[tx]=(batchRun_t){ context, request, nRequest, malloc(sizeof(int)*nResult),
+				malloc(sizeof(int)*nRequest), 0 };
+		pthread_create(&thread[tx], NULL, runBatch, &run[tx]);
+	}
+	for(int tx=0;tx<N_THREAD;tx++){
+		pthread_join(thread[tx], NULL);
+		failed|=compareRun(&reference, &run[tx], tx);
+		free(run[tx].result);
+		free(run[tx].chainStatus);
+	}
+
+	for(size_t rx=0;rx+1<nRequest;rx++){
+		printf("%s,%s", request[rx].certificate, request[rx].domain);
+		for(int sx=0;sx<context->nScenario;sx++){
+			printf(",%d", reference.result[rx*context->nScenario+sx]);
+		}
+		printf("\n");
+	}
+
+	free(reference.result);
+	delete_checkContext(context);
+	releaseRowArena();
+	return(failed?EXIT_TEST_FAIL:0);
+}
+
+static size_t readRequests(const char* path, char row[][ROW_LEN], checkRequest_t* request) {
+	/**
+	 * Read the <certificate>,<domain> rows of <path> into <row>, pointing
+	 * <request> at their cells
+	 *
+	 * RETN:
+	 * 	Number of rows, exits if <path> cannot be read or a row is malformed
+	 */
+	FILE* input=fopen(path, "r");
+	size_t nRow=0;
+
+	if(input==NULL){
+		fprintf(stderr, "Failed to open input: %s\n", path);
+		exit(EXIT_INPUT_FAIL);
+	}
+	while(nRow<MAX_ROW && fgets(row[nRow], ROW_LEN, input)!=NULL){
+		row[nRow][strcspn(row[nRow], "\r\n")]='\0';
+		char* separator=strchr(row[nRow], ',');
+		if(separator==NULL){
+			fprintf(stderr, "Malformed row %zu: %s\n", nRow+1, row[nRow]);
+			exit(EXIT_INPUT_FAIL);
+		}
+		*separator='\0';
+		request[nRow].certificate=row[nRow];
+		request[nRow].domain=separator+1;
+		nRow++;
+	}
+	fclose(input);
+	return(nRow);
+}
+
+static void* runBatch(void* argument) {
+	batchRun_t* run=argument;
+	run->nLoadError=validateBatch_checkContext(run->context, run->request, run->nRequest,
+			run->result, run->chainStatus);
+	return(NULL);
+}
+
+static int compareRun(const batchRun_t* reference, const batchRun_t* run, int thread) {
+	/**
+	 * Report where the results of <run> differ from <reference>, and any
+	 * chain status other than CHAIN_NOT_CHECKED, as there is no trust store
+	 *
+	 * RETN:
+	 * 	1 if they differ, else 0
+	 */
+	int nScenario=reference->context->nScenario;
+	int differ=0;
+
+	if(run->nLoadError!=reference->nLoadError){
+		fprintf(stderr, "thread %d: %d rows failed to load, expected %d\n", thread,
+				run->nLoadError, reference->nLoadError);
+		differ=1;
+	}
+	for(size_t rx=0;rx<run->nRequest;rx++){
+		for(int sx=0;sx<nScenario;sx++){
+			size_t ix=rx*nScenario+sx;
+			if(run->result[ix]!=reference->result[ix]){
+				fprintf(stderr, "thread %d: row %zu scenario %d gave %d, expected %d\n", thread,
+						rx+1, sx, run->result[ix], reference->result[ix]);
+				differ=1;
+			}
+		}
+		if(run->chainStatus[rx]!=CHAIN_NOT_CHECKED){
+			fprintf(stderr, "thread %d: row %zu has chain status %d\n", thread, rx+1,
+					run->chainStatus[rx]);
+			differ=1;
+		}
+	}
+	return(differ);
+}
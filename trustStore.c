@@ -0,0 +1,327 @@
+/*
+ * trustStore.c
+ *
+ * Verification of the issuer chain of certificates against local CA
+ * certificates, read once from a directory or a bundle, without any network
+ * access.
+ *
+ * A certificate's issuer is looked up by its authority key identifier, else
+ * by its issuer name, among the CA certificates of the store. Each candidate
+ * that could have issued it (X509_check_issued) is tried until one's key
+ * verifies its signature. Self issued CAs of the store are its roots; an
+ * intermediate is trusted once verified up to one, and that verification is
+ * done once and kept, so the leaves of one CA cost one signature each.
+ *
+ * Only signatures, names and CA flags are checked, not the validity periods of
+ * issuers, which the time scenarios apply to leaves alone.
+ */
+#include "trustStore.h"
+#include "certBundle.h"
+#include "hashTool.h"
+#include "logger.h"
+
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#include <dirent.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define TRUST_INITIAL_ENTRIES 64
+#define TRUST_MIN_BUCKETS 16
+#define EXIT_TRUST_MALLOC_FAIL 119
+
+/* Status of a chain cut off at TRUST_MAX_DEPTH, within the store only. It
+ * depends on the depth the chain was met at, so is never kept with an
+ * issuer, and is reported as CHAIN_UNTRUSTED_ISSUER. */
+#define CHAIN_DEPTH_EXCEEDED (-1)
+
+static int loadFile(trustStore_t* store, const char* path, int* nAllocated);
+static void indexEntries(trustStore_t* store);
+static uint32_t nameBucket(const trustStore_t* store, const X509_NAME* name);
+static uint32_t keyIdBucket(const trustStore_t* store, const ASN1_OCTET_STRING* keyId);
+static int verifyChain(trustStore_t* store, X509* cert, int depth);
+static int issuerStatus(trustStore_t* store, trustEntry_t* issuer, int depth);
+static int trySignedBy(trustStore_t* store, X509* cert, trustEntry_t* issuer, int depth,
+		int* status);
+static void* trustMalloc(size_t size);
+static void trustMallocFail(void);
+
+static const char* chainStatusNames[CHAIN_STATUS_COUNT]={
+	[CHAIN_NOT_CHECKED]="not-checked",
+	[CHAIN_TRUSTED]="trusted",
+	[CHAIN_UNKNOWN_ISSUER]="unknown-issuer",
+	[CHAIN_BAD_SIGNATURE]="bad-signature",
+	[CHAIN_UNTRUSTED_ISSUER]="untrusted-issuer"
+};
+
+trustStore_t* openTrustStore(const char* path) {
+	/**
+	 * Read the CA certificates of <path>, a directory of certificate files
+	 * or a single file, each PEM (any number of certificates) or DER.
+	 * Certificates that are not CAs, and files of a directory that hold no
+	 * certificate, are skipped.
+	 *
+	 * RETN:
+	 * 	Store, close with closeTrustStore. NULL if <path> cannot be read or
+	 * 	holds no CA certificate.
+	 */
+	struct stat pathStat;
+	char file[PATH_MAX];
+	int nAllocated=TRUST_INITIAL_ENTRIES;
+
+	if(stat(path, &pathStat)!=0){
+		return(NULL);
+	}
+	trustStore_t* store=trustMalloc(sizeof(*store));
+	memset(store, 0, sizeof(*store));
+	store->entry=trustMalloc(sizeof(trustEntry_t)*nAllocated);
+
+	if(S_ISDIR(pathStat.st_mode)){
+		DIR* directory=opendir(path);
+		struct dirent* dirEntry;
+		if(directory==NULL){
+			closeTrustStore(store);
+			return(NULL);
+		}
+		while((dirEntry=readdir(directory))!=NULL){
+			struct stat fileStat;
+			if(dirEntry->d_name[0]=='.'
+					|| snprintf(file, sizeof(file), "%s/%s", path, dirEntry->d_name)>=(int)sizeof(file)
+					|| stat(file, &fileStat)!=0 || !S_ISREG(fileStat.st_mode)){
+				continue;
+			}
+			loadFile(store, file, &nAllocated);
+		}
+		closedir(directory);
+	} else {
+		loadFile(store, path, &nAllocated);
+	}
+
+	if(store->nEntry==0){
+		closeTrustStore(store);
+		return(NULL);
+	}
+	indexEntries(store);
+	return(store);
+}
+
+void closeTrustStore(trustStore_t* store) {
+	if(store==NULL){return;}
+	for(int ix=0;ix<store->nEntry;ix++){
+		X509_free(store->entry[ix].cert);
+	}
+	free(store->entry);
+	free(store->byName);
+	free(store->byKeyId);
+	free(store);
+}
+
+int verify_trustStore(trustStore_t* store, X509* cert) {
+	/**
+	 * Verify the issuer chain of <cert> up to a root of <store>
+	 *
+	 * Safe to call from several threads at once. Threads verifying the same
+	 * intermediate at once may both do so; they reach the same status.
+	 *
+	 * RETN:
+	 * 	CHAIN_TRUSTED, CHAIN_UNKNOWN_ISSUER, CHAIN_BAD_SIGNATURE or
+	 * 	CHAIN_UNTRUSTED_ISSUER
+	 */
+	int status=verifyChain(store, cert, 0);
+	ERR_clear_error();
+	return((status==CHAIN_DEPTH_EXCEEDED)?CHAIN_UNTRUSTED_ISSUER:status);
+}
+
+const char* chainStatusName(int status) {
+	return((status>=0 && status<CHAIN_STATUS_COUNT)?chainStatusNames[status]:"unknown");
+}
+
+static int loadFile(trustStore_t* store, const char* path, int* nAllocated) {
+	/**
+	 * Add the CA certificates of the file <path> to <store>, growing its
+	 * entries from <nAllocated>
+	 *
+	 * RETN:
+	 * 	Number of certificates added
+	 */
+	certBundle_t* bundle=openCertBundle(path);
+	int nAdded=0;
+	X509* cert;
+
+	if(bundle==NULL){
+		return(0);
+	}
+	while((cert=nextCert_certBundle(bundle, NULL))!=NULL){
+		/* Also caches the extensions, so later reads of <cert> by other threads write nothing */
+		if(X509_check_ca(cert)==0 || X509_get0_pubkey(cert)==NULL){
+			X509_free(cert);
+			continue;
+		}
+		if(store->nEntry==*nAllocated){
+			*nAllocated*=2;
+			store->entry=realloc(store->entry, sizeof(trustEntry_t)*(*nAllocated));
+			if(store->entry==NULL){
+				trustMallocFail();
+			}
+		}
+		trustEntry_t* entry=&store->entry[store->nEntry++];
+		entry->cert=cert;
+		entry->key=X509_get0_pubkey(cert);
+		entry->root=(X509_check_issued(cert, cert)==X509_V_OK);
+		entry->status=entry->root?CHAIN_TRUSTED:CHAIN_NOT_CHECKED;
+		nAdded++;
+	}
+	closeCertBundle(bundle);
+	ERR_clear_error();
+	return(nAdded);
+}
+
+static void indexEntries(trustStore_t* store) {
+	/**
+	 * Index the entries of <store> by subject name and key identifier, and
+	 * fingerprint them. Entries no longer move once indexed.
+	 */
+	store->nBucket=TRUST_MIN_BUCKETS;
+	while(store->nBucket<(uint32_t)store->nEntry){
+		store->nBucket*=2;
+	}
+	store->byName=trustMalloc(sizeof(trustEntry_t*)*store->nBucket);
+	store->byKeyId=trustMalloc(sizeof(trustEntry_t*)*store->nBucket);
+	memset(store->byName, 0, sizeof(trustEntry_t*)*store->nBucket);
+	memset(store->byKeyId, 0, sizeof(trustEntry_t*)*store->nBucket);
+
+	/* Order independent, so a directory listed in another order fingerprints the same */
+	store->fingerprint=HASH_SEED;
+	for(int ix=0;ix<store->nEntry;ix++){
+		trustEntry_t* entry=&store->entry[ix];
+		uint32_t bucket=nameBucket(store, X509_get_subject_name(entry->cert));
+		entry->nextByName=store->byName[bucket];
+		store->byName[bucket]=entry;
+
+		const ASN1_OCTET_STRING* keyId=X509_get0_subject_key_id(entry->cert);
+		entry->nextByKeyId=NULL;
+		if(keyId!=NULL){
+			bucket=keyIdBucket(store, keyId);
+			entry->nextByKeyId=store->byKeyId[bucket];
+			store->byKeyId[bucket]=entry;
+		}
+
+		unsigned char digest[EVP_MAX_MD_SIZE];
+		unsigned int digestLength=0;
+		if(X509_digest(entry->cert, EVP_sha256(), digest, &digestLength)){
+			store->fingerprint+=hashBytes(digest, digestLength, HASH_SEED);
+		}
+	}
+}
+
+static uint32_t nameBucket(const trustStore_t* store, const X509_NAME* name) {
+	/* The canonical encoding's hash, so equal names under different encodings collide */
+	return((uint32_t)X509_NAME_hash_ex(name, NULL, NULL, NULL)&(store->nBucket-1));
+}
+
+static uint32_t keyIdBucket(const trustStore_t* store, const ASN1_OCTET_STRING* keyId) {
+	return((uint32_t)hashBytes(ASN1_STRING_get0_data(keyId), ASN1_STRING_length(keyId), HASH_SEED)
+			&(store->nBucket-1));
+}
+
+static int verifyChain(trustStore_t* store, X509* cert, int depth) {
+	/**
+	 * Find the issuer of <cert>, <depth> certificates below the leaf, and
+	 * verify the chain from it
+	 *
+	 * Candidates sharing its authority key identifier are tried first, then
+	 * those with its issuer name, covering CAs without a key identifier.
+	 */
+	const ASN1_OCTET_STRING* keyId=X509_get0_authority_key_id(cert);
+	int status=CHAIN_UNKNOWN_ISSUER;
+
+	if(depth>=TRUST_MAX_DEPTH){
+		return(CHAIN_DEPTH_EXCEEDED);
+	}
+	if(keyId!=NULL){
+		for(trustEntry_t* issuer=store->byKeyId[keyIdBucket(store, keyId)];issuer!=NULL;
+				issuer=issuer->nextByKeyId){
+			if(trySignedBy(store, cert, issuer, depth, &status)){
+				return(status);
+			}
+		}
+	}
+	uint32_t bucket=nameBucket(store, X509_get_issuer_name(cert));
+	for(trustEntry_t* issuer=store->byName[bucket];issuer!=NULL;issuer=issuer->nextByName){
+		const ASN1_OCTET_STRING* issuerKeyId=X509_get0_subject_key_id(issuer->cert);
+		int tried=(keyId!=NULL && issuerKeyId!=NULL && ASN1_OCTET_STRING_cmp(keyId, issuerKeyId)==0);
+		if(!tried && trySignedBy(store, cert, issuer, depth, &status)){
+			return(status);
+		}
+	}
+	return(status);
+}
+
+static int trySignedBy(trustStore_t* store, X509* cert, trustEntry_t* issuer, int depth,
+		int* status) {
+	/**
+	 * Try <issuer> as the issuer of <cert>
+	 *
+	 * ARGS:
+	 * 	status - the best status so far, raised to what <issuer> gives.
+	 * 	Once a chain is cut off it stays CHAIN_DEPTH_EXCEEDED unless
+	 * 	another issuer is trusted.
+	 *
+	 * RETN:
+	 * 	1 if <cert> is trusted through <issuer>, so no other need be tried
+	 */
+	if(X509_check_issued(issuer->cert, cert)!=X509_V_OK){
+		return(0);
+	}
+	__atomic_fetch_add(&store->nSignature, 1, __ATOMIC_RELAXED);
+	if(X509_verify(cert, issuer->key)!=1){
+		if(*status==CHAIN_UNKNOWN_ISSUER){
+			*status=CHAIN_BAD_SIGNATURE;
+		}
+		return(0);
+	}
+	int signerStatus=issuerStatus(store, issuer, depth+1);
+	if(signerStatus==CHAIN_TRUSTED || *status!=CHAIN_DEPTH_EXCEEDED){
+		*status=signerStatus;
+	}
+	return(*status==CHAIN_TRUSTED);
+}
+
+static int issuerStatus(trustStore_t* store, trustEntry_t* issuer, int depth) {
+	/**
+	 * Status of certificates signed by <issuer>: trusted if it is a root or
+	 * an intermediate verified up to one, verified now unless done before
+	 *
+	 * RETN:
+	 * 	CHAIN_TRUSTED, CHAIN_UNTRUSTED_ISSUER, or CHAIN_DEPTH_EXCEEDED if
+	 * 	the chain above <issuer> was cut off at <depth>, which is not kept
+	 */
+	int status=__atomic_load_n(&issuer->status, __ATOMIC_ACQUIRE);
+	if(status!=CHAIN_NOT_CHECKED){
+		__atomic_fetch_add(&store->nIssuerReused, 1, __ATOMIC_RELAXED);
+		return((status==CHAIN_TRUSTED)?CHAIN_TRUSTED:CHAIN_UNTRUSTED_ISSUER);
+	}
+	status=verifyChain(store, issuer->cert, depth);
+	if(status==CHAIN_DEPTH_EXCEEDED){
+		return(CHAIN_DEPTH_EXCEEDED);
+	}
+	__atomic_store_n(&issuer->status, status, __ATOMIC_RELEASE);
+	return((status==CHAIN_TRUSTED)?CHAIN_TRUSTED:CHAIN_UNTRUSTED_ISSUER);
+}
+
+static void* trustMalloc(size_t size) {
+	void* memory=malloc(size);
+	if(memory==NULL){
+		trustMallocFail();
+	}
+	return(memory);
+}
+
+static void trustMallocFail(void) {
+	mylog("Malloc failed to allocate memory. Program terminating");
+	exit(EXIT_TRUST_MALLOC_FAIL);
+}
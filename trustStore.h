@@ -0,0 +1,63 @@
+/*
+ * trustStore.h
+ *
+ * Issuer chain verification against local CA certificates, see trustStore.c.
+ */
+
+#ifndef TRUSTSTORE_H_
+#define TRUSTSTORE_H_
+
+#include <openssl/opensslv.h>
+#include <openssl/x509.h>
+
+#include <stdint.h>
+
+/* Names are bucketed with X509_NAME_hash_ex */
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+#error "certcheck requires OpenSSL 3.0 or later"
+#endif
+
+/* Chain status of a certificate, as written to the chain column */
+#define CHAIN_NOT_CHECKED 0		/* No trust store */
+#define CHAIN_TRUSTED 1			/* Signed by a CA chaining to a root of the store */
+#define CHAIN_UNKNOWN_ISSUER 2		/* No CA of the store could have issued it */
+#define CHAIN_BAD_SIGNATURE 3		/* Its issuers' keys do not verify its signature */
+#define CHAIN_UNTRUSTED_ISSUER 4	/* Its issuer does not itself chain to a root */
+#define CHAIN_STATUS_COUNT 5
+
+/* Intermediates further than this from a root are not trusted */
+#define TRUST_MAX_DEPTH 8
+
+/* A CA certificate of the store. Roots are trusted as they are; an
+ * intermediate once it is verified up to a root, which is done once and kept
+ * in <status>. */
+typedef struct trust_entry trustEntry_t;
+struct trust_entry {
+	X509* cert;
+	EVP_PKEY* key;			/* Borrowed from <cert>, decoded once when loaded */
+	int root;			/* Self issued, and so a trust anchor */
+	int status;			/* CHAIN_* of an intermediate, CHAIN_NOT_CHECKED until verified */
+	trustEntry_t* nextByName;	/* Next entry in the same subject bucket */
+	trustEntry_t* nextByKeyId;	/* Next entry in the same key id bucket */
+};
+
+/* CA certificates read once from a directory or bundle, indexed by subject
+ * name hash and subject key identifier for finding a certificate's issuer */
+typedef struct trust_store trustStore_t;
+struct trust_store {
+	trustEntry_t* entry;
+	int nEntry;
+	trustEntry_t** byName;
+	trustEntry_t** byKeyId;
+	uint32_t nBucket;		/* Of each index, a power of 2 */
+	uint64_t fingerprint;		/* Of the certificates held, for keying outcomes */
+	long nSignature;		/* Signatures verified */
+	long nIssuerReused;		/* Issuers found already verified */
+};
+
+trustStore_t* openTrustStore(const char* path);
+void closeTrustStore(trustStore_t* store);
+int verify_trustStore(trustStore_t* store, X509* cert);
+const char* chainStatusName(int status);
+
+#endif /* TRUSTSTORE_H_ */
@@ -0,0 +1,113 @@
+/*
+ * arena.c
+ *
+ * Bump allocator for temporaries freed all at once, reset after each row.
+ */
+
+#include "arena.h"
+#include "logger.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGNMENT (sizeof(max_align_t))
+#define EXIT_ARENA_MALLOC_FAIL 114
+
+static arenaBlock_t* createBlock(size_t size);
+
+arena_t* create_arena(size_t blockSize) {
+	/**
+	 * Create an arena whose first block holds <blockSize> bytes
+	 */
+	arena_t* arena=malloc(sizeof(*arena));
+	if(arena==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_ARENA_MALLOC_FAIL);
+	}
+	arena->blockSize=blockSize;
+	arena->head=arena->current=createBlock(blockSize);
+	return(arena);
+}
+
+void* alloc_arena(arena_t* arena, size_t size) {
+	/**
+	 * Return <size> bytes of <arena>, aligned for any type. Valid until the
+	 * arena is reset or deleted.
+	 */
+	size=(size+ARENA_ALIGNMENT-1)&~(ARENA_ALIGNMENT-1);
+
+	/* Move on to a later block with room, adding one if none */
+	while(arena->current->used+size>arena->current->size){
+		if(arena->current->next==NULL){
+			size_t blockSize=(size>arena->blockSize)?size:arena->blockSize;
+			arena->current->next=createBlock(blockSize);
+		}
+		arena->current=arena->current->next;
+	}
+
+	void* memory=arena->current->data+arena->current->used;
+	arena->current->used+=size;
+	return(memory);
+}
+
+char* strndup_arena(arena_t* arena, const char* s, size_t length) {
+	/**
+	 * Return a null terminated copy of <length> chars of <s> in <arena>
+	 */
+	char* copy=alloc_arena(arena, length+1);
+	memcpy(copy, s, length);
+	copy[length]='\0';
+	return(copy);
+}
+
+void reset_arena(arena_t* arena) {
+	/**
+	 * Release every allocation of <arena> at once
+	 *
+	 * If the arena outgrew its first block, later blocks are freed and the
+	 * first block is replaced by one large enough for that peak, so memory
+	 * held stays constant from one use to the next.
+	 */
+	if(arena->head->next!=NULL){
+		size_t peak=0;
+		arenaBlock_t* block=arena->head;
+		while(block!=NULL){
+			arenaBlock_t* next=block->next;
+			peak+=block->used;
+			free(block);
+			block=next;
+		}
+		if(peak>arena->blockSize){
+			arena->blockSize=peak;
+		}
+		arena->head=createBlock(arena->blockSize);
+	}
+	arena->head->used=0;
+	arena->current=arena->head;
+}
+
+void delete_arena(void* arena) {
+	/**
+	 * Free <arena> and all its blocks. Takes void* to serve as a destructor.
+	 */
+	if(arena==NULL){return;}
+	arenaBlock_t* block=((arena_t*)arena)->head;
+	while(block!=NULL){
+		arenaBlock_t* next=block->next;
+		free(block);
+		block=next;
+	}
+	free(arena);
+}
+
+static arenaBlock_t* createBlock(size_t size) {
+	arenaBlock_t* block=malloc(sizeof(*block)+size);
+	if(block==NULL){
+		mylog("Malloc failed to allocate memory. Program terminating");
+		exit(EXIT_ARENA_MALLOC_FAIL);
+	}
+	block->next=NULL;
+	block->size=size;
+	block->used=0;
+	return(block);
+}
@@ -0,0 +1,37 @@
+/*
+ * arena.h
+ *
+ * Bump allocator for temporaries freed all at once, see arena.c.
+ */
+
+#ifndef UTILITY_ARENA_H_
+#define UTILITY_ARENA_H_
+
+#include <stddef.h>
+
+#define ARENA_DEFAULT_BLOCK_SIZE 4096
+
+/* Bump allocator. Allocations are not freed individually, the whole arena is
+ * reset in one operation once none of them are needed. */
+typedef struct arena_block arenaBlock_t;
+struct arena_block {
+	arenaBlock_t* next;
+	size_t size;		/* bytes of <data> */
+	size_t used;
+	_Alignas(max_align_t) char data[];
+};
+
+typedef struct arena arena_t;
+struct arena {
+	arenaBlock_t* head;
+	arenaBlock_t* current;	/* Block allocations are made from */
+	size_t blockSize;		/* Size of the first block, grows to fit peak use */
+};
+
+arena_t* create_arena(size_t blockSize);
+void* alloc_arena(arena_t* arena, size_t size);
+char* strndup_arena(arena_t* arena, const char* s, size_t length);
+void reset_arena(arena_t* arena);
+void delete_arena(void* arena);
+
+#endif /* UTILITY_ARENA_H_ */
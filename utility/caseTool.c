@@ -0,0 +1,268 @@
+/*
+ * caseTool.c
+ *
+ * ASCII case folding and case insensitive comparison of names, with SSE2 and
+ * AVX2 kernels on x86-64 and a scalar one elsewhere. The kernel is picked
+ * from the CPU the first time one is needed, so one build runs anywhere.
+ *
+ * Only 'A' to 'Z' are folded; other bytes, including those of UTF-8, compare
+ * as is. Vector kernels finish a name that is not a whole number of vectors
+ * with one last vector overlapping the previous. Names shorter than a vector
+ * are left to the next smaller kernel; under 16 bytes the scalar one is
+ * called directly, as dispatch would cost more than the bytes.
+ */
+#include "caseTool.h"
+
+#if defined(__x86_64__)
+#define CASE_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+#define CASE_BIT 0x20
+#define SSE2_WIDTH 16
+#define AVX2_WIDTH 32
+
+typedef struct case_kernel_table caseKernelTable_t;
+struct case_kernel_table {
+	const char* name;
+	size_t (*fold)(char* folded, const char* s, size_t length);
+	int (*equal)(const char* a, const char* b, size_t length);
+};
+
+static size_t foldScalar(char* folded, const char* s, size_t length);
+static int equalScalar(const char* a, const char* b, size_t length);
+#ifdef CASE_KERNEL_X86
+static size_t foldSse2(char* folded, const char* s, size_t length);
+static int equalSse2(const char* a, const char* b, size_t length);
+static size_t foldAvx2(char* folded, const char* s, size_t length);
+static int equalAvx2(const char* a, const char* b, size_t length);
+#endif
+static int kernelSupported(int kernel);
+static int resolveKernel(void);
+
+static const caseKernelTable_t kernelTable[]={
+	[CASE_KERNEL_SCALAR]={ "scalar", foldScalar, equalScalar },
+#ifdef CASE_KERNEL_X86
+	[CASE_KERNEL_SSE2]={ "sse2", foldSse2, equalSse2 },
+	[CASE_KERNEL_AVX2]={ "avx2", foldAvx2, equalAvx2 },
+#endif
+};
+
+/* Kernel in use, -1 until resolved */
+static int kernelInUse=-1;
+
+size_t foldBytes(char* folded, const char* s, size_t length) {
+	/**
+	 * Copy the <length> bytes of <s> to <folded> lower cased, finding the
+	 * first '.' on the way. <folded> may be <s>.
+	 *
+	 * RETN:
+	 * 	Offset of the first '.' of <s>, <length> if there is none
+	 */
+	if(length<SSE2_WIDTH){
+		return(foldScalar(folded, s, length));
+	}
+	int kernel=__atomic_load_n(&kernelInUse, __ATOMIC_RELAXED);
+	if(kernel<0){
+		kernel=resolveKernel();
+	}
+	return(kernelTable[kernel].fold(folded, s, length));
+}
+
+int equalFolded(const char* a, const char* b, size_t length) {
+	/**
+	 * RETN:
+	 * 	1 if the <length> bytes of <a> and <b> are equal but for ASCII case, else 0
+	 */
+	if(length<SSE2_WIDTH){
+		return(equalScalar(a, b, length));
+	}
+	int kernel=__atomic_load_n(&kernelInUse, __ATOMIC_RELAXED);
+	if(kernel<0){
+		kernel=resolveKernel();
+	}
+	return(kernelTable[kernel].equal(a, b, length));
+}
+
+int caseKernel(void) {
+	/**
+	 * Return the CASE_KERNEL_* in use, picking one if none has been yet
+	 */
+	int kernel=__atomic_load_n(&kernelInUse, __ATOMIC_RELAXED);
+	return((kernel<0)?resolveKernel():kernel);
+}
+
+int useCaseKernel(int kernel) {
+	/**
+	 * Use the CASE_KERNEL_* <kernel> from now on, for benchmarks and tests
+	 *
+	 * RETN:
+	 * 	1, or 0 leaving the kernel unchanged if this CPU cannot run <kernel>
+	 */
+	if(!kernelSupported(kernel)){
+		return(0);
+	}
+	__atomic_store_n(&kernelInUse, kernel, __ATOMIC_RELAXED);
+	return(1);
+}
+
+const char* caseKernelName(int kernel) {
+	return(kernelSupported(kernel)?kernelTable[kernel].name:"unsupported");
+}
+
+static int kernelSupported(int kernel) {
+	switch(kernel){
+	case CASE_KERNEL_SCALAR:
+		return(1);
+#ifdef CASE_KERNEL_X86
+	case CASE_KERNEL_SSE2:
+		/* Part of x86-64 */
+		return(1);
+	case CASE_KERNEL_AVX2:
+		__builtin_cpu_init();
+		return(__builtin_cpu_supports("avx2"));
+#endif
+	default:
+		return(0);
+	}
+}
+
+static int resolveKernel(void) {
+	/**
+	 * Pick the widest kernel this CPU runs. Threads racing here pick the same.
+	 */
+	int kernel=CASE_KERNEL_SCALAR;
+	if(kernelSupported(CASE_KERNEL_AVX2)){
+		kernel=CASE_KERNEL_AVX2;
+	} else if(kernelSupported(CASE_KERNEL_SSE2)){
+		kernel=CASE_KERNEL_SSE2;
+	}
+	__atomic_store_n(&kernelInUse, kernel, __ATOMIC_RELAXED);
+	return(kernel);
+}
+
+static char foldChar(char c) {
+	return((c>='A' && c<='Z')?(char)(c|CASE_BIT):c);
+}
+
+static size_t foldScalar(char* folded, const char* s, size_t length) {
+	size_t dot=length;
+	for(size_t ix=0;ix<length;ix++){
+		char c=s[ix];
+		if(c=='.' && dot==length){
+			dot=ix;
+		}
+		folded[ix]=foldChar(c);
+	}
+	return(dot);
+}
+
+static int equalScalar(const char* a, const char* b, size_t length) {
+	for(size_t ix=0;ix<length;ix++){
+		if(foldChar(a[ix])!=foldChar(b[ix])){
+			return(0);
+		}
+	}
+	return(1);
+}
+
+#ifdef CASE_KERNEL_X86
+
+static inline __m128i foldVector128(__m128i v) {
+	/* Bytes above 0x7f are negative, so never taken for upper case */
+	__m128i upper=_mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A'-1)),
+			_mm_cmplt_epi8(v, _mm_set1_epi8('Z'+1)));
+	return(_mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(CASE_BIT))));
+}
+
+static size_t foldSse2(char* folded, const char* s, size_t length) {
+	/**
+	 * As foldScalar, 16 bytes at a time
+	 */
+	if(length<SSE2_WIDTH){
+		return(foldScalar(folded, s, length));
+	}
+	const __m128i dot=_mm_set1_epi8('.');
+	size_t firstDot=length;
+	size_t ix=0;
+	for(;ix<length;ix+=SSE2_WIDTH){
+		/* The last vector overlaps the one before, its bytes before <ix> are seen */
+		size_t start=(ix+SSE2_WIDTH<=length)?ix:length-SSE2_WIDTH;
+		__m128i v=_mm_loadu_si128((const __m128i*)(s+start));
+		unsigned dots=(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, dot))>>(ix-start);
+		_mm_storeu_si128((__m128i*)(folded+start), foldVector128(v));
+		if(dots!=0 && firstDot==length){
+			firstDot=ix+__builtin_ctz(dots);
+		}
+	}
+	return(firstDot);
+}
+
+static int equalSse2(const char* a, const char* b, size_t length) {
+	/**
+	 * As equalScalar, 16 bytes at a time
+	 */
+	if(length<SSE2_WIDTH){
+		return(equalScalar(a, b, length));
+	}
+	for(size_t ix=0;ix<length;ix+=SSE2_WIDTH){
+		size_t start=(ix+SSE2_WIDTH<=length)?ix:length-SSE2_WIDTH;
+		__m128i va=foldVector128(_mm_loadu_si128((const __m128i*)(a+start)));
+		__m128i vb=foldVector128(_mm_loadu_si128((const __m128i*)(b+start)));
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))!=0xffff){
+			return(0);
+		}
+	}
+	return(1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i foldVector256(__m256i v) {
+	__m256i upper=_mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A'-1)),
+			_mm256_cmpgt_epi8(_mm256_set1_epi8('Z'+1), v));
+	return(_mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(CASE_BIT))));
+}
+
+__attribute__((target("avx2")))
+static size_t foldAvx2(char* folded, const char* s, size_t length) {
+	/**
+	 * As foldScalar, 32 bytes at a time
+	 */
+	if(length<AVX2_WIDTH){
+		return(foldSse2(folded, s, length));
+	}
+	const __m256i dot=_mm256_set1_epi8('.');
+	size_t firstDot=length;
+	size_t ix=0;
+	for(;ix<length;ix+=AVX2_WIDTH){
+		size_t start=(ix+AVX2_WIDTH<=length)?ix:length-AVX2_WIDTH;
+		__m256i v=_mm256_loadu_si256((const __m256i*)(s+start));
+		unsigned dots=(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, dot))>>(ix-start);
+		_mm256_storeu_si256((__m256i*)(folded+start), foldVector256(v));
+		if(dots!=0 && firstDot==length){
+			firstDot=ix+__builtin_ctz(dots);
+		}
+	}
+	return(firstDot);
+}
+
+__attribute__((target("avx2")))
+static int equalAvx2(const char* a, const char* b, size_t length) {
+	/**
+	 * As equalScalar, 32 bytes at a time
+	 */
+	if(length<AVX2_WIDTH){
+		return(equalSse2(a, b, length));
+	}
+	for(size_t ix=0;ix<length;ix+=AVX2_WIDTH){
+		size_t start=(ix+AVX2_WIDTH<=length)?ix:length-AVX2_WIDTH;
+		__m256i va=foldVector256(_mm256_loadu_si256((const __m256i*)(a+start)));
+		__m256i vb=foldVector256(_mm256_loadu_si256((const __m256i*)(b+start)));
+		if((unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb))!=0xffffffffu){
+			return(0);
+		}
+	}
+	return(1);
+}
+
+#endif /* CASE_KERNEL_X86 */
@@ -0,0 +1,23 @@
+/*
+ * caseTool.h
+ *
+ * ASCII case folding kernels, see caseTool.c.
+ */
+
+#ifndef UTILITY_CASETOOL_H_
+#define UTILITY_CASETOOL_H_
+
+#include <stddef.h>
+
+/* Implementations of the kernels, chosen once from the CPU on first use */
+#define CASE_KERNEL_SCALAR 0
+#define CASE_KERNEL_SSE2 1
+#define CASE_KERNEL_AVX2 2
+
+size_t foldBytes(char* folded, const char* s, size_t length);
+int equalFolded(const char* a, const char* b, size_t length);
+int caseKernel(void);
+int useCaseKernel(int kernel);
+const char* caseKernelName(int kernel);
+
+#endif /* UTILITY_CASETOOL_H_ */
@@ -6,109 +6,75 @@
  *   Student #: 834198
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#include "csvTool.h"
 #include "dataStructure.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
 #define CSV_BUFFER_SIZE 1024
 #define CSV_DEFAULT_FS ','
+#define CSV_ROW_DELIMITER '\n'
+#define CSV_ROW_VIEW_INIT_SIZE 4
+#define EXIT_CSV_MALLOC_FAIL 113
+
+/* Name given to read from standard input, or write to standard output */
+#define CSV_STDIN_PATH "-"
+#define CSV_STDOUT_PATH "-"
+
+#define CSV_OUTPUT_MODE 0644
+
+static char* readAll(int fd, size_t* length);
+static int writeAll(int fd, struct iovec* part, int nPart);
+static void bufferBytes(csvWriter_t* csv, const char* data, size_t length);
+static void csvMallocFail(void);
 
 dsa_t* readRow(FILE* csv) {
 	/**
 	 * Read a row of <csv> and return its cells as an array.
 	 *
-	 * A row is read in a buffered manner. Rows may be delimited with
-	 * '\n' or an EOF. Cells are delimited with CSV_DEFUALT_FS or row
-	 * delimiters.
+	 * Rows may be delimited with '\n' or an EOF. Cells are delimited with
+	 * CSV_DEFAULT_FS or row delimiters.
 	 *
-	 * Empty rows are ignored, and the next row is read
+	 * Empty rows are ignored, and the next row is read. This copies every
+	 * cell, prefer readRowView for large inputs.
 	 */
+	char* line=NULL;
+	size_t capacity=0;
+	ssize_t length;
+	csvRowView_t view;
 
-	if (feof(csv)!=0) {return(NULL);}
-
-	char buffer[CSV_BUFFER_SIZE];
-	dsa_t* leftoverBuffer=create_dsa();
-	char* leftover;
-	char* leftoverScanner;
-	char* bufferScanner;
-	char* cellEnd;
-	char* cellStart=buffer;
-	char* cell;
-	dsa_t* rowData = create_dsa();
-	int cellLength;
-	int leftoverLength=0;
-	int lastCellLength=0;
-	int haveRow=0;
-	int eofReached;
-
-	/* Read in text of csv file */
+	/* Skip empty rows */
 	do{
-		fgets(buffer, CSV_BUFFER_SIZE, csv);
-
-		/* Move to the next row if current row empty */
-		if(strlen(buffer)==0){return(readRow(csv));}
-
-		/* Test for remaining row data */
-		if ((buffer[strlen(buffer)-1]=='\n') || (feof(csv)!=0)){haveRow=1;}
-		bufferScanner=buffer;
-
-		/* Break text into cells and write to dsa */
-		while((cellEnd=strchr(bufferScanner, CSV_DEFAULT_FS))!=NULL){
-
-			cellLength=cellEnd-cellStart;
-			cell = malloc(sizeof(char)*(cellLength+1));
-
-			/* This cell contains the leftover from prior fgets reads that did not complete the line*/
-			if (leftoverBuffer->length>0) {
-
-				/* Find leftover length */
-				leftoverLength=0;
-				for(int lx=0;lx<leftoverBuffer->length-1;lx++){
-					leftoverLength+=strlen(getItem_dsa(leftoverBuffer,lx));
-				}
-
-				/* Reassemble leftover */
-				leftover=leftoverScanner=malloc(sizeof(char)*(leftoverLength+1));
-				for(int lx=(leftoverBuffer->length-1);lx>=0;lx--){
-					const char* leftoverFragment=getItem_dsa(leftoverBuffer, lx);
-					strcat(leftoverScanner, leftoverFragment);
-					leftoverScanner+=strlen(leftoverFragment);
-				}
-
-				/* Put leftover in cell, and clear leftover buffer */
-				cell = realloc(cell, sizeof(char)*(leftoverLength+cellLength+1));
-				memcpy(cell, leftoverScanner, leftoverLength);
-				cell+=leftoverLength;
-				delete_dsa(leftoverBuffer);
-				leftoverBuffer=create_dsa();
-			} // break up cells while
-
-			/* Extract cell from row */
-			memcpy(cell, bufferScanner, cellLength);
-			cell[cellLength]='\0';
-			/* Jump up to last FS match, and one beyond it */
-			bufferScanner+=cellLength+1;
-			appendto_dsa(rowData, cell);
+		length=getline(&line, &capacity, csv);
+		if(length>0 && line[length-1]==CSV_ROW_DELIMITER){
+			length--;
 		}
+	} while(length==0);
 
-		/* Stash leftover if we dont have the whole cell */
-		if(!haveRow){
-			appendto_dsa(leftoverBuffer, cellEnd+1);
-
-		/* Extract final cell, which is delimited with \n or EOF */
-		} else {
-			/* This does not include the final new line if present */
-			eofReached = (feof(csv)!=0);
-			lastCellLength = (buffer+strlen(buffer))-bufferScanner-!eofReached;
-			cell = malloc(sizeof(char)*(lastCellLength+1));
-			memcpy(cell, bufferScanner, lastCellLength);
-			cell[lastCellLength]='\0';
-			appendto_dsa(rowData, cell);
-		}
-	} while(!haveRow);
+	if(length<0){
+		free(line);
+		return(NULL);
+	}
+
+	/* Copy cells into the array */
+	initRowView(&view);
+	splitRowView(line, length, &view);
 
-	delete_dsa(leftoverBuffer);
+	dsa_t* rowData = create_dsa();
+	for(int ix=0;ix<view.length;ix++){
+		appendBytes_dsa(rowData, view.cell[ix].data, view.cell[ix].length);
+	}
+
+	freeRowView(&view);
+	free(line);
 	return(rowData);
 }
 
@@ -124,3 +90,344 @@ void writeRow(FILE* csv, dsa_t* row) {
 	}
 	fputc('\n', csv);
 }
+
+csvMap_t* openCsvMap(const char* path) {
+	/**
+	 * Open the csv file at <path> for reading with readRowView
+	 *
+	 * Regular files are memory mapped, so rows are read without copying.
+	 * Other files (pipes, or standard input named as "-") are read into
+	 * memory whole.
+	 *
+	 * RETN:
+	 * 	Opened file, close with closeCsvMap. NULL if it could not be read.
+	 */
+	struct stat fileStat;
+	int fd=(strcmp(path, CSV_STDIN_PATH)==0)?dup(STDIN_FILENO):open(path, O_RDONLY);
+	if(fd<0){return(NULL);}
+
+	csvMap_t* csv=malloc(sizeof(*csv));
+	if(csv==NULL){
+		csvMallocFail();
+	}
+	csv->position=0;
+	csv->mapped=0;
+	csv->data=NULL;
+	csv->length=0;
+
+	if(fstat(fd, &fileStat)==0 && S_ISREG(fileStat.st_mode) && fileStat.st_size>0){
+		void* data=mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data!=MAP_FAILED){
+			madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+			csv->data=data;
+			csv->length=fileStat.st_size;
+			csv->mapped=1;
+		}
+	}
+
+	if(!csv->mapped){
+		csv->data=readAll(fd, &csv->length);
+		if(csv->data==NULL){
+			free(csv);
+			csv=NULL;
+		}
+	}
+	close(fd);
+	return(csv);
+}
+
+void closeCsvMap(csvMap_t* csv) {
+	/**
+	 * Release <csv>, invalidating every view read from it
+	 */
+	if(csv==NULL){return;}
+	if(csv->mapped){
+		munmap((void*)csv->data, csv->length);
+	} else {
+		free((void*)csv->data);
+	}
+	free(csv);
+}
+
+int readRowView(csvMap_t* csv, csvRowView_t* row) {
+	/**
+	 * Read the next row of <csv> into <row>, as with readRow.
+	 *
+	 * Cells point into <csv> and stay valid until it is closed. No memory is
+	 * allocated unless the row has more cells than <row> has held before.
+	 *
+	 * RETN:
+	 * 	1 if a row was read, 0 at the end of <csv>
+	 */
+	while(csv->position<csv->length){
+		const char* line=csv->data+csv->position;
+		size_t remaining=csv->length-csv->position;
+		const char* lineEnd=memchr(line, CSV_ROW_DELIMITER, remaining);
+		size_t length=(lineEnd==NULL)?remaining:(size_t)(lineEnd-line);
+
+		csv->position+=length+(lineEnd!=NULL);
+
+		/* Skip empty rows */
+		if(length>0){
+			splitRowView(line, length, row);
+			return(1);
+		}
+	}
+	return(0);
+}
+
+void splitRowView(const char* line, size_t length, csvRowView_t* row) {
+	/**
+	 * Set <row> to the cells of the <length> chars at <line>, which hold
+	 * one row without its delimiter
+	 */
+	const char* lineEnd=line+length;
+	const char* cellEnd;
+
+	row->length=0;
+	while((cellEnd=memchr(line, CSV_DEFAULT_FS, lineEnd-line))!=NULL){
+		appendCellView(row, line, cellEnd-line);
+		line=cellEnd+1;
+	}
+	appendCellView(row, line, lineEnd-line);
+}
+
+void appendCellView(csvRowView_t* row, const char* data, size_t length) {
+	/**
+	 * Add a cell to the end of <row>. <data> is referenced, not copied.
+	 */
+	if(row->length==row->size){
+		int size=(row->size==0)?CSV_ROW_VIEW_INIT_SIZE:row->size*2;
+		csvCell_t* cell=realloc(row->cell, sizeof(csvCell_t)*size);
+		if(cell==NULL){
+			csvMallocFail();
+		}
+		row->cell=cell;
+		row->size=size;
+	}
+	row->cell[row->length].data=data;
+	row->cell[row->length].length=length;
+	row->length++;
+}
+
+void initRowView(csvRowView_t* row) {
+	row->cell=NULL;
+	row->length=0;
+	row->size=0;
+}
+
+void freeRowView(csvRowView_t* row) {
+	free(row->cell);
+	initRowView(row);
+}
+
+void writeRowView(FILE* csv, const csvRowView_t* row) {
+	/**
+	 * Write the cells of <row> into <csv>
+	 */
+	for(int ix=0;ix<row->length;ix++){
+		if(ix!=0){fputc(CSV_DEFAULT_FS, csv);}
+		fwrite(row->cell[ix].data, sizeof(char), row->cell[ix].length, csv);
+	}
+	fputc('\n', csv);
+}
+
+csvWriter_t* openCsvWriter(const char* path, size_t flushAt) {
+	/**
+	 * Open <path> for writing rows with writeRowBuffered, truncating it
+	 *
+	 * Works alike for files, pipes and standard output (named as "-").
+	 *
+	 * ARGS:
+	 * 	flushAt - bytes to buffer before writing out. 0 writes every row
+	 * 	as it is given, for consumers reading the output as it is made.
+	 *
+	 * RETN:
+	 * 	Writer, close with closeCsvWriter. NULL if <path> could not be opened.
+	 */
+	int toStdout=(strcmp(path, CSV_STDOUT_PATH)==0);
+	int fd=toStdout?STDOUT_FILENO:open(path, O_WRONLY|O_CREAT|O_TRUNC, CSV_OUTPUT_MODE);
+	if(fd<0){return(NULL);}
+
+	return(openCsvWriterFd(fd, !toStdout, flushAt));
+}
+
+csvWriter_t* openCsvWriterFd(int fd, int ownsFd, size_t flushAt) {
+	/**
+	 * Write rows with writeRowBuffered to the open descriptor <fd>, such as
+	 * a socket. <fd> is closed by closeCsvWriter if <ownsFd>.
+	 *
+	 * RETN:
+	 * 	Writer, close with closeCsvWriter
+	 */
+	csvWriter_t* csv=malloc(sizeof(*csv));
+	if(csv==NULL){
+		csvMallocFail();
+	}
+	csv->fd=fd;
+	csv->ownsFd=ownsFd;
+	csv->flushAt=flushAt;
+	csv->capacity=(flushAt>CSV_WRITER_DEFAULT_CAPACITY)?flushAt:CSV_WRITER_DEFAULT_CAPACITY;
+	csv->length=0;
+	csv->buffer=malloc(csv->capacity);
+	if(csv->buffer==NULL){
+		csvMallocFail();
+	}
+	return(csv);
+}
+
+int writeRowBuffered(csvWriter_t* csv, const csvRowView_t* row) {
+	/**
+	 * Write the cells of <row> into <csv>
+	 *
+	 * The row is formatted into the writer's buffer, which is written out
+	 * once it holds flushAt bytes. A cell too large for the buffer is written
+	 * straight from where it lies, together with what is buffered.
+	 *
+	 * RETN:
+	 * 	0, or -1 if writing failed
+	 */
+	const char separator=CSV_DEFAULT_FS;
+	const char delimiter=CSV_ROW_DELIMITER;
+
+	for(int ix=0;ix<row->length;ix++){
+		const csvCell_t* cell=&row->cell[ix];
+
+		if(ix!=0){
+			if(csv->length==csv->capacity && flushCsvWriter(csv)!=0){return(-1);}
+			bufferBytes(csv, &separator, 1);
+		}
+
+		/* Large cell, gather it with the buffer rather than copying */
+		if(cell->length>csv->capacity-csv->length){
+			struct iovec part[2]={
+				{ .iov_base=csv->buffer, .iov_len=csv->length },
+				{ .iov_base=(void*)cell->data, .iov_len=cell->length }
+			};
+			if(writeAll(csv->fd, part, 2)!=0){return(-1);}
+			csv->length=0;
+			continue;
+		}
+		bufferBytes(csv, cell->data, cell->length);
+	}
+
+	if(csv->length==csv->capacity && flushCsvWriter(csv)!=0){return(-1);}
+	bufferBytes(csv, &delimiter, 1);
+
+	if(csv->length>=csv->flushAt){
+		return(flushCsvWriter(csv));
+	}
+	return(0);
+}
+
+int writeNumberedRowBuffered(csvWriter_t* csv, long number, const csvRowView_t* row) {
+	/**
+	 * Write <row> into <csv> as writeRowBuffered does, after a first cell
+	 * holding <number>
+	 *
+	 * RETN:
+	 * 	0, or -1 if writing failed
+	 */
+	char prefix[CSV_NUMBER_CELL_LEN];
+	int length=snprintf(prefix, sizeof(prefix), "%ld%c", number, CSV_DEFAULT_FS);
+
+	if(csv->capacity-csv->length<(size_t)length && flushCsvWriter(csv)!=0){return(-1);}
+	bufferBytes(csv, prefix, length);
+	return(writeRowBuffered(csv, row));
+}
+
+int flushCsvWriter(csvWriter_t* csv) {
+	/**
+	 * Write out everything buffered by <csv>
+	 *
+	 * RETN:
+	 * 	0, or -1 if writing failed
+	 */
+	struct iovec part={ .iov_base=csv->buffer, .iov_len=csv->length };
+	if(csv->length>0 && writeAll(csv->fd, &part, 1)!=0){
+		return(-1);
+	}
+	csv->length=0;
+	return(0);
+}
+
+int closeCsvWriter(csvWriter_t* csv) {
+	/**
+	 * Flush and free <csv>
+	 *
+	 * RETN:
+	 * 	0, or -1 if writing failed
+	 */
+	if(csv==NULL){return(0);}
+	int status=flushCsvWriter(csv);
+	if(csv->ownsFd && close(csv->fd)!=0){
+		status=-1;
+	}
+	free(csv->buffer);
+	free(csv);
+	return(status);
+}
+
+static void bufferBytes(csvWriter_t* csv, const char* data, size_t length) {
+	memcpy(csv->buffer+csv->length, data, length);
+	csv->length+=length;
+}
+
+static int writeAll(int fd, struct iovec* part, int nPart) {
+	/**
+	 * Write every byte of the <nPart> buffers of <part> to <fd>, continuing
+	 * after short writes and interrupts. <part> is consumed.
+	 */
+	while(nPart>0){
+		ssize_t nWritten=writev(fd, part, nPart);
+		if(nWritten<0){
+			if(errno==EINTR){continue;}
+			return(-1);
+		}
+
+		/* Skip past what was written */
+		while(nPart>0 && (size_t)nWritten>=part->iov_len){
+			nWritten-=part->iov_len;
+			part++;
+			nPart--;
+		}
+		if(nPart>0){
+			part->iov_base=(char*)part->iov_base+nWritten;
+			part->iov_len-=nWritten;
+		}
+	}
+	return(0);
+}
+
+static char* readAll(int fd, size_t* length) {
+	/**
+	 * Read <fd> until its end into a heap buffer, and set <length>
+	 */
+	size_t capacity=CSV_BUFFER_SIZE;
+	char* data=malloc(capacity);
+	ssize_t nRead;
+
+	*length=0;
+	while(data!=NULL && (nRead=read(fd, data+*length, capacity-*length))>0){
+		*length+=nRead;
+		if(*length==capacity){
+			capacity*=2;
+			char* grown=realloc(data, capacity);
+			if(grown==NULL){free(data);}
+			data=grown;
+		}
+	}
+	if(data==NULL){
+		csvMallocFail();
+	}
+	if(nRead<0){
+		free(data);
+		return(NULL);
+	}
+	return(data);
+}
+
+static void csvMallocFail(void) {
+	printf("Malloc failed to allocate memory. Program terminating\n");
+	exit(EXIT_CSV_MALLOC_FAIL);
+}
@@ -12,7 +12,64 @@
 #ifndef CSVTOOL_H_
 #define CSVTOOL_H_
 
+/* A cell of a row, pointing into the text it was read from. Not null terminated. */
+typedef struct csv_cell csvCell_t;
+struct csv_cell {
+	const char* data;
+	size_t length;
+};
+
+/* Cells of one row. The cell array is reused from row to row. */
+typedef struct csv_row_view csvRowView_t;
+struct csv_row_view {
+	csvCell_t* cell;
+	int length;		/* number of cells held */
+	int size;		/* cell capacity */
+};
+
+/* A whole csv file held in memory, mapped where possible */
+typedef struct csv_map csvMap_t;
+struct csv_map {
+	const char* data;
+	size_t length;
+	size_t position;	/* Start of the next unread row */
+	int mapped;			/* <data> is a mapping rather than heap memory */
+};
+
+/* Rows formatted into a large buffer and written in few system calls */
+typedef struct csv_writer csvWriter_t;
+struct csv_writer {
+	int fd;
+	int ownsFd;			/* Close <fd> on closeCsvWriter */
+	char* buffer;
+	size_t capacity;
+	size_t length;		/* Bytes buffered and not yet written */
+	size_t flushAt;		/* Write out once this many bytes are buffered */
+};
+
+/* Buffer held by a writer, flushes happen sooner if asked */
+#define CSV_WRITER_DEFAULT_CAPACITY (1024*1024)
+
+/* A row number cell and its separator, as written by writeNumberedRowBuffered */
+#define CSV_NUMBER_CELL_LEN 24
+
 dsa_t* readRow(FILE *f);
 void writeRow(FILE *f, dsa_t* row);
 
+csvMap_t* openCsvMap(const char* path);
+void closeCsvMap(csvMap_t* csv);
+int readRowView(csvMap_t* csv, csvRowView_t* row);
+void splitRowView(const char* line, size_t length, csvRowView_t* row);
+void appendCellView(csvRowView_t* row, const char* data, size_t length);
+void initRowView(csvRowView_t* row);
+void freeRowView(csvRowView_t* row);
+void writeRowView(FILE* f, const csvRowView_t* row);
+
+csvWriter_t* openCsvWriter(const char* path, size_t flushAt);
+csvWriter_t* openCsvWriterFd(int fd, int ownsFd, size_t flushAt);
+int writeRowBuffered(csvWriter_t* csv, const csvRowView_t* row);
+int writeNumberedRowBuffered(csvWriter_t* csv, long number, const csvRowView_t* row);
+int flushCsvWriter(csvWriter_t* csv);
+int closeCsvWriter(csvWriter_t* csv);
+
 #endif /* CSVTOOL_H_ */
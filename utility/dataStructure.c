@@ -9,31 +9,45 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <math.h>
 #include "dataStructure.h"
 
-# define DYN_ARRAY_INIT_LENGTH 2
 # define EXIT_MALLOC_FAIL 111
 
-int grow_array(void** array, int reqd_sz, size_t unit_sz);
-int get_newsize_geometric_growth(int required_size);
-void malloc_fail();
+static void reserve_items(dsa_t* array, int reqd_items);
+static void reserve_text(dsa_t* array, size_t reqd_bytes);
+static void write_bytes(dsa_t* array, const char* data, size_t length, int ix);
+static size_t get_newsize_geometric_growth(size_t size, size_t required_size);
+static void malloc_fail();
 
 void append_dsa(dsa_t* dest, dsa_t* source) {
 	/**
 	 * Assuming <dest> and <source> are contiguous, add the elements of <source> to <dest>
 	 */
+	assert(dest!=source);
 	for(int ix=0;ix<source->length;ix++){
-		writeto_dsa(dest, source->array[ix],dest->length);
+		const char* word=getItem_dsa(source, ix);
+		if(word!=NULL){
+			writeto_dsa(dest, word, dest->length);
+		} else {
+			reserve_items(dest, dest->length+1);
+			dest->offset[dest->length++]=DSA_NO_ITEM;
+		}
 	}
 }
 
-void appendto_dsa(dsa_t* array, char* word){
+void appendto_dsa(dsa_t* array, const char* word){
 	writeto_dsa(array, word, array->length);
 }
 
+void appendBytes_dsa(dsa_t* array, const char* data, size_t length){
+	/**
+	 * Append the <length> bytes at <data>, which need not be null terminated
+	 */
+	write_bytes(array, data, length, array->length);
+}
+
 void
-writeto_dsa(dsa_t *array, char* word, int ix){
+writeto_dsa(dsa_t *array, const char* word, int ix){
     /* DESC: Writes a string to dynamic string array at a given index. If a
      *       string already exists at the index, overwrites.
      *
@@ -43,37 +57,33 @@ writeto_dsa(dsa_t *array, char* word, int ix){
      *
      * OTPT: void
      */
+    write_bytes(array, word, strlen(word), ix);
+}
 
-    int new_size, fx;
-    int word_length=(int)strlen(word);
-    assert(array!=NULL);
+static void
+write_bytes(dsa_t* array, const char* data, size_t length, int ix){
+    /* DESC: Copies <length> bytes to the end of the packed text, null
+     *       terminated, and points element <ix> at them. Elements skipped
+     *       over are left unset. A string overwritten stays in the text until
+     *       the array is cleared.
+     *
+     * INPT: data - must not point into the text of <array>
+     */
+    int fx;
+    assert(array!=NULL && ix>=0);
 
-    /* If dynamic array is not large enough, geometrically increase size*/
-    if (ix>=array->size) {
-        new_size=grow_array((void**)&array->array, 1+ix, sizeof(char*));
-        array->array=(char**)array->array;
+    reserve_items(array, ix+1);
+    reserve_text(array, array->textLength+length+1);
 
-        /* Initialize newly allocated memory */
-        for (fx=array->size; fx<new_size; fx++) {
-            array->array[fx]=NULL;
-        }
-        array->size=new_size;
+    /* Unset elements between the last held and the one written */
+    for (fx=array->length; fx<ix; fx++) {
+        array->offset[fx]=DSA_NO_ITEM;
     }
 
-    /* Allocate memory for string if required*/
-    if (array->array[ix]==NULL) {
-        array->array[ix]=(char*)malloc(sizeof(char)*(1+word_length));
-    /* Reallocate if overwriting string */
-    } else {
-        array->array[ix]=(char*)realloc(array->array[ix],
-                                                sizeof(char)*(1+word_length));
-    }
-    if (array->array[ix]==NULL) {
-        malloc_fail();
-    }
-
-    /* Copy the string to the allocated memory */
-    strcpy(array->array[ix], word);
+    memcpy(array->text+array->textLength, data, length);
+    array->text[array->textLength+length]='\0';
+    array->offset[ix]=array->textLength;
+    array->textLength+=length+1;
     if (ix+1>array->length) {
         array->length=ix+1;
     }
@@ -83,7 +93,6 @@ dsa_t*
 create_dsa() {
     /* DESC: Creates an dynamic string array
      * OTPT: dsa_t * - Pointer to dynamic string array*/
-    int fx;
 
     /* Allocate memory for array structure.*/
     dsa_t* array;
@@ -91,86 +100,131 @@ create_dsa() {
     if (array==NULL) {
         malloc_fail();
     }
+    init_dsa(array);
+    return(array);
+}
+
+void
+init_dsa(dsa_t* array) {
+    /* DESC: Initialises an empty array in memory the caller holds, such as
+     *       on the stack. Release with free_dsa.
+     */
+    array->offset=array->inlineOffset;
+    array->size=DSA_INLINE_ITEMS;
+    array->length=0;
+    array->text=array->inlineText;
+    array->textSize=DSA_INLINE_TEXT;
+    array->textLength=0;
+}
+
+void
+clear_dsa(dsa_t* array) {
+    /* DESC: Empties the array, keeping the memory it holds for reuse */
+    array->length=0;
+    array->textLength=0;
+}
 
-    /* Allocate memory for strings in array & null init */
-    array->array=(char**)malloc(DYN_ARRAY_INIT_LENGTH*sizeof(char*));
-    for (fx=0; fx<DYN_ARRAY_INIT_LENGTH; fx++) {
-        array->array[fx]=NULL;
+void
+free_dsa(dsa_t* array) {
+    /* DESC: Frees the memory held by an array from init_dsa, leaving it
+     *       empty
+     */
+    if (array->offset!=array->inlineOffset) {
+        free(array->offset);
     }
-    if (array->array==NULL) {
-        malloc_fail();
+    if (array->text!=array->inlineText) {
+        free(array->text);
     }
-    array->size=DYN_ARRAY_INIT_LENGTH;
-    array->length=0;
-    return(array);
+    init_dsa(array);
 }
 
 void
 delete_dsa(dsa_t* array) {
-    /* DESC: Deletes dynamic string array
+    /* DESC: Deletes dynamic string array from create_dsa
      * OTPT: void
      */
-
-    int ix;
     if (array==NULL) {return;}
-    /* Free all strings from memory */
-    for (ix=0;ix<array->length;ix++) {
-        free(array->array[ix]);
-    }
+    free_dsa(array);
     free(array);
-    array=NULL;
 }
 
 const char* getItem_dsa(dsa_t* array, int index) {
 	/**
 	 * Return a const char* to item at index. Null if index invalid or has nothing
 	 */
-	if(index>=array->size){return(NULL);}
-	return((const char*)(array->array[index]));
+	if(index<0 || index>=array->length || array->offset[index]==DSA_NO_ITEM){return(NULL);}
+	return(array->text+array->offset[index]);
 }
 
-int
-grow_array(void** array, int reqd_sz, size_t unit_sz) {
-    /* DESC: Grows an array geometrically to the required size
-     *       Returns the new size
-     *
-     * INPT: void** array - pointer to mallocd void* pointer
-     *
-     *       int required_sz - new minimmum size required. 1base count of units
-     *       array will be required to hold.
-     *
-     *       int unit_sz - size of objects being stored in array
-     *
-     * OTPT: int - the new size of array
-     *
+static void
+reserve_items(dsa_t* array, int reqd_items) {
+    /* DESC: Grows the element index geometrically to hold at least
+     *       <reqd_items>, moving it off the structure the first time
      */
-    int new_sz;
-    new_sz=get_newsize_geometric_growth(reqd_sz);
+    size_t new_size;
+    size_t* offset;
+
+    if (reqd_items<=array->size) {return;}
+    new_size=get_newsize_geometric_growth(array->size, reqd_items);
+    if (array->offset==array->inlineOffset) {
+        offset=(size_t*)malloc(new_size*sizeof(size_t));
+        if (offset!=NULL) {
+            memcpy(offset, array->inlineOffset, array->length*sizeof(size_t));
+        }
+    } else {
+        offset=(size_t*)realloc(array->offset, new_size*sizeof(size_t));
+    }
+    if (offset==NULL) {
+        malloc_fail();
+    }
+    array->offset=offset;
+    array->size=(int)new_size;
+}
 
-    /* Update the address (inside whatever struct being operated on) that points
-     * to the mallocd array. */
-    *array=realloc(*array, new_sz*unit_sz);
-    if (*array==NULL) {
+static void
+reserve_text(dsa_t* array, size_t reqd_bytes) {
+    /* DESC: Grows the packed text geometrically to hold at least
+     *       <reqd_bytes>, moving it off the structure the first time. Only
+     *       offsets refer into the text, so moving it is safe.
+     */
+    size_t new_size;
+    char* text;
+
+    if (reqd_bytes<=array->textSize) {return;}
+    new_size=get_newsize_geometric_growth(array->textSize, reqd_bytes);
+    if (array->text==array->inlineText) {
+        text=(char*)malloc(new_size);
+        if (text!=NULL) {
+            memcpy(text, array->inlineText, array->textLength);
+        }
+    } else {
+        text=(char*)realloc(array->text, new_size);
+    }
+    if (text==NULL) {
         malloc_fail();
     }
-    return(new_sz);
+    array->text=text;
+    array->textSize=new_size;
 }
 
-int get_newsize_geometric_growth(int required_size) {
+static size_t get_newsize_geometric_growth(size_t size, size_t required_size) {
     /* DESC: Returns a new size of an array given a required size such that
      *       growth will be geometric. Skips steps of growth when possible to
      *       prevent unnecessary memory read write operations.
      *
-     * INPT: int required_size - The minimum count of elements the array is to
-     *       hold.
+     * INPT: size_t size - The current size, at least 1.
+     *       size_t required_size - The minimum count of elements the array is
+     *       to hold.
      *
-     * OTPT: int - the new size.
+     * OTPT: size_t - the new size.
      */
-    return((int)pow(2,((int)log2(required_size))+1));
+    while (size<required_size) {
+        size*=2;
+    }
+    return(size);
 }
 
-void malloc_fail() {
+static void malloc_fail() {
     printf("Malloc failed to allocate memory. Program terminating\n");
     exit(EXIT_MALLOC_FAIL);
 }
-
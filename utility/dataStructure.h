@@ -9,16 +9,38 @@
 #ifndef UTILITY_DATASTRUCTURE_H_
 #define UTILITY_DATASTRUCTURE_H_
 
+#include <stddef.h>
+
+#define DSA_INLINE_ITEMS 4      /*elements held before the index is allocated */
+#define DSA_INLINE_TEXT 64      /*bytes of strings held before the text is allocated */
+#define DSA_NO_ITEM ((size_t)-1)
+
+/* Strings packed end to end into one buffer, each null terminated, and
+ * indexed by their offset into it. The first few strings of an array live
+ * inside the structure itself, so short arrays allocate nothing further.
+ * Overwriting an element adds the new string to the end of the buffer, and
+ * clear_dsa empties the array for reuse without freeing. Pointers from
+ * getItem_dsa hold until the array is next written to. An array refers to
+ * its own inline storage, so it is not to be copied by value. */
 typedef struct dynamic_string_array dsa_t;
 struct dynamic_string_array {
-    char** array;
-    int size;       /*element capacity */
-    int length;     /*number of elements held*/
+    int length;             /*number of elements held*/
+    int size;               /*element capacity */
+    size_t* offset;         /*of each element in <text>, DSA_NO_ITEM if never written */
+    char* text;
+    size_t textLength;      /*bytes of <text> used */
+    size_t textSize;        /*bytes of <text> held */
+    size_t inlineOffset[DSA_INLINE_ITEMS];
+    char inlineText[DSA_INLINE_TEXT];
 };
 
 dsa_t *create_dsa();
-void writeto_dsa(dsa_t *array, char* word, int ix);
-void appendto_dsa(dsa_t *array, char* word);
+void init_dsa(dsa_t* array);
+void free_dsa(dsa_t* array);
+void clear_dsa(dsa_t* array);
+void writeto_dsa(dsa_t *array, const char* word, int ix);
+void appendto_dsa(dsa_t *array, const char* word);
+void appendBytes_dsa(dsa_t* array, const char* data, size_t length);
 void delete_dsa(dsa_t* array);
 void append_dsa(dsa_t* dest, dsa_t* source);
 const char* getItem_dsa(dsa_t* array, int ix);
@@ -0,0 +1,40 @@
+/*
+ * hashTool.c
+ *
+ * Non-cryptographic 64 bit hashing of strings and bytes for hash tables.
+ */
+
+#include "hashTool.h"
+
+#define FNV_PRIME 1099511628211ULL
+
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed) {
+	/**
+	 * Return the 64 bit FNV-1a hash of <length> bytes at <data>
+	 *
+	 * ARGS:
+	 * 	seed - starting state. HASH_SEED for a fresh hash, or the result of a
+	 * 	prior call to continue hashing across several buffers
+	 */
+	const unsigned char* scanner=data;
+	uint64_t hash=seed;
+
+	for(size_t ix=0;ix<length;ix++){
+		hash^=scanner[ix];
+		hash*=FNV_PRIME;
+	}
+	return(hash);
+}
+
+uint64_t hashString(const char* s) {
+	/**
+	 * Return the hash of null terminated string <s>, excluding the null
+	 */
+	uint64_t hash=HASH_SEED;
+
+	while(*s!='\0'){
+		hash^=(unsigned char)*s++;
+		hash*=FNV_PRIME;
+	}
+	return(hash);
+}
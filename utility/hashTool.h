@@ -0,0 +1,18 @@
+/*
+ * hashTool.h
+ *
+ * Non-cryptographic 64 bit hashing of strings and bytes for hash tables.
+ */
+
+#ifndef UTILITY_HASHTOOL_H_
+#define UTILITY_HASHTOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_SEED 14695981039346656037ULL
+
+uint64_t hashBytes(const void* data, size_t length, uint64_t seed);
+uint64_t hashString(const char* s);
+
+#endif /* UTILITY_HASHTOOL_H_ */
@@ -0,0 +1,321 @@
+/*
+ * hostnameTool.c
+ *
+ * Matching of hostnames against certificate names without regular expressions
+ * or allocation, singly or through an index of all names of a certificate.
+ */
+#include "hostnameTool.h"
+#include "caseTool.h"
+#include "hashTool.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HOSTNAME_SET_MIN_CAPACITY 4
+
+/* How a certificate name is held by a hostnameIndex_t */
+#define NAME_EXACT 0
+#define NAME_WILDCARD 1
+#define NAME_PARTIAL 2
+
+static int classifyName(const char* name, size_t length);
+static int initSet(hostnameSet_t* set, uint32_t nName);
+static void freeSet(hostnameSet_t* set);
+static void insertSet(hostnameIndex_t* index, hostnameSet_t* set, uint32_t offset, size_t length);
+static int findSet(const hostnameIndex_t* index, const hostnameSet_t* set,
+		const char* name, size_t length);
+static int isWildcardChar(char c);
+
+int matchHostname(const char* pattern, size_t patternLength,
+		const char* hostname, size_t hostnameLength) {
+	/**
+	 * Check <hostname> against the certificate name <pattern>
+	 *
+	 * Comparison is ASCII case insensitive and of the whole name. The leftmost
+	 * label of <pattern> may hold one HOSTNAME_WILDCARD, optionally between a
+	 * literal prefix and suffix (eg "*", "w*", "*-east"). The wildcard stands
+	 * for one or more letters, digits or '-' of the corresponding hostname
+	 * label, so it never spans a '.'. Any other wildcard is literal.
+	 *
+	 * ARGS:
+	 * 	pattern, hostname - names and their lengths, null termination not needed
+	 *
+	 * RETN:
+	 * 	HOSTNAME_MATCH or HOSTNAME_NOMATCH
+	 */
+
+	/* Locate the end of the leftmost labels */
+	const char* patternDot=memchr(pattern, '.', patternLength);
+	const char* hostnameDot=memchr(hostname, '.', hostnameLength);
+	size_t patternLabelLength=(patternDot==NULL)?patternLength:(size_t)(patternDot-pattern);
+	size_t hostnameLabelLength=(hostnameDot==NULL)?hostnameLength:(size_t)(hostnameDot-hostname);
+	const char* wildcard=memchr(pattern, HOSTNAME_WILDCARD, patternLabelLength);
+
+	/* Without a wildcard the names must be identical */
+	if(wildcard==NULL || patternDot==NULL){
+		return((patternLength==hostnameLength && equalFolded(pattern, hostname, patternLength))
+				?HOSTNAME_MATCH:HOSTNAME_NOMATCH);
+	}
+
+	/* Everything after the leftmost label must be identical */
+	size_t patternRest=patternLength-patternLabelLength;
+	if(patternRest!=hostnameLength-hostnameLabelLength
+			|| !equalFolded(patternDot, hostname+hostnameLabelLength, patternRest)){
+		return(HOSTNAME_NOMATCH);
+	}
+
+	/* Leftmost label is <prefix><wildcard><suffix>, wildcard covers at least one char */
+	size_t prefixLength=wildcard-pattern;
+	size_t suffixLength=patternLabelLength-prefixLength-1;
+	if(memchr(wildcard+1, HOSTNAME_WILDCARD, suffixLength)!=NULL
+			|| hostnameLabelLength<prefixLength+suffixLength+1
+			|| !equalFolded(pattern, hostname, prefixLength)
+			|| !equalFolded(wildcard+1, hostname+hostnameLabelLength-suffixLength, suffixLength)){
+		return(HOSTNAME_NOMATCH);
+	}
+	for(size_t ix=prefixLength;ix<hostnameLabelLength-suffixLength;ix++){
+		if(!isWildcardChar(hostname[ix])){
+			return(HOSTNAME_NOMATCH);
+		}
+	}
+	return(HOSTNAME_MATCH);
+}
+
+static int isWildcardChar(char c) {
+	/* Characters a wildcard may stand for, as per WILDCARD_MATCHES of certVerifier.c */
+	return((c>='a' && c<='z') || (c>='A' && c<='Z') || (c>='0' && c<='9') || c=='-');
+}
+
+hostnameIndex_t* create_hostnameIndex(const char* const* names, int nName) {
+	/**
+	 * Build an index of the <nName> certificate names <names>
+	 *
+	 * A hostname found by lookup_hostnameIndex is exactly one that matchHostname
+	 * accepts for some name of <names>.
+	 *
+	 * RETN:
+	 * 	The index, free with delete_hostnameIndex. NULL if memory ran out.
+	 */
+	hostnameIndex_t* index=calloc(1, sizeof(*index));
+	if(index==NULL){return(NULL);}
+
+	/* Size the buffer and each set */
+	uint32_t nExact=0;
+	uint32_t nWildcard=0;
+	size_t bufferLength=1;
+	for(int ix=0;ix<nName;ix++){
+		const char* name=names[ix];
+		size_t length=strlen(name);
+		bufferLength+=length+1;
+		switch(classifyName(name, length)){
+		case NAME_EXACT: nExact++; break;
+		case NAME_WILDCARD: nWildcard++; break;
+		default: index->nPartial++; break;
+		}
+	}
+
+	index->buffer=malloc(bufferLength);
+	index->bufferLength=1;
+	index->partial=malloc(sizeof(uint32_t)*(index->nPartial+1));
+	index->partialLength=malloc(sizeof(uint32_t)*(index->nPartial+1));
+	if(index->buffer==NULL || index->partial==NULL || index->partialLength==NULL
+			|| !initSet(&index->exact, nExact) || !initSet(&index->wildcardParent, nWildcard)){
+		delete_hostnameIndex(index);
+		return(NULL);
+	}
+	index->buffer[0]='\0';
+	index->nPartial=0;
+
+	/* Copy names lower cased into the buffer and place them */
+	for(int ix=0;ix<nName;ix++){
+		const char* name=names[ix];
+		size_t length=strlen(name);
+		uint32_t offset=(uint32_t)index->bufferLength;
+		char* copy=index->buffer+offset;
+		foldBytes(copy, name, length);
+		copy[length]='\0';
+		index->bufferLength+=length+1;
+
+		switch(classifyName(name, length)){
+		case NAME_EXACT:
+			insertSet(index, &index->exact, offset, length);
+			break;
+		case NAME_WILDCARD:
+			/* Index the parent domain "rest" of "*.rest" */
+			insertSet(index, &index->wildcardParent, offset+2, length-2);
+			break;
+		default:
+			index->partial[index->nPartial]=offset;
+			index->partialLength[index->nPartial]=(uint32_t)length;
+			index->nPartial++;
+			break;
+		}
+	}
+	return(index);
+}
+
+int lookup_hostnameIndex(const hostnameIndex_t* index, const char* hostname, size_t hostnameLength) {
+	/**
+	 * Check <hostname> against every name of <index>
+	 *
+	 * RETN:
+	 * 	HOSTNAME_MATCH or HOSTNAME_NOMATCH, as matchHostname over the names
+	 */
+	char folded[HOSTNAME_MAX_LENGTH];
+	const char* rest=NULL;		/* Lower cased, after the leftmost label */
+	size_t labelLength;
+
+	if(hostnameLength<=HOSTNAME_MAX_LENGTH){
+		labelLength=foldBytes(folded, hostname, hostnameLength);
+
+		/* One probe for an identical name */
+		if(findSet(index, &index->exact, folded, hostnameLength)){
+			return(HOSTNAME_MATCH);
+		}
+		rest=(labelLength<hostnameLength)?folded+labelLength+1:NULL;
+	} else {
+		/* Too long for any name of <exact>, but "*.rest" still covers it if
+		 * "rest" is short enough to be indexed */
+		const char* dot=memchr(hostname, '.', hostnameLength);
+		labelLength=(dot==NULL)?hostnameLength:(size_t)(dot-hostname);
+		if(dot!=NULL && hostnameLength-labelLength-1<=HOSTNAME_MAX_LENGTH){
+			foldBytes(folded, dot+1, hostnameLength-labelLength-1);
+			rest=folded;
+		}
+	}
+
+	/* One probe for "*.rest" where the leftmost label could stand for the wildcard */
+	if(rest!=NULL && labelLength>0){
+		int wildcardable=1;
+		for(size_t ix=0;ix<labelLength && wildcardable;ix++){
+			wildcardable=isWildcardChar(hostname[ix]);
+		}
+		if(wildcardable && findSet(index, &index->wildcardParent, rest,
+				hostnameLength-labelLength-1)){
+			return(HOSTNAME_MATCH);
+		}
+	}
+
+	/* Remaining names */
+	for(int ix=0;ix<index->nPartial;ix++){
+		if(matchHostname(index->buffer+index->partial[ix], index->partialLength[ix],
+				hostname, hostnameLength)==HOSTNAME_MATCH){
+			return(HOSTNAME_MATCH);
+		}
+	}
+	return(HOSTNAME_NOMATCH);
+}
+
+size_t footprint_hostnameIndex(const hostnameIndex_t* index) {
+	/**
+	 * Return the approximate bytes held by <index>
+	 */
+	size_t slotSize=sizeof(uint64_t)+sizeof(uint32_t)+sizeof(uint16_t);
+	return(sizeof(*index)+index->bufferLength
+			+(index->exact.capacity+index->wildcardParent.capacity)*slotSize
+			+(index->nPartial+1)*2*sizeof(uint32_t));
+}
+
+const char* nextName_hostnameIndex(const hostnameIndex_t* index, const char* name) {
+	/**
+	 * Iterate the names of <index>, lower cased and in the order given
+	 *
+	 * ARGS:
+	 * 	name - NULL for the first name, else the name previously returned
+	 *
+	 * RETN:
+	 * 	The next name, NULL once all have been returned
+	 */
+	name=(name==NULL)?index->buffer+1:name+strlen(name)+1;
+	if(name>=index->buffer+index->bufferLength){
+		return(NULL);
+	}
+	return(name);
+}
+
+void delete_hostnameIndex(hostnameIndex_t* index) {
+	if(index==NULL){return;}
+	freeSet(&index->exact);
+	freeSet(&index->wildcardParent);
+	free(index->buffer);
+	free(index->partial);
+	free(index->partialLength);
+	free(index);
+}
+
+static int classifyName(const char* name, size_t length) {
+	/**
+	 * Return how <name> is indexed, as per the rules of matchHostname
+	 */
+	const char* dot=memchr(name, '.', length);
+	size_t labelLength=(dot==NULL)?length:(size_t)(dot-name);
+
+	if(length>HOSTNAME_MAX_LENGTH){
+		return(NAME_PARTIAL);
+	}
+	if(dot==NULL || memchr(name, HOSTNAME_WILDCARD, labelLength)==NULL){
+		return(NAME_EXACT);
+	}
+	if(labelLength==1){
+		return(NAME_WILDCARD);
+	}
+	return(NAME_PARTIAL);
+}
+
+static int initSet(hostnameSet_t* set, uint32_t nName) {
+	/**
+	 * Allocate empty slots for <nName> names at no more than half load
+	 */
+	set->capacity=HOSTNAME_SET_MIN_CAPACITY;
+	while(set->capacity<nName*2){
+		set->capacity*=2;
+	}
+	set->hash=malloc(sizeof(uint64_t)*set->capacity);
+	set->offset=calloc(set->capacity, sizeof(uint32_t));
+	set->length=malloc(sizeof(uint16_t)*set->capacity);
+	return(set->hash!=NULL && set->offset!=NULL && set->length!=NULL);
+}
+
+static void freeSet(hostnameSet_t* set) {
+	free(set->hash);
+	free(set->offset);
+	free(set->length);
+}
+
+static void insertSet(hostnameIndex_t* index, hostnameSet_t* set, uint32_t offset, size_t length) {
+	/**
+	 * Place the name at <offset> of the index buffer in <set>, unless already held
+	 */
+	const char* name=index->buffer+offset;
+	uint64_t hash=hashBytes(name, length, HASH_SEED);
+	uint32_t slot=(uint32_t)hash&(set->capacity-1);
+
+	while(set->offset[slot]!=0){
+		if(set->hash[slot]==hash && set->length[slot]==length
+				&& memcmp(index->buffer+set->offset[slot], name, length)==0){
+			return;
+		}
+		slot=(slot+1)&(set->capacity-1);
+	}
+	set->hash[slot]=hash;
+	set->offset[slot]=offset;
+	set->length[slot]=(uint16_t)length;
+}
+
+static int findSet(const hostnameIndex_t* index, const hostnameSet_t* set,
+		const char* name, size_t length) {
+	/**
+	 * Return 1 if lower cased <name> is held in <set>
+	 */
+	uint64_t hash=hashBytes(name, length, HASH_SEED);
+	uint32_t slot=(uint32_t)hash&(set->capacity-1);
+
+	while(set->offset[slot]!=0){
+		if(set->hash[slot]==hash && set->length[slot]==length
+				&& memcmp(index->buffer+set->offset[slot], name, length)==0){
+			return(1);
+		}
+		slot=(slot+1)&(set->capacity-1);
+	}
+	return(0);
+}
@@ -0,0 +1,56 @@
+/*
+ * hostnameTool.h
+ *
+ * Hostname matching against certificate names, see hostnameTool.c.
+ */
+
+#ifndef UTILITY_HOSTNAMETOOL_H_
+#define UTILITY_HOSTNAMETOOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HOSTNAME_MATCH 1
+#define HOSTNAME_NOMATCH 0
+
+/* Wildcard character of a certificate name, see matchHostname */
+#define HOSTNAME_WILDCARD '*'
+
+/* Longest hostname as per RFC1035, longer certificate names are never indexed */
+#define HOSTNAME_MAX_LENGTH 255
+
+/* Open addressing set of lower cased names held in a shared buffer */
+typedef struct hostname_set hostnameSet_t;
+struct hostname_set {
+	uint64_t* hash;
+	uint32_t* offset;		/* Offset of a name in the index buffer, 0 if slot empty */
+	uint16_t* length;
+	uint32_t capacity;		/* Always a power of 2 */
+};
+
+/* Certificate names arranged for lookup of a hostname.
+ *
+ * Names without a wildcard are held in <exact>. Names of the form "*.rest" are
+ * held as "rest" in <wildcardParent>, so a hostname is checked with one probe
+ * of each. Other wildcard forms (eg "w*.rest") are few and kept in <partial>
+ * for a linear matchHostname scan. */
+typedef struct hostname_index hostnameIndex_t;
+struct hostname_index {
+	char* buffer;			/* Null terminated names from offset 1 */
+	size_t bufferLength;
+	hostnameSet_t exact;
+	hostnameSet_t wildcardParent;
+	uint32_t* partial;		/* Offsets of names matched by scanning */
+	uint32_t* partialLength;
+	int nPartial;
+};
+
+int matchHostname(const char* pattern, size_t patternLength,
+		const char* hostname, size_t hostnameLength);
+hostnameIndex_t* create_hostnameIndex(const char* const* names, int nName);
+int lookup_hostnameIndex(const hostnameIndex_t* index, const char* hostname, size_t hostnameLength);
+size_t footprint_hostnameIndex(const hostnameIndex_t* index);
+const char* nextName_hostnameIndex(const hostnameIndex_t* index, const char* name);
+void delete_hostnameIndex(hostnameIndex_t* index);
+
+#endif /* UTILITY_HOSTNAMETOOL_H_ */
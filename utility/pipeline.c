@@ -0,0 +1,170 @@
+/*
+ * pipeline.c
+ *
+ * Reader -> worker pool -> writer pipeline which preserves input order.
+ *
+ * Items live in a ring of <window> slots. The reader fills the slot after the
+ * last read item, workers claim filled slots in read order and mark them done,
+ * and the writer drains done slots strictly in read order. The reader blocks
+ * once <window> items are read but not yet written, bounding memory.
+ */
+#include "pipeline.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct pipeline pipeline_t;
+struct pipeline {
+	void** item;
+	char* done;
+	long window;
+	long nRead;			/* Items placed in the ring */
+	long nClaimed;		/* Items taken by a worker */
+	long nWritten;		/* Items handed to the writer */
+	int readDone;
+
+	pipelineProcess_t process;
+	pipelineWrite_t write;
+	void* context;
+
+	pthread_mutex_t lock;
+	pthread_cond_t canRead;
+	pthread_cond_t canClaim;
+	pthread_cond_t canWrite;
+};
+
+static void* workerMain(void* argument);
+static void* writerMain(void* argument);
+
+int runPipeline(int nWorker, int window, pipelineRead_t read,
+		pipelineProcess_t process, pipelineWrite_t write, void* context) {
+	/**
+	 * Run items from <read> through <process> on <nWorker> threads and into
+	 * <write> in their original order. Reading happens on the calling thread.
+	 *
+	 * ARGS:
+	 * 	window - maximum items in flight between read and write, at least nWorker
+	 *
+	 * RETN:
+	 * 	0 once every item has been written, -1 if threads could not be started
+	 */
+	pipeline_t p;
+	pthread_t* worker=malloc(sizeof(pthread_t)*nWorker);
+	pthread_t writer;
+	int nStarted=0;
+	int status=0;
+
+	if(window<nWorker){window=nWorker;}
+	p.window=window;
+	p.item=malloc(sizeof(void*)*window);
+	p.done=calloc(window, sizeof(char));
+	p.nRead=p.nClaimed=p.nWritten=0;
+	p.readDone=0;
+	p.process=process;
+	p.write=write;
+	p.context=context;
+	pthread_mutex_init(&p.lock, NULL);
+	pthread_cond_init(&p.canRead, NULL);
+	pthread_cond_init(&p.canClaim, NULL);
+	pthread_cond_init(&p.canWrite, NULL);
+
+	if(worker==NULL || p.item==NULL || p.done==NULL
+			|| pthread_create(&writer, NULL, writerMain, &p)!=0){
+		free(worker); free(p.item); free(p.done);
+		return(-1);
+	}
+	while(nStarted<nWorker && pthread_create(&worker[nStarted], NULL, workerMain, &p)==0){
+		nStarted++;
+	}
+	if(nStarted==0){
+		status=-1;
+	}
+
+	/* Read stage */
+	void* item;
+	while(status==0 && (item=read(context))!=NULL){
+		pthread_mutex_lock(&p.lock);
+		while(p.nRead-p.nWritten>=p.window){
+			pthread_cond_wait(&p.canRead, &p.lock);
+		}
+		long slot=p.nRead%p.window;
+		p.item[slot]=item;
+		p.done[slot]=0;
+		p.nRead++;
+		pthread_cond_signal(&p.canClaim);
+		pthread_mutex_unlock(&p.lock);
+	}
+
+	/* Drain */
+	pthread_mutex_lock(&p.lock);
+	p.readDone=1;
+	pthread_cond_broadcast(&p.canClaim);
+	pthread_cond_signal(&p.canWrite);
+	pthread_mutex_unlock(&p.lock);
+
+	for(int ix=0;ix<nStarted;ix++){
+		pthread_join(worker[ix], NULL);
+	}
+	pthread_join(writer, NULL);
+
+	pthread_mutex_destroy(&p.lock);
+	pthread_cond_destroy(&p.canRead);
+	pthread_cond_destroy(&p.canClaim);
+	pthread_cond_destroy(&p.canWrite);
+	free(p.item);
+	free(p.done);
+	free(worker);
+	return(status);
+}
+
+static void* workerMain(void* argument) {
+	pipeline_t* p=argument;
+
+	pthread_mutex_lock(&p->lock);
+	for(;;){
+		while(p->nClaimed==p->nRead && !p->readDone){
+			pthread_cond_wait(&p->canClaim, &p->lock);
+		}
+		if(p->nClaimed==p->nRead){break;}
+
+		long seq=p->nClaimed++;
+		void* item=p->item[seq%p->window];
+		pthread_mutex_unlock(&p->lock);
+
+		p->process(p->context, item);
+
+		pthread_mutex_lock(&p->lock);
+		p->done[seq%p->window]=1;
+		if(seq==p->nWritten){
+			pthread_cond_signal(&p->canWrite);
+		}
+	}
+	pthread_mutex_unlock(&p->lock);
+	return(NULL);
+}
+
+static void* writerMain(void* argument) {
+	pipeline_t* p=argument;
+
+	pthread_mutex_lock(&p->lock);
+	for(;;){
+		long slot=p->nWritten%p->window;
+		while(!(p->nWritten<p->nRead && p->done[slot])
+				&& !(p->readDone && p->nWritten==p->nRead)){
+			pthread_cond_wait(&p->canWrite, &p->lock);
+		}
+		if(p->nWritten==p->nRead){break;}
+
+		void* item=p->item[slot];
+		pthread_mutex_unlock(&p->lock);
+
+		p->write(p->context, item);
+
+		pthread_mutex_lock(&p->lock);
+		p->done[slot]=0;
+		p->nWritten++;
+		pthread_cond_signal(&p->canRead);
+	}
+	pthread_mutex_unlock(&p->lock);
+	return(NULL);
+}
@@ -0,0 +1,22 @@
+/*
+ * pipeline.h
+ *
+ * Order preserving reader, worker pool and writer pipeline, see pipeline.c.
+ */
+
+#ifndef UTILITY_PIPELINE_H_
+#define UTILITY_PIPELINE_H_
+
+/* Produce the next item, or NULL once input is exhausted. Called from one thread. */
+typedef void* (*pipelineRead_t)(void* context);
+
+/* Work on an item. Called concurrently from every worker thread. */
+typedef void (*pipelineProcess_t)(void* context, void* item);
+
+/* Consume a processed item. Called from one thread, in the order items were read. */
+typedef void (*pipelineWrite_t)(void* context, void* item);
+
+int runPipeline(int nWorker, int window, pipelineRead_t read,
+		pipelineProcess_t process, pipelineWrite_t write, void* context);
+
+#endif /* UTILITY_PIPELINE_H_ */
@@ -16,12 +16,18 @@
 #define true 1
 #define false 0
 
+static char* replaceMatchWith(arena_t* arena, const char* regex, const char* source, char* replacement);
+
 dsa_t* extractAllMatch(const char* regex, const char* searchString){
+	/**
+	 * Return every match of <regex> in <searchString>, in order, packed into
+	 * one array without copying each match separately
+	 */
 	dsa_t* array=create_dsa();
-	int ix=0;
-	char* buffer;
-	while( (searchString=extractMatch(regex, searchString, &buffer))!=NULL){
-		writeto_dsa(array, buffer, ix++);
+	regmatch_t match;
+	while(findMatchAt(regex, searchString, &match)==MATCH){
+		appendBytes_dsa(array, searchString+match.rm_so, match.rm_eo-match.rm_so);
+		searchString+=match.rm_eo;
 	}
 	return(array);
 }
@@ -30,7 +36,7 @@ const char* extractMatch(const char* regex, const char* searchString, char** des
 	/**
 	 * Search <string> for match with <regex> Write match into <destination>
 	 *
-	 * Terminates if an error occured
+	 * NULL if <regex> cannot be compiled
 	 *
 	 * ARGUMENT:
 	 *
@@ -72,8 +78,6 @@ regmatch_t* findMatch(const char* regex, const char* searchString) {
 	/**
 	 * Search <string> for match with <regex> and return a structure encoding its address
 	 *
-	 * Program terminates if <regex> cannot be compiled
-	 *
 	 * ARGUMENT:
 	 * 	searchString - string to search
 	 * 	regex		 - Posix ERE to match with. $ metachar ignored.
@@ -83,14 +87,30 @@ regmatch_t* findMatch(const char* regex, const char* searchString) {
 	 * 		regmatch_t* match location. User is responsible for freeing this
 	 *
 	 * NOTE:
-	 * 	always uses extended regexes.
+	 * 	always uses extended regexes. findMatchAt avoids the allocation.
 	 */
-	regex_t rx;
 	regmatch_t* match=malloc(sizeof(regmatch_t));
 
+	if (findMatchAt(regex, searchString, match)==MATCH) {
+		return(match);
+	}
+
+	/* No match found */
+	free(match);
+	return(NULL);
+}
+
+int findMatchAt(const char* regex, const char* searchString, regmatch_t* match) {
+	/**
+	 * As findMatch, but write the match location into <match>
+	 *
+	 * RETURN:
+	 * 	MATCH, NOMATCH or EREGCOMP if <regex> cannot be compiled
+	 */
+	regex_t rx;
+
 	int errSize=100; // Default error message size
 	int error = regcomp(&rx, regex, REG_EXTENDED);
-	int matchSize;
 
 	/* Check compilation sucessful */
 	if(error!=0){
@@ -98,7 +118,7 @@ regmatch_t* findMatch(const char* regex, const char* searchString) {
 		regerror(error,&rx,errorMessage,errSize);
 		mylog("Regex compilation error");
 		mylog(errorMessage);
-		exit(EREGCOMP);
+		return(EREGCOMP);
 	}
 
 	/* Match */
@@ -106,11 +126,11 @@ regmatch_t* findMatch(const char* regex, const char* searchString) {
 	regfree(&rx);
 
 	if (error!=REG_NOMATCH) {
-		return(match);
+		return(MATCH);
 	}
 
 	/* No match found */
-	return(NULL);
+	return(NOMATCH);
 }
 
 char* jumpMatch(const char* regex, const char* searchString) {
@@ -131,7 +151,8 @@ char* jumpMatch(const char* regex, const char* searchString) {
 
 int isMatch(const char* regex, const char* searchString){
 	/**
-	 * Return true/false indicating wether <regex> matches <searchString>
+	 * Return true/false indicating wether <regex> matches <searchString>,
+	 * or EREGCOMP if <regex> cannot be compiled
 	 *
 	 * Matching is case insensitive
 	 */
@@ -147,7 +168,7 @@ int isMatch(const char* regex, const char* searchString){
 		regerror(error,&rx,errorMessage,errSize);
 		mylog("Regex compilation error");
 		mylog(errorMessage);
-		exit(EREGCOMP);
+		return(EREGCOMP);
 	}
 
 	/* Match */
@@ -176,22 +197,38 @@ char* replaceMatch(const char* regex, const char* source, char* replacement) {
 	 * NOTE:
 	 * 	all arguments must be null terminated
 	 */
-	regmatch_t* match = findMatch(regex, source);
-	if(match==NULL){return(NULL);}
-	int matchLength = match->rm_eo-match->rm_so;
-	int matchPrefixLength = match->rm_so;
+	return(replaceMatchWith(NULL, regex, source, replacement));
+}
+
+char* replaceMatchArena(arena_t* arena, const char* regex, const char* source, char* replacement) {
+	/**
+	 * As replaceMatch, but the result is allocated from <arena>
+	 */
+	return(replaceMatchWith(arena, regex, source, replacement));
+}
+
+static char* replaceMatchWith(arena_t* arena, const char* regex, const char* source, char* replacement) {
+	/**
+	 * Implements replaceMatch, allocating from <arena> or the heap if NULL
+	 */
+	regmatch_t match;
+	if(findMatchAt(regex, source, &match)!=MATCH){return(NULL);}
+	int matchLength = match.rm_eo-match.rm_so;
+	int matchPrefixLength = match.rm_so;
 	int replacementLength=strlen(replacement);
 	int sourceLength=strlen(source);
 	int resultLength=(sourceLength-matchLength+replacementLength);
 
 	/* Memory for new string, assumes match never contains terminating null byte */
-	char* newString = malloc(sizeof(char)*(resultLength+1));
+	char* newString = (arena==NULL)
+			?malloc(sizeof(char)*(resultLength+1))
+			:alloc_arena(arena, sizeof(char)*(resultLength+1));
 
 	/* Assemble new string */
 	char* newStringScanner = newString;
 
 	/* Copy over what lies before match */
-	if(match->rm_so>0){
+	if(match.rm_so>0){
 		memcpy(newStringScanner, source, matchPrefixLength);
 	}
 	newStringScanner+=matchPrefixLength;
@@ -199,8 +236,7 @@ char* replaceMatch(const char* regex, const char* source, char* replacement) {
 	memcpy(newStringScanner, replacement, replacementLength);
 	newStringScanner+=replacementLength;
 
-	strcpy(newStringScanner, source+match->rm_eo);
+	strcpy(newStringScanner, source+match.rm_eo);
 
-	free(match);
 	return(newString);
 }
@@ -8,6 +8,7 @@
 #ifndef UTILITY_REGEXTOOL_H_
 #define UTILITY_REGEXTOOL_H_
 
+#include "arena.h"
 #include "dataStructure.h"
 #include <regex.h>
 
@@ -19,7 +20,9 @@ const char* extractMatch(const char* regex, const char* searchString, char** des
 dsa_t* extractAllMatch(const char* regex, const char* searchString);
 int isMatch(const char* regex, const char* searchString);
 regmatch_t* findMatch(const char* regex, const char* searchString);
+int findMatchAt(const char* regex, const char* searchString, regmatch_t* match);
 char* jumpMatch(const char* regex, const char* searchString);
 char* replaceMatch(const char* regex, const char* source, char* replacement);
+char* replaceMatchArena(arena_t* arena, const char* regex, const char* source, char* replacement);
 
 #endif /* UTILITY_REGEXTOOL_H_ */
@@ -0,0 +1,136 @@
+/*
+ * timing.c
+ *
+ * Monotonic clock reads and latency histograms for stage timing and benchmarks.
+ */
+
+#include "timing.h"
+
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#define EXIT_MALLOC_FAIL 115
+
+static int bucketOf(uint64_t nanoseconds);
+static uint64_t bucketUpperBound(int bucket);
+
+uint64_t nowNanoseconds(void) {
+	/**
+	 * Return a monotonic timestamp in nanoseconds, only meaningful as the
+	 * difference of two calls
+	 */
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return((uint64_t)now.tv_sec*NANOSECONDS_PER_SECOND+(uint64_t)now.tv_nsec);
+}
+
+latencyHistogram_t* create_latencyHistogram(void) {
+	/**
+	 * Create an empty histogram, delete with delete_latencyHistogram
+	 */
+	latencyHistogram_t* histogram=calloc(1, sizeof(*histogram));
+	if(histogram==NULL){
+		fprintf(stderr, "Malloc failed to allocate memory. Program terminating\n");
+		exit(EXIT_MALLOC_FAIL);
+	}
+	return(histogram);
+}
+
+void delete_latencyHistogram(latencyHistogram_t* histogram) {
+	free(histogram);
+}
+
+void recordLatency(latencyHistogram_t* histogram, uint64_t nanoseconds) {
+	/**
+	 * Count one duration of <nanoseconds>
+	 */
+	__atomic_fetch_add(&histogram->count[bucketOf(nanoseconds)], 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&histogram->total, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&histogram->sum, nanoseconds, __ATOMIC_RELAXED);
+
+	uint64_t max=__atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+	while(nanoseconds>max && !__atomic_compare_exchange_n(&histogram->max, &max,
+			nanoseconds, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+uint64_t percentileLatency(const latencyHistogram_t* histogram, double percentile) {
+	/**
+	 * Return the duration at or below which <percentile> percent of recorded
+	 * durations fall, rounded up to its bucket's bound. Not to be called
+	 * while durations are still being recorded.
+	 */
+	if(histogram->total==0){
+		return(0);
+	}
+	uint64_t rank=(uint64_t)(histogram->total*percentile/100.0);
+	if(rank==0){
+		rank=1;
+	}
+
+	uint64_t seen=0;
+	for(int bucket=0;bucket<LATENCY_BUCKETS;bucket++){
+		seen+=histogram->count[bucket];
+		if(seen>=rank){
+			uint64_t bound=bucketUpperBound(bucket);
+			return((bound<histogram->max)?bound:histogram->max);
+		}
+	}
+	return(histogram->max);
+}
+
+void printLatencyHistogram(FILE* stream, const latencyHistogram_t* histogram) {
+	/**
+	 * Print the count of durations in each power of two range to <stream>,
+	 * one indented line per range that has any
+	 */
+	for(int range=0;range<LATENCY_BUCKETS/LATENCY_SUB_BUCKETS;range++){
+		uint64_t count=0;
+		for(int sub=0;sub<LATENCY_SUB_BUCKETS;sub++){
+			count+=histogram->count[range*LATENCY_SUB_BUCKETS+sub];
+		}
+		if(count!=0){
+			uint64_t bound=bucketUpperBound((range+1)*LATENCY_SUB_BUCKETS-1);
+			fprintf(stream, "\t<=%10.1fus %10lu %5.1f%%\n", bound/1000.0, (unsigned long)count,
+					100.0*count/histogram->total);
+		}
+	}
+}
+
+long peakResidentKiB(void) {
+	/**
+	 * Return the peak resident set size of the process in KiB
+	 */
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage)!=0){
+		return(0);
+	}
+	return(usage.ru_maxrss);
+}
+
+static int bucketOf(uint64_t nanoseconds) {
+	/**
+	 * Durations below LATENCY_SUB_BUCKETS have a bucket each, above that the
+	 * top LATENCY_SUB_BUCKET_BITS bits below the leading one pick the bucket
+	 * within its power of two
+	 */
+	if(nanoseconds<LATENCY_SUB_BUCKETS){
+		return((int)nanoseconds);
+	}
+	int magnitude=63-__builtin_clzll(nanoseconds);
+	int shift=magnitude-LATENCY_SUB_BUCKET_BITS;
+	return(((shift+1)<<LATENCY_SUB_BUCKET_BITS)
+			+(int)((nanoseconds>>shift)&(LATENCY_SUB_BUCKETS-1)));
+}
+
+static uint64_t bucketUpperBound(int bucket) {
+	/**
+	 * Return the largest duration counted in <bucket>
+	 */
+	if(bucket<LATENCY_SUB_BUCKETS){
+		return((uint64_t)bucket);
+	}
+	int shift=(bucket>>LATENCY_SUB_BUCKET_BITS)-1;
+	uint64_t mantissa=LATENCY_SUB_BUCKETS+(uint64_t)(bucket&(LATENCY_SUB_BUCKETS-1));
+	return(((mantissa+1)<<shift)-1);
+}
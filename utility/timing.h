@@ -0,0 +1,39 @@
+/*
+ * timing.h
+ *
+ * Monotonic clock reads and latency histograms, see timing.c.
+ */
+
+#ifndef UTILITY_TIMING_H_
+#define UTILITY_TIMING_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define NANOSECONDS_PER_SECOND 1000000000ULL
+
+/* Each power of two range of durations is split into this many buckets,
+ * bounding the error of a percentile to 1/16th of its value */
+#define LATENCY_SUB_BUCKET_BITS 4
+#define LATENCY_SUB_BUCKETS (1<<LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_BUCKETS ((64-LATENCY_SUB_BUCKET_BITS+1)*LATENCY_SUB_BUCKETS)
+
+/* Histogram of durations in nanoseconds, safe to record into from several
+ * threads at once */
+typedef struct latency_histogram latencyHistogram_t;
+struct latency_histogram {
+	uint64_t count[LATENCY_BUCKETS];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t max;
+};
+
+uint64_t nowNanoseconds(void);
+latencyHistogram_t* create_latencyHistogram(void);
+void delete_latencyHistogram(latencyHistogram_t* histogram);
+void recordLatency(latencyHistogram_t* histogram, uint64_t nanoseconds);
+uint64_t percentileLatency(const latencyHistogram_t* histogram, double percentile);
+void printLatencyHistogram(FILE* stream, const latencyHistogram_t* histogram);
+long peakResidentKiB(void);
+
+#endif /* UTILITY_TIMING_H_ */